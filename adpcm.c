@@ -0,0 +1,221 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "adpcm.h"
+
+#define ADPCM_STEPS 89
+
+static const int16 adpcm_steps[ADPCM_STEPS] = {
+    7,     8,     9,     10,    11,    12,    13,    14,    16,    17,
+    19,    21,    23,    25,    28,    31,    34,    37,    41,    45,
+    50,    55,    60,    66,    73,    80,    88,    97,    107,   118,
+    130,   143,   157,   173,   190,   209,   230,   253,   279,   307,
+    337,   371,   408,   449,   494,   544,   598,   658,   724,   796,
+    876,   963,   1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+    2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,
+    5894,  6484,  7132,  7845,  8630,  9493,  10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+static const int8 adpcm_index_change[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+// Indexed by step index and nibble
+static int32 adpcm_diff[ADPCM_STEPS][16];
+static uint8 adpcm_next[ADPCM_STEPS][16];
+static bool adpcm_tables_ready = false;
+
+static void build_tables(void) {
+  for (int i = 0; i < ADPCM_STEPS; ++i)
+    for (int n = 0; n < 16; ++n) {
+      int32 step = adpcm_steps[i];
+      int32 diff = step >> 3;
+      if (n & 4)
+        diff += step;
+      if (n & 2)
+        diff += step >> 1;
+      if (n & 1)
+        diff += step >> 2;
+      adpcm_diff[i][n] = n & 8 ? -diff : diff;
+      int next = i + adpcm_index_change[n & 7];
+      adpcm_next[i][n] = next < 0 ? 0 : next >= ADPCM_STEPS ? ADPCM_STEPS - 1
+                                                           : next;
+    }
+  adpcm_tables_ready = true;
+}
+
+static inline int32 clamp16(int32 s) {
+  return s > 32767 ? 32767 : s < -32768 ? -32768 : s;
+}
+
+// Runs fn on each sample of the block in turn, two nibbles to a byte with
+// the low one first
+#define ADPCM_STEP(n, i, fn)                                                   \
+  {                                                                            \
+    pred = clamp16(pred + adpcm_diff[idx][n]);                                 \
+    idx = adpcm_next[idx][n];                                                  \
+    fn(i, pred);                                                               \
+  }
+#define ADPCM_DECODE(block, count, fn)                                         \
+  {                                                                            \
+    int32 pred = (int16)((block)[0] | (block)[1] << 8);                        \
+    uint32 idx = (block)[2] < ADPCM_STEPS ? (block)[2] : ADPCM_STEPS - 1;      \
+    const uint8 *nibbles = (block) + 4;                                        \
+    uint32 i = 1;                                                              \
+    if (!adpcm_tables_ready)                                                   \
+      build_tables();                                                          \
+    if ((count) > 0)                                                           \
+      fn(0, pred);                                                             \
+    for (; i + 2 <= (count); i += 2) {                                         \
+      uint32 byte = *nibbles++;                                                \
+      ADPCM_STEP(byte & 15, i, fn);                                            \
+      ADPCM_STEP(byte >> 4, i + 1, fn);                                        \
+    }                                                                          \
+    if (i < (count))                                                           \
+      ADPCM_STEP(*nibbles & 15, i, fn);                                        \
+  }
+
+void adpcm_decode_block(const uint8 *block, int16 *out, uint32 count) {
+#define PUT16(i, s) out[i] = (int16)(s)
+  ADPCM_DECODE(block, count, PUT16);
+#undef PUT16
+}
+
+void adpcm_decode_block8(const uint8 *block, int8 *out, uint32 count) {
+#define PUT8(i, s) out[i] = (int8)((s) >> 8)
+  ADPCM_DECODE(block, count, PUT8);
+#undef PUT8
+}
+
+int16 adpcm_sample_at(const AdpcmSound *sound, uint32 index) {
+  int16 last = 0;
+  if (index >= sound->length)
+    return 0;
+#define KEEP(i, s) last = (int16)(s)
+  ADPCM_DECODE(sound->data +
+                   (index / ADPCM_BLOCK_SAMPLES) * ADPCM_BLOCK_BYTES,
+               index % ADPCM_BLOCK_SAMPLES + 1, KEEP);
+#undef KEEP
+  return last;
+}
+
+void adpcm_encode_block(const int16 *in, uint32 count, uint8 *block,
+                        int *index) {
+  if (!adpcm_tables_ready)
+    build_tables();
+  int32 pred = count > 0 ? in[0] : 0;
+  uint32 idx = *index;
+  memset(block, 0, ADPCM_BLOCK_BYTES);
+  block[0] = LOWBYTE(pred);
+  block[1] = HIBYTE(pred);
+  block[2] = (uint8)idx;
+  for (uint32 i = 1; i < ADPCM_BLOCK_SAMPLES; ++i) {
+    int32 sample = i < count ? in[i] : pred;
+    int32 delta = sample - pred;
+    int32 step = adpcm_steps[idx];
+    uint32 n = 0;
+    if (delta < 0) {
+      n = 8;
+      delta = -delta;
+    }
+    if (delta >= step) {
+      n |= 4;
+      delta -= step;
+    }
+    if (delta >= step >> 1) {
+      n |= 2;
+      delta -= step >> 1;
+    }
+    if (delta >= step >> 2)
+      n |= 1;
+    // Step the same way as the decoder, so it doesn't drift
+    pred = clamp16(pred + adpcm_diff[idx][n]);
+    idx = adpcm_next[idx][n];
+    block[4 + ((i - 1) >> 1)] |= n << (((i - 1) & 1) << 2);
+  }
+  *index = idx;
+}
+
+typedef PACKED_STRUCT AdpcmChunkHeader {
+  char id[4];
+  uint32 size;
+}
+AdpcmChunkHeader;
+
+typedef PACKED_STRUCT AdpcmWavFmt {
+  uint16 format_tag;
+  uint16 channels;
+  uint32 rate;
+  uint32 byte_rate;
+  uint16 block_align;
+  uint16 bits;
+}
+AdpcmWavFmt;
+
+RESULT adpcm_load_wav(AdpcmSound *sound, const char *path) {
+  AdpcmChunkHeader chunk;
+  char wave[4];
+  uint32 fact_length = 0;
+  bool have_fmt = false;
+  memset(sound, 0, sizeof(*sound));
+  FILE *f = fopen(path, "rb");
+  CHECKERR(f == NULL, "Can't open %s\n", path);
+  CHECKERR(fread(&chunk, sizeof(chunk), 1, f) != 1 ||
+               memcmp(chunk.id, "RIFF", 4) != 0 ||
+               fread(wave, sizeof(wave), 1, f) != 1 ||
+               memcmp(wave, "WAVE", 4) != 0,
+           "%s isn't a WAV file\n", path);
+  for (;;) {
+    CHECKERR(fread(&chunk, sizeof(chunk), 1, f) != 1, "%s has no data\n",
+             path);
+    if (memcmp(chunk.id, "fmt ", 4) == 0) {
+      AdpcmWavFmt fmt;
+      CHECKERR(chunk.size < sizeof(fmt) || fread(&fmt, sizeof(fmt), 1, f) != 1,
+               "Bad format chunk in %s\n", path);
+      CHECKERR(fmt.format_tag != ADPCM_WAV_FORMAT || fmt.channels != 1 ||
+                   fmt.block_align != ADPCM_BLOCK_BYTES || fmt.bits != 4,
+               "%s isn't mono IMA ADPCM with %d byte blocks\n", path,
+               ADPCM_BLOCK_BYTES);
+      sound->rate = fmt.rate;
+      have_fmt = true;
+      chunk.size -= sizeof(fmt);
+    } else if (memcmp(chunk.id, "fact", 4) == 0 && chunk.size >= 4) {
+      CHECKERR(fread(&fact_length, 4, 1, f) != 1, "Truncated %s\n", path);
+      chunk.size -= 4;
+    } else if (memcmp(chunk.id, "data", 4) == 0) {
+      CHECKERR(!have_fmt, "%s has no format\n", path);
+      break;
+    }
+    CHECKERR(fseek(f, chunk.size + (chunk.size & 1), SEEK_CUR) != 0,
+             "Truncated %s\n", path);
+  }
+
+  uint32 blocks = chunk.size / ADPCM_BLOCK_BYTES;
+  uint32 rest = chunk.size % ADPCM_BLOCK_BYTES;
+  // A short last block holds its header sample and two per byte after it
+  sound->length = blocks * ADPCM_BLOCK_SAMPLES + (rest > 4 ? (rest - 4) * 2 + 1
+                                                           : rest == 4);
+  if (fact_length != 0 && fact_length < sound->length)
+    sound->length = fact_length;
+  sound->data_size = chunk.size;
+  sound->data = malloc(chunk.size ? chunk.size : 1);
+  OOMERROR(sound->data);
+  CHECKERR(fread(sound->data, 1, chunk.size, f) != chunk.size,
+           "Truncated %s\n", path);
+  fclose(f);
+  return RES_OK;
+onerror:
+  if (f != NULL)
+    fclose(f);
+  adpcm_free(sound);
+  return RES_ERR;
+onoom:
+  exit(EXIT_FAILURE);
+}
+
+void adpcm_free(AdpcmSound *sound) {
+  free(sound->data);
+  sound->data = NULL;
+  sound->data_size = 0;
+  sound->length = 0;
+}
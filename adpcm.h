@@ -0,0 +1,43 @@
+#ifndef ADPCM_H
+#define ADPCM_H
+
+#include "defs.h"
+
+// IMA/DVI ADPCM sounds, 4 bits per sample, in the block layout of IMA ADPCM
+// WAV files (format tag 0x11) written by tools/adpcmenc. Only mono is
+// supported. Every block starts with the first sample and the step index,
+// so any block can be decoded on its own.
+//
+// Decoding is two table lookups per sample: the difference for the step
+// index and nibble, and the next step index.
+
+#define ADPCM_BLOCK_BYTES 256
+#define ADPCM_BLOCK_SAMPLES 505 // the sample in the header and 2 per byte
+#define ADPCM_WAV_FORMAT 0x11
+
+typedef struct AdpcmSound {
+  uint8 *data; // blocks of ADPCM_BLOCK_BYTES, the last one may be shorter
+  uint32 data_size;
+  uint32 length; // samples
+  uint32 rate;
+} AdpcmSound;
+
+// Loads an IMA ADPCM WAV file
+RESULT adpcm_load_wav(AdpcmSound *sound, const char *path);
+void adpcm_free(AdpcmSound *sound);
+
+// Decodes the first count samples of a block, count at most
+// ADPCM_BLOCK_SAMPLES
+void adpcm_decode_block(const uint8 *block, int16 *out, uint32 count);
+// Same, keeping the high byte, as the mixer plays it
+void adpcm_decode_block8(const uint8 *block, int8 *out, uint32 count);
+// Decodes a single sample, up to a block's worth of work
+int16 adpcm_sample_at(const AdpcmSound *sound, uint32 index);
+
+// Encodes count samples (at most ADPCM_BLOCK_SAMPLES) into a block, padding
+// it with silence. *index carries the step index from block to block, start
+// with 0.
+void adpcm_encode_block(const int16 *in, uint32 count, uint8 *block,
+                        int *index);
+
+#endif // ADPCM_H
@@ -0,0 +1,148 @@
+/*
+    gmm2json: program that reads Gridmonger's GMM file and converts it into
+   JSON format
+    Copyright (C) 2025 Jagholin (github.com/Jagholin)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see
+   <https://www.gnu.org/licenses/>
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "cell_triggers.h"
+#include "dynarray.h"
+#include "level_grid.h"
+
+static void add_trigger(CellTriggerMap *map, Dynarray *entries, uint16 row,
+                        uint16 col, CellTriggerKind kind, uint16 index) {
+  if (row >= map->rows || col >= map->cols)
+    return;
+  CellTrigger trigger = {(uint32)row * map->cols + col, kind, index};
+  dynarray_push(entries, &trigger);
+  map->bits[row * map->words_per_row + (col >> 5)] |= 1u << (col & 31);
+}
+
+static int compare_triggers(const void *a, const void *b) {
+  const CellTrigger *x = a, *y = b;
+  if (x->cell != y->cell)
+    return x->cell < y->cell ? -1 : 1;
+  if (x->kind != y->kind)
+    return x->kind < y->kind ? -1 : 1;
+  return x->index < y->index ? -1 : x->index > y->index;
+}
+
+static uint16 region_of(const RiffChunkLevelRegn *regn, uint16 across,
+                        uint16 row, uint16 col) {
+  return (row / regn->rows_per_region) * across +
+         col / regn->columns_per_region;
+}
+
+// Flags the cells a step can enter from another region. Without expanded
+// layers every cell on the edge of a region is flagged.
+static void add_region_borders(CellTriggerMap *map, Dynarray *entries,
+                               const RiffChunkLevelRegn *regn,
+                               const LevelGrid *grid) {
+  uint16 across = (map->cols + regn->columns_per_region - 1) /
+                  regn->columns_per_region;
+  for (uint16 r = 0; r < map->rows; ++r)
+    for (uint16 c = 0; c < map->cols; ++c) {
+      uint16 region = region_of(regn, across, r, c);
+      for (int dir = DIR_NORTH; dir <= DIR_WEST; ++dir) {
+        int nrow = r + dir_drow[dir], ncol = c + dir_dcol[dir];
+        if (nrow < 0 || ncol < 0 || nrow >= map->rows || ncol >= map->cols ||
+            region_of(regn, across, nrow, ncol) == region)
+          continue;
+        if (grid == NULL || grid_can_move(grid, nrow, ncol, (dir + 2) & 3)) {
+          add_trigger(map, entries, r, c, CELL_TRIGGER_REGION, region);
+          break;
+        }
+      }
+    }
+}
+
+RESULT cell_triggers_build(CellTriggerMap *map, const GmmLevel *level,
+                           uint16 level_index,
+                           const RiffChunkMapLinks *links) {
+  CHECKERR(level->prop == NULL, "Level %u has no properties\n", level_index);
+  map->rows = level->prop->num_rows;
+  map->cols = level->prop->num_columns;
+  map->words_per_row = (map->cols + 31) >> 5;
+  map->bits = calloc((size_t)map->rows * map->words_per_row + 1,
+                     sizeof(uint32));
+  OOMERROR(map->bits);
+  Dynarray entries = make_dynarray(sizeof(CellTrigger), 64);
+
+  if (level->anno != NULL)
+    for (uint16 i = 0; i < level->anno->num_annotations; ++i) {
+      const AnnotationRecord *rec = &level->anno->records[i];
+      if (rec->kind != AK_LABEL)
+        add_trigger(map, &entries, rec->row, rec->column,
+                    CELL_TRIGGER_ANNOTATION, i);
+    }
+  if (links != NULL)
+    for (uint16 i = 0; i < links->num_links; ++i) {
+      const MapLinksRecord *rec = &links->records[i];
+      if (rec->src_level_index == level_index)
+        add_trigger(map, &entries, rec->src_row, rec->src_column,
+                    CELL_TRIGGER_LINK, i);
+      if (rec->dest_level_index == level_index)
+        add_trigger(map, &entries, rec->dest_row, rec->dest_column,
+                    CELL_TRIGGER_LINK, i);
+    }
+  if (level->regn != NULL && level->regn->enable_regions &&
+      level->regn->rows_per_region > 0 &&
+      level->regn->columns_per_region > 0) {
+    LevelGrid grid;
+    bool expanded = level_grid_from_level(level, &grid) == RES_OK;
+    add_region_borders(map, &entries, level->regn, expanded ? &grid : NULL);
+  }
+
+  qsort(entries.data, entries.len, sizeof(CellTrigger), compare_triggers);
+  map->entries = (CellTrigger *)entries.data;
+  map->num_entries = entries.len;
+  return RES_OK;
+onerror:
+  map->bits = NULL;
+  map->entries = NULL;
+  map->num_entries = 0;
+  return RES_ERR;
+onoom:
+  exit(EXIT_FAILURE);
+}
+
+void cell_triggers_free(CellTriggerMap *map) {
+  free(map->bits);
+  free(map->entries);
+  map->bits = NULL;
+  map->entries = NULL;
+  map->num_entries = 0;
+}
+
+uint32 cell_triggers_lookup(const CellTriggerMap *map, uint16 row, uint16 col,
+                            const CellTrigger **first) {
+  uint32 cell = (uint32)row * map->cols + col;
+  uint32 lo = 0, hi = map->num_entries;
+  while (lo < hi) {
+    uint32 mid = (lo + hi) >> 1;
+    if (map->entries[mid].cell < cell)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  uint32 end = lo;
+  while (end < map->num_entries && map->entries[end].cell == cell)
+    end++;
+  *first = &map->entries[lo];
+  return end - lo;
+}
@@ -0,0 +1,70 @@
+/*
+    gmm2json: program that reads Gridmonger's GMM file and converts it into
+   JSON format
+    Copyright (C) 2025 Jagholin (github.com/Jagholin)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see
+   <https://www.gnu.org/licenses/>
+*/
+#ifndef CELL_TRIGGERS_H
+#define CELL_TRIGGERS_H
+
+#include <stdbool.h>
+
+#include "defs.h"
+#include "gmm_file.h"
+
+// One bit per cell of a level that is set if entering the cell may fire
+// something, and a side table that says what. A move costs one bit test, the
+// table is only searched on hits.
+
+typedef enum CellTriggerKind {
+  CELL_TRIGGER_ANNOTATION, // index into the anno records of the level
+  CELL_TRIGGER_LINK,       // index into the map links, either end of it
+  CELL_TRIGGER_REGION,     // entered from another region, index of this one
+} CellTriggerKind;
+
+typedef struct CellTrigger {
+  uint32 cell; // row * cols + col
+  uint16 kind;
+  uint16 index;
+} CellTrigger;
+
+typedef struct CellTriggerMap {
+  uint16 rows;
+  uint16 cols;
+  uint32 words_per_row;
+  uint32 *bits;
+  // Sorted by cell, then kind
+  CellTrigger *entries;
+  uint32 num_entries;
+} CellTriggerMap;
+
+// Builds the map of the level with index level_index. Annotations other than
+// labels become triggers. links may be NULL.
+RESULT cell_triggers_build(CellTriggerMap *map, const GmmLevel *level,
+                           uint16 level_index,
+                           const RiffChunkMapLinks *links);
+void cell_triggers_free(CellTriggerMap *map);
+
+static inline bool cell_triggers_test(const CellTriggerMap *map, uint16 row,
+                                      uint16 col) {
+  return (map->bits[row * map->words_per_row + (col >> 5)] >> (col & 31)) & 1;
+}
+
+// Returns the number of triggers of the cell, *first points to them
+uint32 cell_triggers_lookup(const CellTriggerMap *map, uint16 row, uint16 col,
+                            const CellTrigger **first);
+
+#endif // CELL_TRIGGERS_H
@@ -2,7 +2,9 @@
 #ifndef DEFS_H
 #define DEFS_H
 
+#ifdef __DJGPP__
 #include <pc.h>
+#endif
 #include <stdio.h>
 #include <unistd.h>
 
@@ -12,6 +14,7 @@
 #define LOWBYTE(x) ((x) & 0xFF)
 #define HIBYTE(x) (((x) & 0xFF00) >> 8)
 
+typedef signed char int8;
 typedef unsigned char uint8;
 typedef unsigned short uint16;
 typedef short int16;
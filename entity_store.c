@@ -0,0 +1,186 @@
+/*
+    gmm2json: program that reads Gridmonger's GMM file and converts it into
+   JSON format
+    Copyright (C) 2025 Jagholin (github.com/Jagholin)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see
+   <https://www.gnu.org/licenses/>
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "entity_store.h"
+#include "pack.h"
+
+RESULT entity_store_init(EntityStore *store, uint32 capacity) {
+  CHECKERR(capacity == 0 || capacity > ENTITY_MAX,
+           "Entity store capacity %u out of range\n", capacity);
+  memset(store, 0, sizeof(*store));
+  store->capacity = capacity;
+  store->row = malloc(capacity * sizeof(uint16));
+  store->col = malloc(capacity * sizeof(uint16));
+  store->type = malloc(capacity);
+  store->icon = malloc(capacity);
+  store->script_hash = malloc(capacity * sizeof(uint32));
+  store->anno_index = malloc(capacity * sizeof(uint16));
+  store->health = malloc(capacity * sizeof(int16));
+  store->timer = malloc(capacity * sizeof(uint16));
+  store->slot_of = malloc(capacity * sizeof(uint16));
+  store->generation = malloc(capacity * sizeof(uint16));
+  store->dense_of = malloc(capacity * sizeof(uint16));
+  OOMERROR(store->row);
+  OOMERROR(store->col);
+  OOMERROR(store->type);
+  OOMERROR(store->icon);
+  OOMERROR(store->script_hash);
+  OOMERROR(store->anno_index);
+  OOMERROR(store->health);
+  OOMERROR(store->timer);
+  OOMERROR(store->slot_of);
+  OOMERROR(store->generation);
+  OOMERROR(store->dense_of);
+  // Generations start at 1, so that no handle equals ENTITY_NONE
+  for (uint32 i = 0; i < capacity; ++i)
+    store->generation[i] = 1;
+  entity_store_clear(store);
+  return RES_OK;
+onerror:
+  return RES_ERR;
+onoom:
+  exit(EXIT_FAILURE);
+}
+
+void entity_store_free(EntityStore *store) {
+  free(store->row);
+  free(store->col);
+  free(store->type);
+  free(store->icon);
+  free(store->script_hash);
+  free(store->anno_index);
+  free(store->health);
+  free(store->timer);
+  free(store->slot_of);
+  free(store->generation);
+  free(store->dense_of);
+  memset(store, 0, sizeof(*store));
+}
+
+static void next_generation(EntityStore *store, uint16 slot) {
+  if (++store->generation[slot] == 0)
+    store->generation[slot] = 1;
+}
+
+void entity_store_clear(EntityStore *store) {
+  for (uint32 i = 0; i < store->count; ++i)
+    next_generation(store, store->slot_of[i]);
+  store->count = 0;
+  for (uint32 i = 0; i < store->capacity; ++i)
+    store->dense_of[i] = i + 1 < store->capacity ? i + 1 : ENTITY_MAX;
+  store->free_slot = 0;
+}
+
+EntityHandle entity_spawn(EntityStore *store, EntityType type, uint16 row,
+                          uint16 col) {
+  if (store->free_slot == ENTITY_MAX)
+    return ENTITY_NONE;
+  uint16 slot = store->free_slot;
+  uint32 index = store->count++;
+  store->free_slot = store->dense_of[slot];
+  store->dense_of[slot] = index;
+  store->slot_of[index] = slot;
+  store->row[index] = row;
+  store->col[index] = col;
+  store->type[index] = type;
+  store->icon[index] = 0;
+  store->script_hash[index] = 0;
+  store->anno_index[index] = 0;
+  store->health[index] = 1;
+  store->timer[index] = 0;
+  return entity_handle(store, index);
+}
+
+static void destroy_index(EntityStore *store, uint32 index) {
+  uint16 slot = store->slot_of[index];
+  uint32 last = --store->count;
+  if (index != last) {
+    store->row[index] = store->row[last];
+    store->col[index] = store->col[last];
+    store->type[index] = store->type[last];
+    store->icon[index] = store->icon[last];
+    store->script_hash[index] = store->script_hash[last];
+    store->anno_index[index] = store->anno_index[last];
+    store->health[index] = store->health[last];
+    store->timer[index] = store->timer[last];
+    store->slot_of[index] = store->slot_of[last];
+    store->dense_of[store->slot_of[index]] = index;
+  }
+  next_generation(store, slot);
+  store->dense_of[slot] = store->free_slot;
+  store->free_slot = slot;
+}
+
+void entity_destroy(EntityStore *store, EntityHandle handle) {
+  int32 index = entity_index(store, handle);
+  if (index >= 0)
+    destroy_index(store, index);
+}
+
+uint32 entity_store_spawn_annotations(EntityStore *store,
+                                      const RiffChunkLevelAnno *anno) {
+  uint32 spawned = 0;
+  for (uint16 i = 0; i < anno->num_annotations; ++i) {
+    const AnnotationRecord *rec = &anno->records[i];
+    if (rec->kind != AK_ICON && rec->kind != AK_CUSTOM)
+      continue;
+    EntityType type = rec->kind == AK_ICON ? ENTITY_PROP : ENTITY_SCRIPTED;
+    EntityHandle handle = entity_spawn(store, type, rec->row, rec->column);
+    if (handle == ENTITY_NONE)
+      break;
+    uint32 index = store->dense_of[handle & 0xFFFF];
+    store->anno_index[index] = i;
+    if (rec->kind == AK_ICON)
+      store->icon[index] = rec->icon.icon;
+    else
+      store->script_hash[index] = pack_hash_name(rec->custom.custom_id);
+    spawned++;
+  }
+  return spawned;
+}
+
+uint32 entity_store_tick(EntityStore *store, uint16 ticks,
+                         EntityHandle *ready) {
+  uint16 *timer = store->timer;
+  uint32 count = store->count, num_ready = 0;
+  // Branch free countdown first, it vectorizes
+  for (uint32 i = 0; i < count; ++i) {
+    uint16 t = timer[i];
+    timer[i] = t > ticks ? t - ticks : 0;
+  }
+  for (uint32 i = 0; i < count; ++i)
+    if (timer[i] == 0)
+      ready[num_ready++] = entity_handle(store, i);
+  return num_ready;
+}
+
+uint32 entity_store_remove_dead(EntityStore *store) {
+  uint32 removed = 0;
+  // Walk backwards, so that the entity moved into a freed index was already
+  // checked
+  for (uint32 i = store->count; i-- > 0;)
+    if (store->health[i] <= 0) {
+      destroy_index(store, i);
+      removed++;
+    }
+  return removed;
+}
@@ -0,0 +1,108 @@
+/*
+    gmm2json: program that reads Gridmonger's GMM file and converts it into
+   JSON format
+    Copyright (C) 2025 Jagholin (github.com/Jagholin)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see
+   <https://www.gnu.org/licenses/>
+*/
+#ifndef ENTITY_STORE_H
+#define ENTITY_STORE_H
+
+#include <stdbool.h>
+
+#include "defs.h"
+#include "gmm_file.h"
+
+// Monsters, items and props of a level, stored as one array per component.
+//
+// Live entities are packed into dense indices 0 .. count - 1, so the update
+// loops walk plain arrays. Destroying an entity moves the last one into its
+// place. Entities are referred to by handles: the low 16 bits are a slot,
+// which maps to the current dense index, and the high 16 bits the generation
+// of the slot, which changes whenever the slot is freed. Stale handles are
+// rejected instead of finding a new entity.
+
+typedef uint32 EntityHandle;
+#define ENTITY_NONE 0
+
+#define ENTITY_MAX 0xFFFF
+
+typedef enum EntityType {
+  ENTITY_PROP,     // from an icon annotation
+  ENTITY_SCRIPTED, // from a custom id annotation, runs its trigger script
+} EntityType;
+
+typedef struct EntityStore {
+  uint32 capacity;
+  uint32 count;
+  // Dense component columns, indexed by dense index
+  uint16 *row;
+  uint16 *col;
+  uint8 *type;
+  uint8 *icon;
+  uint32 *script_hash; // pack_hash_name of the custom id
+  uint16 *anno_index;  // record in the annotation chunk
+  int16 *health;       // the entity dies when it reaches 0
+  uint16 *timer;       // ticks until it acts next
+  uint16 *slot_of;     // slot of the dense index
+  // Slots, indexed by the low half of a handle
+  uint16 *generation;
+  uint16 *dense_of; // dense index, or the next free slot
+  uint16 free_slot; // ENTITY_MAX if none
+} EntityStore;
+
+RESULT entity_store_init(EntityStore *store, uint32 capacity);
+void entity_store_free(EntityStore *store);
+void entity_store_clear(EntityStore *store);
+
+// Returns ENTITY_NONE if the store is full
+EntityHandle entity_spawn(EntityStore *store, EntityType type, uint16 row,
+                          uint16 col);
+void entity_destroy(EntityStore *store, EntityHandle handle);
+
+static inline bool entity_alive(const EntityStore *store,
+                                EntityHandle handle) {
+  uint16 slot = handle & 0xFFFF;
+  return slot < store->capacity && store->generation[slot] == handle >> 16;
+}
+
+// Dense index of a live entity, -1 for stale handles
+static inline int32 entity_index(const EntityStore *store,
+                                 EntityHandle handle) {
+  return entity_alive(store, handle) ? store->dense_of[handle & 0xFFFF] : -1;
+}
+
+static inline EntityHandle entity_handle(const EntityStore *store,
+                                         uint32 index) {
+  uint16 slot = store->slot_of[index];
+  return ((uint32)store->generation[slot] << 16) | slot;
+}
+
+// Spawns an entity for every icon and custom id annotation of the level.
+// Returns the number spawned.
+uint32 entity_store_spawn_annotations(EntityStore *store,
+                                      const RiffChunkLevelAnno *anno);
+
+// Counts the timers down by ticks and writes the handles of the entities
+// whose timer ran out to ready, which must hold count entries. Their timers
+// stay at 0, so they are ready on every tick until the timer is set again.
+// Returns the number written.
+uint32 entity_store_tick(EntityStore *store, uint16 ticks,
+                         EntityHandle *ready);
+// Destroys every entity whose health dropped to 0 or below. Returns the
+// number destroyed.
+uint32 entity_store_remove_dead(EntityStore *store);
+
+#endif // ENTITY_STORE_H
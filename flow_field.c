@@ -0,0 +1,120 @@
+/*
+    gmm2json: program that reads Gridmonger's GMM file and converts it into
+   JSON format
+    Copyright (C) 2025 Jagholin (github.com/Jagholin)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see
+   <https://www.gnu.org/licenses/>
+*/
+#include <stdlib.h>
+
+#include "flow_field.h"
+
+// Rebuild instead of letting the bias run into the unreachable marker
+#define FLOW_MAX_BIAS (INT32_MAX / 2)
+
+static inline uint32 num_cells(const LevelGrid *grid) {
+  return (uint32)grid->rows * grid->stride;
+}
+
+RESULT flow_field_init(FlowField *field, const LevelGrid *grid) {
+  field->grid = *grid;
+  field->dist = malloc(num_cells(grid) * sizeof(int32));
+  OOMERROR(field->dist);
+  field->dir = malloc(num_cells(grid));
+  OOMERROR(field->dir);
+  field->queue = malloc(num_cells(grid) * sizeof(uint32));
+  OOMERROR(field->queue);
+  field->bias = 0;
+  field->target_row = 0;
+  field->target_col = 0;
+  return RES_OK;
+onoom:
+  exit(EXIT_FAILURE);
+}
+
+void flow_field_free(FlowField *field) {
+  free(field->dist);
+  free(field->dir);
+  free(field->queue);
+  field->dist = NULL;
+  field->dir = NULL;
+  field->queue = NULL;
+}
+
+// BFS from the target that only ever lowers distances. From scratch every
+// cell starts unreachable; after a one-cell move the old values (plus one)
+// are upper bounds, and the wave stops where they're already exact.
+static void lower_wave(FlowField *field) {
+  const LevelGrid *grid = &field->grid;
+  uint32 head = 0, tail = 0;
+  uint32 start = grid_index(grid, field->target_row, field->target_col);
+
+  field->dist[start] = -field->bias;
+  field->dir[start] = DIR_NONE;
+  field->queue[tail++] = start;
+  while (head < tail) {
+    uint32 cur = field->queue[head++];
+    uint16 r = cur / grid->stride, c = cur % grid->stride;
+    int32 next_dist = field->dist[cur] + 1;
+    for (int d = DIR_NORTH; d <= DIR_WEST; ++d) {
+      if (!grid_can_move(grid, r, c, d))
+        continue;
+      uint32 next = grid_index(grid, r + dir_drow[d], c + dir_dcol[d]);
+      if (field->dist[next] <= next_dist)
+        continue;
+      field->dist[next] = next_dist;
+      field->dir[next] = (d + 2) & 3;
+      field->queue[tail++] = next;
+    }
+  }
+}
+
+void flow_field_build(FlowField *field, uint16 row, uint16 col) {
+  uint32 cells = num_cells(&field->grid);
+  for (uint32 i = 0; i < cells; ++i) {
+    field->dist[i] = INT32_MAX;
+    field->dir[i] = DIR_NONE;
+  }
+  field->bias = 0;
+  field->target_row = row;
+  field->target_col = col;
+  if (grid_cell_open(&field->grid, row, col))
+    lower_wave(field);
+}
+
+void flow_field_move_target(FlowField *field, uint16 row, uint16 col) {
+  const LevelGrid *grid = &field->grid;
+  uint16 old_row = field->target_row, old_col = field->target_col;
+  int d;
+  if (row == old_row && col == old_col)
+    return;
+  for (d = DIR_NORTH; d <= DIR_WEST; ++d)
+    if (old_row + dir_drow[d] == row && old_col + dir_dcol[d] == col)
+      break;
+  if (d > DIR_WEST || field->bias >= FLOW_MAX_BIAS ||
+      field->dist[grid_index(grid, old_row, old_col)] == INT32_MAX ||
+      !grid_can_move(grid, old_row, old_col, d)) {
+    flow_field_build(field, row, col);
+    return;
+  }
+  // Every distance grows by at most one, the new target fixes the rest
+  field->bias++;
+  field->target_row = row;
+  field->target_col = col;
+  lower_wave(field);
+  // The old target is exactly one step away, but that's no improvement over
+  // its bumped distance, so the wave leaves its direction alone
+  field->dir[grid_index(grid, old_row, old_col)] = d;
+}
@@ -0,0 +1,66 @@
+/*
+    gmm2json: program that reads Gridmonger's GMM file and converts it into
+   JSON format
+    Copyright (C) 2025 Jagholin (github.com/Jagholin)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see
+   <https://www.gnu.org/licenses/>
+*/
+#ifndef FLOW_FIELD_H
+#define FLOW_FIELD_H
+
+#include <stdint.h>
+
+#include "defs.h"
+#include "level_grid.h"
+
+#define FLOW_UNREACHED 0xFFFFFFFFu
+
+// Walking distance to a target cell and the direction of the next step
+// towards it, for every cell of a level.
+//
+// Distances are kept as dist[i] + bias. When the target moves to a
+// neighbouring cell, no distance grows by more than one, so bias is bumped
+// and a BFS wave from the new target lowers only the cells that got closer.
+// Direction tables of all other cells stay valid.
+typedef struct FlowField {
+  LevelGrid grid;
+  int32 *dist;  // indexed like the layers, INT32_MAX if unreachable
+  uint8 *dir;   // GridDir of the next step, DIR_NONE at the target
+  uint32 *queue;
+  int32 bias;
+  uint16 target_row;
+  uint16 target_col;
+} FlowField;
+
+RESULT flow_field_init(FlowField *field, const LevelGrid *grid);
+void flow_field_free(FlowField *field);
+
+// Full sweep from the target, needed after walls or doors change
+void flow_field_build(FlowField *field, uint16 row, uint16 col);
+// Moves the target, incrementally if it moved to a neighbouring cell
+void flow_field_move_target(FlowField *field, uint16 row, uint16 col);
+
+static inline GridDir flow_field_dir(const FlowField *field, uint16 row,
+                                     uint16 col) {
+  return (GridDir)field->dir[grid_index(&field->grid, row, col)];
+}
+
+static inline uint32 flow_field_distance(const FlowField *field, uint16 row,
+                                         uint16 col) {
+  int32 raw = field->dist[grid_index(&field->grid, row, col)];
+  return raw == INT32_MAX ? FLOW_UNREACHED : (uint32)(raw + field->bias);
+}
+
+#endif // FLOW_FIELD_H
@@ -24,6 +24,8 @@
 
 #include "defs.h"
 #include "gmm_file.h"
+#include "gmm_schema.h"
+#include "layer_cache.h"
 
 struct DecodingCursor {
   const uint8 **data;
@@ -33,7 +35,13 @@ struct DecodingCursor {
 
 struct DecodingContext {
   size_t level_size;
+  uint16 level_row_len;
+  unsigned int flags; // GmmDecodeFlags
   const char *list_type;
+  // When set, chunks are decoded into this pool of GmmFlatChunk instead of the
+  // per-list children arrays.
+  Dynarray *flat_pool;
+  uint32 flat_parent;
 };
 
 RESULT
@@ -61,7 +69,7 @@ struct DecodingCursor recursive_cursor_from(struct DecodingCursor *cursor,
   return result;
 }
 
-void free_gmmfile(RiffFile *f) { free(f->data); }
+void free_gmmfile(RiffFile *f) { free(f->block); }
 
 char *decode_wstr(struct DecodingCursor cursor) {
   char *result = NULL;
@@ -119,13 +127,15 @@ onoom:
   exit(EXIT_FAILURE);
 }
 
-uint8 *decode_cell_layer(struct DecodingCursor cursor, size_t size) {
+// With shared set the layer is allocated from, and interned in, layer_cache
+uint8 *decode_cell_layer(struct DecodingCursor cursor, size_t size,
+                         bool shared) {
   // See if we have compression
   uint8 *result = NULL;
   const uint8 *compression_type = *cursor.data;
   advance_cursor(cursor, 1);
   PROPAGATEERR();
-  result = malloc(size * sizeof(uint8));
+  result = shared ? layer_cache_alloc(size) : malloc(size * sizeof(uint8));
   OOMERROR(result);
   if (*compression_type == 0) {
     // No compression, just memcpy.
@@ -182,17 +192,48 @@ uint8 *decode_cell_layer(struct DecodingCursor cursor, size_t size) {
     goto onerror;
   }
 
-  return result;
+  return shared ? layer_cache_intern(result) : result;
 
 onpropagate:
 onerror:
-  if (result)
+  if (result && shared)
+    layer_cache_release(result);
+  else if (result)
     free(result);
   return NULL;
 onoom:
   exit(EXIT_FAILURE);
 }
 
+// Same as decode_cell_layer, but keeps the layer in run-length form
+RESULT decode_cell_layer_rle(struct DecodingCursor cursor, size_t size,
+                             uint16 row_len, RleLayer *out) {
+  const uint8 *compression_type = *cursor.data;
+  advance_cursor(cursor, 1);
+  PROPAGATEERR();
+  const uint8 *data = *cursor.data;
+  size_t data_len = 0;
+  if (*compression_type == 0) {
+    data_len = size;
+  } else if (*compression_type == 1) {
+    data_len = *(const uint32 *)*cursor.data;
+    advance_cursor(cursor, sizeof(uint32));
+    PROPAGATEERR();
+    data = *cursor.data;
+  }
+  CHECKERR(data_len > *cursor.len,
+           "Cell layer is longer than its chunk on line %d\n", __LINE__);
+  CHECKERR(rle_layer_build(out, *compression_type, data, data_len, size,
+                           row_len) != RES_OK,
+           "Can't build run-length layer on line %d\n", __LINE__);
+  advance_cursor(cursor, data_len);
+  PROPAGATEERR();
+  return RES_OK;
+onpropagate:
+onerror:
+  return RES_ERR;
+}
+
 size_t decode_map_prop_chunk(struct DecodingCursor cursor,
                              RiffChunkMapProperties *out) {
   size_t start_len = *cursor.len;
@@ -217,22 +258,12 @@ onerror:
 
 size_t decode_map_coor_chunk(struct DecodingCursor cursor,
                              RiffChunkMapCoords *out) {
-  PACKED_STRUCT DecodedData {
-    uint8 origin;
-    uint8 row_style;
-    uint8 column_style;
-    uint16 row_start;
-    uint16 column_start;
-  }
-  *decoded_data = (struct DecodedData *)*cursor.data;
-  advance_cursor(cursor, sizeof(struct DecodedData));
+  const struct map_coor_wire *decoded_data =
+      (const struct map_coor_wire *)*cursor.data;
+  advance_cursor(cursor, sizeof(struct map_coor_wire));
   PROPAGATEERR();
-  out->origin = decoded_data->origin;
-  out->row_style = decoded_data->row_style;
-  out->column_style = decoded_data->column_style;
-  out->row_start = decoded_data->row_start;
-  out->column_start = decoded_data->column_start;
-  return sizeof(struct DecodedData);
+  map_coor_decode(decoded_data, out);
+  return sizeof(struct map_coor_wire);
 onpropagate:
   exit(EXIT_FAILURE);
 }
@@ -244,19 +275,11 @@ size_t decode_lvl_prop_chunk(struct DecodingCursor cursor,
   PROPAGATEERR();
   out->level_name = decode_wstr(cursor);
   PROPAGATEERR();
-  PACKED_STRUCT DecodedData {
-    int16 elevation;
-    uint16 num_rows;
-    uint16 num_columns;
-    uint8 override_coord_opts;
-  }
-  *decoded_data = (struct DecodedData *)*cursor.data;
-  advance_cursor(cursor, sizeof(struct DecodedData));
+  const struct lvl_prop_wire *decoded_data =
+      (const struct lvl_prop_wire *)*cursor.data;
+  advance_cursor(cursor, sizeof(struct lvl_prop_wire));
   PROPAGATEERR();
-  out->elevation = decoded_data->elevation;
-  out->num_rows = decoded_data->num_rows;
-  out->num_columns = decoded_data->num_columns;
-  out->override_coord_opts = decoded_data->override_coord_opts;
+  lvl_prop_decode(decoded_data, out);
   out->notes = decode_wstr(cursor);
   PROPAGATEERR();
   return start_len - *cursor.len;
@@ -266,46 +289,57 @@ onpropagate:
 
 size_t decode_lvl_coor_chunk(struct DecodingCursor cursor,
                              RiffChunkLevelCoords *out) {
-  PACKED_STRUCT DecodedData {
-    uint8 origin;
-    uint8 row_style;
-    uint8 column_style;
-    uint16 row_start;
-    uint16 column_start;
-  }
-  *decoded_data = (struct DecodedData *)*cursor.data;
-  advance_cursor(cursor, sizeof(struct DecodedData));
+  const struct lvl_coor_wire *decoded_data =
+      (const struct lvl_coor_wire *)*cursor.data;
+  advance_cursor(cursor, sizeof(struct lvl_coor_wire));
   PROPAGATEERR();
-  out->origin = decoded_data->origin;
-  out->row_style = decoded_data->row_style;
-  out->column_style = decoded_data->column_style;
-  out->row_start = decoded_data->row_start;
-  out->column_start = decoded_data->column_start;
-  return sizeof(struct DecodedData);
+  lvl_coor_decode(decoded_data, out);
+  return sizeof(struct lvl_coor_wire);
 onpropagate:
   exit(EXIT_FAILURE);
 }
 
 size_t decode_lvl_cell_chunk(struct DecodingCursor cursor,
-                             RiffChunkLevelCell *out, size_t cell_count) {
+                             RiffChunkLevelCell *out, size_t cell_count,
+                             struct DecodingContext *ctx) {
   const uint8 *start_addr = *cursor.data;
-  out->floor = decode_cell_layer(cursor, cell_count);
+  out->row_len = ctx->level_row_len;
+  out->cells_count = cell_count;
+  out->rle_layers = NULL;
+  out->shared_layers = false;
+  if (ctx->flags & GMM_DECODE_RLE_LAYERS) {
+    out->floor = out->floor_orientation = out->floor_color = NULL;
+    out->wall_north = out->wall_west = out->trail = NULL;
+    out->rle_layers = malloc(sizeof(RleLayer) * GMM_LAYER_COUNT);
+    OOMERROR(out->rle_layers);
+    for (int i = 0; i < GMM_LAYER_COUNT; ++i) {
+      CHECKERR(decode_cell_layer_rle(cursor, cell_count, out->row_len,
+                                     &out->rle_layers[i]) != RES_OK,
+               "Error decoding cell layer %d\n", i);
+    }
+    return *cursor.data - start_addr;
+  }
+
+  bool shared = (ctx->flags & GMM_DECODE_SHARE_LAYERS) != 0;
+  out->shared_layers = shared;
+  out->floor = decode_cell_layer(cursor, cell_count, shared);
   PROPAGATEERR();
-  out->floor_orientation = decode_cell_layer(cursor, cell_count);
+  out->floor_orientation = decode_cell_layer(cursor, cell_count, shared);
   PROPAGATEERR();
-  out->floor_color = decode_cell_layer(cursor, cell_count);
+  out->floor_color = decode_cell_layer(cursor, cell_count, shared);
   PROPAGATEERR();
-  out->wall_north = decode_cell_layer(cursor, cell_count);
+  out->wall_north = decode_cell_layer(cursor, cell_count, shared);
   PROPAGATEERR();
-  out->wall_west = decode_cell_layer(cursor, cell_count);
+  out->wall_west = decode_cell_layer(cursor, cell_count, shared);
   PROPAGATEERR();
-  out->trail = decode_cell_layer(cursor, cell_count);
+  out->trail = decode_cell_layer(cursor, cell_count, shared);
   PROPAGATEERR();
-  out->cells_count = cell_count;
 
   return *cursor.data - start_addr;
 
 onpropagate:
+onerror:
+onoom:
   exit(EXIT_FAILURE);
 }
 
@@ -371,22 +405,12 @@ onoom:
 size_t decode_lvl_regn_chunk(struct DecodingCursor cursor,
                              RiffChunkLevelRegn *out) {
   const uint8 *start_addr = *cursor.data;
-  const PACKED_STRUCT DecodedData {
-    uint8 enable_regions;
-    uint16 row_per_region;
-    uint16 columns_per_region;
-    uint8 per_region_coords;
-    uint16 num_regions;
-  }
-  *decoded_data = (const struct DecodedData *)*cursor.data;
-  advance_cursor(cursor, sizeof(struct DecodedData));
+  const struct lvl_regn_wire *decoded_data =
+      (const struct lvl_regn_wire *)*cursor.data;
+  advance_cursor(cursor, sizeof(struct lvl_regn_wire));
   PROPAGATEERR();
 
-  out->enable_regions = decoded_data->enable_regions;
-  out->rows_per_region = decoded_data->row_per_region;
-  out->columns_per_region = decoded_data->columns_per_region;
-  out->per_region_coords = decoded_data->per_region_coords;
-  out->num_regions = decoded_data->num_regions;
+  lvl_regn_decode(decoded_data, out);
   out->records = malloc(sizeof(LevelRegionRecord) * out->num_regions);
   OOMERROR(out->records);
 
@@ -417,26 +441,17 @@ size_t decode_map_links_chunk(const struct DecodingCursor cursor,
   out->records = malloc(sizeof(MapLinksRecord) * (*num_links));
   OOMERROR(out->records);
 
-  for (uint16 i = 0; i < *num_links; ++i) {
-
-    const PACKED_STRUCT DecodedData {
-      uint16 src_level_index;
-      uint16 src_row;
-      uint16 src_column;
-      uint16 dest_level_index;
-      uint16 dest_row;
-      uint16 dest_column;
-    }
-    *decoded_data = (const struct DecodedData *)*cursor.data;
-    advance_cursor(cursor, sizeof(struct DecodedData));
-    PROPAGATEERR();
+  const struct map_link_wire *decoded_data =
+      (const struct map_link_wire *)*cursor.data;
+  advance_cursor(cursor, sizeof(struct map_link_wire) * out->num_links);
+  PROPAGATEERR();
 
-    out->records[i].src_level_index = decoded_data->src_level_index;
-    out->records[i].src_row = decoded_data->src_row;
-    out->records[i].src_column = decoded_data->src_column;
-    out->records[i].dest_level_index = decoded_data->dest_level_index;
-    out->records[i].dest_row = decoded_data->dest_row;
-    out->records[i].dest_column = decoded_data->dest_column;
+  if (GMM_MAP_LINKS_BULK_COPY) {
+    memcpy(out->records, decoded_data,
+           sizeof(MapLinksRecord) * out->num_links);
+  } else {
+    for (uint16 i = 0; i < out->num_links; ++i)
+      map_link_decode(&decoded_data[i], &out->records[i]);
   }
 
   return *cursor.data - start_addr;
@@ -479,7 +494,20 @@ size_t _decode_chunks(struct DecodingCursor dc, Dynarray *out,
     CHECKRESULT("Unexpectedly run out of bytes while decoding");
     size_t size_check = *dc.len;
 
-    GmmChunk *new_chunk = dynarray_push_inplace(out);
+    GmmChunk *new_chunk = NULL;
+    uint32 new_index = GMM_FLAT_NONE;
+    if (ctx->flat_pool != NULL) {
+      new_index = dynarray_size(ctx->flat_pool);
+      if (ctx->flat_parent != GMM_FLAT_NONE)
+        flat_chunk_at(ctx->flat_pool, ctx->flat_parent)->child_count++;
+      GmmFlatChunk *new_node = dynarray_push_inplace(ctx->flat_pool);
+      new_node->parent = ctx->flat_parent;
+      new_node->child_count = 0;
+      new_node->subtree_end = new_index + 1;
+      new_chunk = &new_node->chunk;
+    } else {
+      new_chunk = dynarray_push_inplace(out);
+    }
     RiffChunkHeader *new_header = (RiffChunkHeader *)new_chunk;
     strncpy((char *)new_header->ckId, header->ckId, 4);
     new_header->ckSize = header->ckSize;
@@ -504,18 +532,31 @@ size_t _decode_chunks(struct DecodingCursor dc, Dynarray *out,
       CHECKERR(*dc.len < 4,
                "Unexpected end of a chunk. The file might be damaged.\n");
       strncpy((char *)new_chunk->list_chunk.ckType, (const char *)*dc.data, 4);
+      // The flat pool may move while the children are decoded, so the nested
+      // context gets its own copy of the list type.
+      char list_type[4];
+      memcpy(list_type, new_chunk->list_chunk.ckType, 4);
       decoded_length += 4;
       advance_cursor(dc, 4);
       CHECKRESULT("Unexpectedly run out of bytes while decoding");
-      new_chunk->list_chunk.children = make_dynarray(sizeof(GmmChunk), 1);
       size_t list_len = header->ckSize - 4;
       struct DecodingCursor nested_cursor =
           recursive_cursor_from(&dc, &list_len);
       PROPAGATEERR();
       struct DecodingContext new_ctx;
       memcpy(&new_ctx, ctx, sizeof(struct DecodingContext));
-      new_ctx.list_type = (const char *)new_chunk->list_chunk.ckType;
-      _decode_chunks(nested_cursor, &new_chunk->list_chunk.children, &new_ctx);
+      new_ctx.list_type = list_type;
+      if (ctx->flat_pool != NULL) {
+        memset(&new_chunk->list_chunk.children, 0, sizeof(Dynarray));
+        new_ctx.flat_parent = new_index;
+        _decode_chunks(nested_cursor, NULL, &new_ctx);
+        flat_chunk_at(ctx->flat_pool, new_index)->subtree_end =
+            dynarray_size(ctx->flat_pool);
+      } else {
+        new_chunk->list_chunk.children = make_dynarray(sizeof(GmmChunk), 1);
+        _decode_chunks(nested_cursor, &new_chunk->list_chunk.children,
+                       &new_ctx);
+      }
       // advance len by the amount of bytes that were just read
       // *dc.len -= header->ckSize - 4 - list_len;
     } else if (strncmp(header->ckId, "prop", 4) == 0) {
@@ -530,6 +571,7 @@ size_t _decode_chunks(struct DecodingCursor dc, Dynarray *out,
         size_t level_size = (new_chunk->level_prop_chunk.num_columns + 1) *
                             (new_chunk->level_prop_chunk.num_rows + 1);
         ctx->level_size = level_size;
+        ctx->level_row_len = new_chunk->level_prop_chunk.num_columns + 1;
       }
     } else if (strncmp(header->ckId, "coor", 4) == 0) {
       if (strncmp(ctx->list_type, "map ", 4) == 0) {
@@ -543,7 +585,7 @@ size_t _decode_chunks(struct DecodingCursor dc, Dynarray *out,
     } else if (strncmp(header->ckId, "cell", 4) == 0) {
       new_chunk->ctype = GMM_LVL_CELL;
       decoded_length += decode_lvl_cell_chunk(dc, &new_chunk->level_cell_chunk,
-                                              ctx->level_size);
+                                              ctx->level_size, ctx);
     } else if (strncmp(header->ckId, "anno", 4) == 0) {
       new_chunk->ctype = GMM_LVL_ANNO;
       decoded_length += decode_lvl_anno_chunk(dc, &new_chunk->level_anno_chunk);
@@ -580,36 +622,254 @@ onerror:
 }
 
 Dynarray decode_chunks(RiffFile *file) {
+  return decode_chunks_with_flags(file, 0);
+}
+
+// Same as decode_chunks, flags is a combination of GmmDecodeFlags
+Dynarray decode_chunks_with_flags(RiffFile *file, unsigned int flags) {
   Dynarray result = make_dynarray(sizeof(GmmChunk), 2);
   const uint8 *file_data = file->data;
   size_t data_size = file->length;
   struct DecodingCursor cursor = {&file_data, &data_size, NULL};
-  struct DecodingContext ctx = {0, NULL};
+  struct DecodingContext ctx = {0, 0, flags, NULL, NULL, GMM_FLAT_NONE};
   _decode_chunks(cursor, &result, &ctx);
   return result;
 }
 
-void free_chunks(Dynarray *chunk_array) {
-  for (unsigned int i = 0; i < dynarray_size(chunk_array); ++i) {
-    GmmChunk *ck = (GmmChunk *)dynarray_get(chunk_array, i);
+// Counts the chunks of a block, nested ones included, by their headers only.
+// Stops at the first header that doesn't fit, _decode_chunks reports those.
+static uint32 count_chunks(const uint8 *data, size_t len) {
+  uint32 count = 0;
+  while (len >= 8) {
+    uint32 size;
+    memcpy(&size, data + 4, 4);
+    count++;
+    if (size > len - 8)
+      break;
+    if (strncmp((const char *)data, "LIST", 4) == 0 && size >= 4)
+      count += count_chunks(data + 12, size - 4);
+    size_t step = 8 + (size_t)size + size % 2;
+    if (step > len)
+      break;
+    data += step;
+    len -= step;
+  }
+  return count;
+}
+
+// Same as decode_chunks, but all chunks of the file are stored in a single
+// Dynarray of GmmFlatChunk (see gmm_file.h for the layout).
+Dynarray decode_chunks_flat(RiffFile *file, unsigned int flags) {
+  // Sized by a counting pass, so the pool is allocated once. One spare
+  // element, as dynarray_push_inplace grows when len reaches cap.
+  Dynarray result = make_dynarray(sizeof(GmmFlatChunk),
+                                  count_chunks(file->data, file->length) + 1);
+  const uint8 *file_data = file->data;
+  size_t data_size = file->length;
+  struct DecodingCursor cursor = {&file_data, &data_size, NULL};
+  struct DecodingContext ctx = {0, 0, flags, NULL, &result, GMM_FLAT_NONE};
+  _decode_chunks(cursor, NULL, &ctx);
+  return result;
+}
+
+// Frees the memory owned by the chunk itself, but not its children.
+static void free_chunk_payload(GmmChunk *ck) {
+  switch (ck->ctype) {
+  case GMM_MAP_PROP:
+    free(ck->map_prop_chunk.author);
+    free(ck->map_prop_chunk.creation_time);
+    free(ck->map_prop_chunk.game);
+    free(ck->map_prop_chunk.notes);
+    free(ck->map_prop_chunk.title);
+    break;
+  case GMM_LVL_PROP:
+    free(ck->level_prop_chunk.location_name);
+    free(ck->level_prop_chunk.level_name);
+    free(ck->level_prop_chunk.notes);
+    break;
+  case GMM_LVL_CELL:
+    if (ck->level_cell_chunk.shared_layers) {
+      layer_cache_release(ck->level_cell_chunk.floor);
+      layer_cache_release(ck->level_cell_chunk.floor_orientation);
+      layer_cache_release(ck->level_cell_chunk.floor_color);
+      layer_cache_release(ck->level_cell_chunk.wall_north);
+      layer_cache_release(ck->level_cell_chunk.wall_west);
+      layer_cache_release(ck->level_cell_chunk.trail);
+      break;
+    }
+    free(ck->level_cell_chunk.floor);
+    free(ck->level_cell_chunk.floor_orientation);
+    free(ck->level_cell_chunk.floor_color);
+    free(ck->level_cell_chunk.wall_north);
+    free(ck->level_cell_chunk.wall_west);
+    free(ck->level_cell_chunk.trail);
+    if (ck->level_cell_chunk.rle_layers != NULL) {
+      for (int i = 0; i < GMM_LAYER_COUNT; ++i)
+        rle_layer_free(&ck->level_cell_chunk.rle_layers[i]);
+      free(ck->level_cell_chunk.rle_layers);
+    }
+    break;
+  case GMM_LVL_ANNO:
+    for (uint16 i = 0; i < ck->level_anno_chunk.num_annotations; ++i) {
+      AnnotationRecord *rec = &ck->level_anno_chunk.records[i];
+      free(rec->text);
+      if (rec->kind == AK_CUSTOM)
+        free(rec->custom.custom_id);
+    }
+    free(ck->level_anno_chunk.records);
+    break;
+  case GMM_LVL_REGN:
+    for (uint16 i = 0; i < ck->level_regn_chunk.num_regions; ++i) {
+      free(ck->level_regn_chunk.records[i].name);
+      free(ck->level_regn_chunk.records[i].notes);
+    }
+    free(ck->level_regn_chunk.records);
+    break;
+  case GMM_MAP_LINKS:
+    free(ck->map_links_chunk.records);
+    break;
+  default:
+    break;
+  }
+}
+
+static size_t str_memory(const char *str) {
+  return str ? strlen(str) + 1 : 0;
+}
+
+// Approximate number of heap bytes owned by the chunk and its children
+size_t chunk_memory_size(GmmChunk *ck) {
+  size_t result = sizeof(GmmChunk);
+  switch (ck->ctype) {
+  case GMM_LIST:
+    for (unsigned int i = 0; i < dynarray_size(&ck->list_chunk.children); ++i)
+      result += chunk_memory_size(
+          (GmmChunk *)dynarray_get(&ck->list_chunk.children, i));
+    break;
+  case GMM_MAP_PROP:
+    result += str_memory(ck->map_prop_chunk.author) +
+              str_memory(ck->map_prop_chunk.creation_time) +
+              str_memory(ck->map_prop_chunk.game) +
+              str_memory(ck->map_prop_chunk.notes) +
+              str_memory(ck->map_prop_chunk.title);
+    break;
+  case GMM_LVL_PROP:
+    result += str_memory(ck->level_prop_chunk.location_name) +
+              str_memory(ck->level_prop_chunk.level_name) +
+              str_memory(ck->level_prop_chunk.notes);
+    break;
+  case GMM_LVL_CELL:
+    if (ck->level_cell_chunk.rle_layers != NULL) {
+      for (int i = 0; i < GMM_LAYER_COUNT; ++i)
+        result += sizeof(RleLayer) +
+                  rle_layer_memory(&ck->level_cell_chunk.rle_layers[i]);
+    } else if (ck->level_cell_chunk.shared_layers) {
+      // Shared layers are split between the levels that hold them
+      RiffChunkLevelCell *cell = &ck->level_cell_chunk;
+      result += layer_cache_share(cell->floor) +
+                layer_cache_share(cell->floor_orientation) +
+                layer_cache_share(cell->floor_color) +
+                layer_cache_share(cell->wall_north) +
+                layer_cache_share(cell->wall_west) +
+                layer_cache_share(cell->trail);
+    } else {
+      result += ck->level_cell_chunk.cells_count * GMM_LAYER_COUNT;
+    }
+    break;
+  case GMM_LVL_ANNO:
+    for (uint16 i = 0; i < ck->level_anno_chunk.num_annotations; ++i) {
+      AnnotationRecord *rec = &ck->level_anno_chunk.records[i];
+      result += sizeof(AnnotationRecord) + str_memory(rec->text);
+      if (rec->kind == AK_CUSTOM)
+        result += str_memory(rec->custom.custom_id);
+    }
+    break;
+  case GMM_LVL_REGN:
+    for (uint16 i = 0; i < ck->level_regn_chunk.num_regions; ++i)
+      result += sizeof(LevelRegionRecord) +
+                str_memory(ck->level_regn_chunk.records[i].name) +
+                str_memory(ck->level_regn_chunk.records[i].notes);
+    break;
+  case GMM_MAP_LINKS:
+    result += sizeof(MapLinksRecord) * ck->map_links_chunk.num_links;
+    break;
+  default:
+    break;
+  }
+  return result;
+}
+
+// Collects the chunks of a decoded 'lvl ' LIST chunk
+RESULT gmm_level_from_list(GmmChunk *list, GmmLevel *out) {
+  memset(out, 0, sizeof(GmmLevel));
+  CHECKERR(list->ctype != GMM_LIST ||
+               strncmp((const char *)list->list_chunk.ckType, "lvl ", 4) != 0,
+           "Chunk is not a level list\n");
+  for (unsigned int i = 0; i < dynarray_size(&list->list_chunk.children);
+       ++i) {
+    GmmChunk *ck = (GmmChunk *)dynarray_get(&list->list_chunk.children, i);
     switch (ck->ctype) {
-    case GMM_LIST:
-      free_chunks(&ck->list_chunk.children);
+    case GMM_LVL_PROP:
+      out->prop = &ck->level_prop_chunk;
+      break;
+    case GMM_LVL_COOR:
+      out->coor = &ck->level_coor_chunk;
       break;
-    case GMM_MAP_PROP:
-      free(ck->map_prop_chunk.author);
-      free(ck->map_prop_chunk.creation_time);
-      free(ck->map_prop_chunk.game);
-      free(ck->map_prop_chunk.notes);
-      free(ck->map_prop_chunk.title);
+    case GMM_LVL_CELL:
+      out->cell = &ck->level_cell_chunk;
+      break;
+    case GMM_LVL_ANNO:
+      out->anno = &ck->level_anno_chunk;
+      break;
+    case GMM_LVL_REGN:
+      out->regn = &ck->level_regn_chunk;
       break;
     default:
       break;
     }
   }
+  return RES_OK;
+onerror:
+  return RES_ERR;
+}
+
+// Collects all levels of a decoded file in file order, and the map links.
+// levels must be a Dynarray of GmmLevel, *links is left untouched if the file
+// has no links chunk.
+void gmm_collect_levels(Dynarray *chunk_array, Dynarray *levels,
+                        RiffChunkMapLinks **links) {
+  for (unsigned int i = 0; i < dynarray_size(chunk_array); ++i) {
+    GmmChunk *ck = (GmmChunk *)dynarray_get(chunk_array, i);
+    if (ck->ctype == GMM_LIST) {
+      GmmLevel level;
+      if (strncmp((const char *)ck->list_chunk.ckType, "lvl ", 4) == 0 &&
+          gmm_level_from_list(ck, &level) == RES_OK)
+        dynarray_push(levels, &level);
+      else
+        gmm_collect_levels(&ck->list_chunk.children, levels, links);
+    } else if (ck->ctype == GMM_MAP_LINKS) {
+      *links = &ck->map_links_chunk;
+    }
+  }
+}
+
+void free_chunks(Dynarray *chunk_array) {
+  for (unsigned int i = 0; i < dynarray_size(chunk_array); ++i) {
+    GmmChunk *ck = (GmmChunk *)dynarray_get(chunk_array, i);
+    if (ck->ctype == GMM_LIST)
+      free_chunks(&ck->list_chunk.children);
+    else
+      free_chunk_payload(ck);
+  }
   dynarray_free(chunk_array);
 }
 
+void free_flat_chunks(Dynarray *flat_chunks) {
+  for (unsigned int i = 0; i < dynarray_size(flat_chunks); ++i)
+    free_chunk_payload(&flat_chunk_at(flat_chunks, i)->chunk);
+  dynarray_free(flat_chunks);
+}
+
 RiffFile read_riff(FILE *fstr, const Context *ctx) {
   PACKED_STRUCT {
     uint8 ckId[4];
@@ -618,7 +878,7 @@ RiffFile read_riff(FILE *fstr, const Context *ctx) {
   }
   header;
   // read the RIFF header of GMM file
-  RiffFile result = {0, NULL};
+  RiffFile result = {0, NULL, NULL};
   size_t readlen = fread(&header, sizeof(header), 1, fstr);
   uint32 remainder_len;
   uint8 *remainder_bytes = NULL;
@@ -643,6 +903,7 @@ RiffFile read_riff(FILE *fstr, const Context *ctx) {
 
   result.length = remainder_len;
   result.data = remainder_bytes;
+  result.block = remainder_bytes;
   return result;
 onerror:
   if (remainder_bytes)
@@ -651,6 +912,162 @@ onoom:
   exit(EXIT_FAILURE);
 }
 
+// Same as read_riff, but the file is already in memory (e.g. loaded from an
+// asset pack). Takes ownership of the malloc'd buffer, the result points into
+// it, so no copy is made.
+RiffFile read_riff_buffer(uint8 *buffer, uint32 len, const Context *ctx) {
+  PACKED_STRUCT RiffHeader {
+    uint8 ckId[4];
+    uint32 ckSize;
+    uint8 formType[4];
+  }
+  *header = (struct RiffHeader *)buffer;
+  RiffFile result = {0, NULL, NULL};
+
+  CHECKERR(len < sizeof(struct RiffHeader), "Buffer of %s is too short",
+           ctx->file_name);
+  CHECKERR(strncmp((const char *)header->ckId, "RIFF", 4),
+           "The file %s is not a RIFF file", ctx->file_name);
+  CHECKERR(strncmp((const char *)header->formType, "GRMM", 4),
+           "The file %s is not a valid GMM file", ctx->file_name);
+  uint32 remainder_len = header->ckSize - 4 + header->ckSize % 2;
+  // The alignment byte at the very end is optional
+  if (remainder_len == len - sizeof(struct RiffHeader) + 1)
+    remainder_len--;
+  CHECKERR(remainder_len > len - sizeof(struct RiffHeader),
+           "Expected %u bytes of data in %s, got only %u bytes.\n",
+           remainder_len, ctx->file_name,
+           (unsigned int)(len - sizeof(struct RiffHeader)));
+
+  result.length = remainder_len;
+  result.data = buffer + sizeof(struct RiffHeader);
+  result.block = buffer;
+  return result;
+onerror:
+  free(buffer);
+  exit(EXIT_FAILURE);
+}
+
+static void write_json_string(FILE *f, const char *str) {
+  fputc('"', f);
+  for (const char *c = str ? str : ""; *c != '\0'; ++c) {
+    if (*c == '"' || *c == '\\')
+      fprintf(f, "\\%c", *c);
+    else if ((unsigned char)*c < 0x20)
+      fprintf(f, "\\u%04x", (unsigned char)*c);
+    else
+      fputc(*c, f);
+  }
+  fputc('"', f);
+}
+
+static void write_chunk_json(FILE *f, GmmChunk *ck) {
+  fprintf(f, "{\"type\": \"%s\", \"id\": \"%.4s\"",
+          chunk_type_to_str(ck->ctype),
+          (const char *)ck->unknown_chunk.head.ckId);
+  switch (ck->ctype) {
+  case GMM_LIST:
+    fprintf(f, ", \"list_type\": \"%.4s\", \"children\": ",
+            (const char *)ck->list_chunk.ckType);
+    write_chunks_json(f, &ck->list_chunk.children);
+    break;
+  case GMM_MAP_PROP:
+    fprintf(f, ", \"version\": %u, \"title\": ",
+            ck->map_prop_chunk.version);
+    write_json_string(f, ck->map_prop_chunk.title);
+    fprintf(f, ", \"game\": ");
+    write_json_string(f, ck->map_prop_chunk.game);
+    fprintf(f, ", \"author\": ");
+    write_json_string(f, ck->map_prop_chunk.author);
+    fprintf(f, ", \"creation_time\": ");
+    write_json_string(f, ck->map_prop_chunk.creation_time);
+    fprintf(f, ", \"notes\": ");
+    write_json_string(f, ck->map_prop_chunk.notes);
+    break;
+  case GMM_MAP_COOR:
+    fprintf(f, ", ");
+    map_coor_write_json(f, &ck->map_coor_chunk);
+    break;
+  case GMM_LVL_PROP:
+    fprintf(f, ", \"location_name\": ");
+    write_json_string(f, ck->level_prop_chunk.location_name);
+    fprintf(f, ", \"level_name\": ");
+    write_json_string(f, ck->level_prop_chunk.level_name);
+    fprintf(f, ", ");
+    lvl_prop_write_json(f, &ck->level_prop_chunk);
+    fprintf(f, ", \"notes\": ");
+    write_json_string(f, ck->level_prop_chunk.notes);
+    break;
+  case GMM_LVL_COOR:
+    fprintf(f, ", ");
+    lvl_coor_write_json(f, &ck->level_coor_chunk);
+    break;
+  case GMM_LVL_CELL:
+    fprintf(f, ", \"cells_count\": %lu",
+            (unsigned long)ck->level_cell_chunk.cells_count);
+    break;
+  case GMM_LVL_ANNO:
+    fprintf(f, ", \"annotations\": [");
+    for (uint16 i = 0; i < ck->level_anno_chunk.num_annotations; ++i) {
+      AnnotationRecord *rec = &ck->level_anno_chunk.records[i];
+      fprintf(f, "%s{\"row\": %u, \"column\": %u, \"kind\": %d",
+              i ? ", " : "", rec->row, rec->column, (int)rec->kind);
+      if (rec->kind == AK_INDEXED) {
+        fprintf(f, ", \"index\": %u, \"index_color\": %u",
+                rec->indexed.index, rec->indexed.index_color);
+      } else if (rec->kind == AK_CUSTOM) {
+        fprintf(f, ", \"custom_id\": ");
+        write_json_string(f, rec->custom.custom_id);
+      } else if (rec->kind == AK_ICON) {
+        fprintf(f, ", \"icon\": %u", rec->icon.icon);
+      } else if (rec->kind == AK_LABEL) {
+        fprintf(f, ", \"label_color\": %u", rec->label.label_color);
+      }
+      fprintf(f, ", \"text\": ");
+      write_json_string(f, rec->text);
+      fputc('}', f);
+    }
+    fputc(']', f);
+    break;
+  case GMM_LVL_REGN:
+    fprintf(f, ", ");
+    lvl_regn_write_json(f, &ck->level_regn_chunk);
+    fprintf(f, ", \"regions\": [");
+    for (uint16 i = 0; i < ck->level_regn_chunk.num_regions; ++i) {
+      fprintf(f, "%s{\"name\": ", i ? ", " : "");
+      write_json_string(f, ck->level_regn_chunk.records[i].name);
+      fprintf(f, ", \"notes\": ");
+      write_json_string(f, ck->level_regn_chunk.records[i].notes);
+      fputc('}', f);
+    }
+    fputc(']', f);
+    break;
+  case GMM_MAP_LINKS:
+    fprintf(f, ", \"links\": [");
+    for (uint16 i = 0; i < ck->map_links_chunk.num_links; ++i) {
+      fprintf(f, "%s{", i ? ", " : "");
+      map_link_write_json(f, &ck->map_links_chunk.records[i]);
+      fputc('}', f);
+    }
+    fputc(']', f);
+    break;
+  default:
+    break;
+  }
+  fputc('}', f);
+}
+
+// Writes the decoded chunk tree as a JSON array
+void write_chunks_json(FILE *f, Dynarray *chunk_array) {
+  fputc('[', f);
+  for (unsigned int i = 0; i < dynarray_size(chunk_array); ++i) {
+    if (i > 0)
+      fprintf(f, ", ");
+    write_chunk_json(f, (GmmChunk *)dynarray_get(chunk_array, i));
+  }
+  fputc(']', f);
+}
+
 char *chunk_type_to_str(GmmChunkType ck_type) {
   static char *unknown_type = "TYPE_UNKNOWN";
   if (ck_type < sizeof(chunk_names) / sizeof(char *)) {
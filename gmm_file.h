@@ -20,19 +20,22 @@
 #ifndef GMMFILE_H
 #define GMMFILE_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
 
 #include "defs.h"
 #include "dynarray.h"
+#include "rle_layer.h"
 
 typedef struct Context {
   char *file_name;
 } Context;
 
 typedef struct RiffFile {
-  uint16 length;
+  uint32 length;
   uint8 *data;
+  uint8 *block; // allocation that holds data, freed by free_gmmfile
 } RiffFile;
 
 typedef struct RiffChunkHeader {
@@ -90,8 +93,20 @@ typedef struct RiffChunkLevelCoords {
   uint16 column_start;
 } RiffChunkLevelCoords;
 
+typedef enum GmmLayer {
+  GMM_LAYER_FLOOR = 0,
+  GMM_LAYER_FLOOR_ORIENTATION,
+  GMM_LAYER_FLOOR_COLOR,
+  GMM_LAYER_WALL_NORTH,
+  GMM_LAYER_WALL_WEST,
+  GMM_LAYER_TRAIL,
+  GMM_LAYER_COUNT,
+} GmmLayer;
+
 typedef struct RiffChunkLevelCell {
   RiffChunkHeader head;
+  // The byte planes are NULL if the level was decoded with
+  // GMM_DECODE_RLE_LAYERS, rle_layers is set instead.
   uint8 *floor;
   uint8 *floor_orientation;
   uint8 *floor_color;
@@ -99,6 +114,11 @@ typedef struct RiffChunkLevelCell {
   uint8 *wall_west;
   uint8 *trail;
   size_t cells_count;
+  uint16 row_len; // cells per row of a layer, num_columns + 1
+  RleLayer *rle_layers; // GMM_LAYER_COUNT entries, indexed by GmmLayer
+  // The byte planes belong to layer_cache (GMM_DECODE_SHARE_LAYERS), call
+  // layer_make_writable before writing to one
+  bool shared_layers;
 } RiffChunkLevelCell;
 
 typedef struct IndexedAnnotation {
@@ -210,14 +230,88 @@ typedef struct GmmChunk {
   GmmChunkType ctype;
 } GmmChunk;
 
+// Chunks of a single decoded 'lvl ' LIST, any of them can be NULL if the
+// level doesn't have it.
+typedef struct GmmLevel {
+  RiffChunkLevelProperties *prop;
+  RiffChunkLevelCoords *coor;
+  RiffChunkLevelCell *cell;
+  RiffChunkLevelAnno *anno;
+  RiffChunkLevelRegn *regn;
+} GmmLevel;
+
+#define GMM_FLAT_NONE 0xFFFFFFFFu
+
+// Node of a flattened chunk tree. All nodes of a file live in one Dynarray in
+// pre-order, so the first child of a LIST node (if any) is the next node in the
+// array, and subtree_end is the index one past the last node of its subtree
+// (which is also the index of its next sibling, if there is one).
+// For GMM_LIST nodes chunk.list_chunk.children is left empty.
+typedef struct GmmFlatChunk {
+  GmmChunk chunk;
+  uint32 parent;      // index of the enclosing LIST, GMM_FLAT_NONE on top level
+  uint32 child_count; // number of direct children
+  uint32 subtree_end;
+} GmmFlatChunk;
+
+// Flags for decode_chunks_with_flags
+typedef enum GmmDecodeFlags {
+  // Keep cell layers in run-length form (RiffChunkLevelCell.rle_layers)
+  GMM_DECODE_RLE_LAYERS = 1,
+  // Share identical byte planes between levels through the layer cache
+  GMM_DECODE_SHARE_LAYERS = 2,
+} GmmDecodeFlags;
+
 struct DecodingCursor;
 struct DecodingContext;
 
 void free_gmmfile(RiffFile *);
 Dynarray decode_chunks(RiffFile *);
+Dynarray decode_chunks_with_flags(RiffFile *, unsigned int flags);
 void free_chunks(Dynarray *chunk_array);
+Dynarray decode_chunks_flat(RiffFile *, unsigned int flags);
+void free_flat_chunks(Dynarray *flat_chunks);
 char *chunk_type_to_str(GmmChunkType ck_type);
+RESULT gmm_level_from_list(GmmChunk *list, GmmLevel *out);
+void gmm_collect_levels(Dynarray *chunk_array, Dynarray *levels,
+                        RiffChunkMapLinks **links);
+size_t chunk_memory_size(GmmChunk *ck);
+void write_chunks_json(FILE *f, Dynarray *chunk_array);
 
 RiffFile read_riff(FILE *fstr, const Context *ctx);
+RiffFile read_riff_buffer(uint8 *buffer, uint32 len, const Context *ctx);
+
+// Returns the cell value of a layer, whichever form it was decoded in
+static inline uint8 level_cell_get(const RiffChunkLevelCell *cell,
+                                   GmmLayer layer, uint16 row, uint16 col) {
+  if (cell->rle_layers != NULL)
+    return rle_layer_get(&cell->rle_layers[layer], row, col);
+  const uint8 *planes[GMM_LAYER_COUNT] = {
+      cell->floor,      cell->floor_orientation, cell->floor_color,
+      cell->wall_north, cell->wall_west,         cell->trail};
+  return planes[layer][(uint32)row * cell->row_len + col];
+}
+
+static inline GmmFlatChunk *flat_chunk_at(Dynarray *flat_chunks,
+                                          uint32 index) {
+  return (GmmFlatChunk *)dynarray_get(flat_chunks, index);
+}
+
+// Returns the index of the first child of the node, or GMM_FLAT_NONE
+static inline uint32 flat_first_child(Dynarray *flat_chunks, uint32 index) {
+  GmmFlatChunk *node = flat_chunk_at(flat_chunks, index);
+  return node->child_count > 0 ? index + 1 : GMM_FLAT_NONE;
+}
+
+// Returns the index of the next node on the same level, or GMM_FLAT_NONE
+static inline uint32 flat_next_sibling(Dynarray *flat_chunks, uint32 index) {
+  GmmFlatChunk *node = flat_chunk_at(flat_chunks, index);
+  uint32 next = node->subtree_end;
+  if (next >= dynarray_size(flat_chunks))
+    return GMM_FLAT_NONE;
+  if (flat_chunk_at(flat_chunks, next)->parent != node->parent)
+    return GMM_FLAT_NONE;
+  return next;
+}
 
 #endif // GMMFILE_H
@@ -0,0 +1,98 @@
+/*
+    gmm2json: program that reads Gridmonger's GMM file and converts it into
+   JSON format
+    Copyright (C) 2025 Jagholin (github.com/Jagholin)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see
+   <https://www.gnu.org/licenses/>
+*/
+#ifndef GMM_SCHEMA_H
+#define GMM_SCHEMA_H
+
+#include <stdio.h>
+
+#include "defs.h"
+#include "gmm_file.h"
+
+// Layouts of the fixed-size records of GMM chunks, in on-disk order.
+// Every entry is X(type, name), where name is the field of the decoded struct.
+// The decoders and the JSON output of these records are generated from the
+// lists below, so they can't drift apart.
+
+#define GMM_COOR_FIELDS(X)                                                      \
+  X(uint8, origin)                                                              \
+  X(uint8, row_style)                                                           \
+  X(uint8, column_style)                                                        \
+  X(uint16, row_start)                                                          \
+  X(uint16, column_start)
+
+#define GMM_LVL_PROP_FIELDS(X)                                                  \
+  X(int16, elevation)                                                           \
+  X(uint16, num_rows)                                                           \
+  X(uint16, num_columns)                                                        \
+  X(uint8, override_coord_opts)
+
+#define GMM_LVL_REGN_FIELDS(X)                                                  \
+  X(uint8, enable_regions)                                                      \
+  X(uint16, rows_per_region)                                                    \
+  X(uint16, columns_per_region)                                                 \
+  X(uint8, per_region_coords)                                                   \
+  X(uint16, num_regions)
+
+#define GMM_MAP_LINK_FIELDS(X)                                                  \
+  X(uint16, src_level_index)                                                    \
+  X(uint16, src_row)                                                            \
+  X(uint16, src_column)                                                         \
+  X(uint16, dest_level_index)                                                   \
+  X(uint16, dest_row)                                                           \
+  X(uint16, dest_column)
+
+#define GMM_WIRE_FIELD(type, name) type name;
+#define GMM_COPY_FIELD(type, name) out->name = in->name;
+#define GMM_JSON_FIELD(type, name)                                              \
+  fprintf(f, "%s\"" #name "\": %ld", sep, (long)in->name);                      \
+  sep = ", ";
+
+// Defines for a record:
+//   struct <name>_wire                 packed on-disk layout
+//   <name>_decode(wire, out)           on-disk -> decoded struct
+//   <name>_write_json(f, in)           fields as JSON key/value pairs
+#define GMM_DEFINE_RECORD(name, out_type, FIELDS)                               \
+  PACKED_STRUCT name##_wire{FIELDS(GMM_WIRE_FIELD)};                            \
+  static inline void name##_decode(const struct name##_wire *in,                \
+                                   out_type *out) {                             \
+    FIELDS(GMM_COPY_FIELD)                                                      \
+  }                                                                             \
+  static inline void name##_write_json(FILE *f, const out_type *in) {           \
+    const char *sep = "";                                                       \
+    FIELDS(GMM_JSON_FIELD)                                                      \
+    (void)sep;                                                                  \
+  }
+
+GMM_DEFINE_RECORD(map_coor, RiffChunkMapCoords, GMM_COOR_FIELDS)
+GMM_DEFINE_RECORD(lvl_coor, RiffChunkLevelCoords, GMM_COOR_FIELDS)
+GMM_DEFINE_RECORD(lvl_prop, RiffChunkLevelProperties, GMM_LVL_PROP_FIELDS)
+GMM_DEFINE_RECORD(lvl_regn, RiffChunkLevelRegn, GMM_LVL_REGN_FIELDS)
+GMM_DEFINE_RECORD(map_link, MapLinksRecord, GMM_MAP_LINK_FIELDS)
+
+// MapLinksRecord has the same layout in memory as on disk, so on little endian
+// targets the whole record array can be copied at once.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define GMM_MAP_LINKS_BULK_COPY                                                 \
+  (sizeof(MapLinksRecord) == sizeof(struct map_link_wire))
+#else
+#define GMM_MAP_LINKS_BULK_COPY 0
+#endif
+
+#endif // GMM_SCHEMA_H
@@ -0,0 +1,516 @@
+/*
+    gmm2json: program that reads Gridmonger's GMM file and converts it into
+   JSON format
+    Copyright (C) 2025 Jagholin (github.com/Jagholin)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see
+   <https://www.gnu.org/licenses/>
+*/
+#include <string.h>
+
+#include "hpa.h"
+
+#define HPA_UNREACHED 0xFFFF
+#define HPA_INFINITY 0xFFFFFFFFu
+#define HPA_NONE 0xFFFFFFFFu
+// Keeps cluster areas below HPA_UNREACHED
+#define HPA_MAX_CLUSTER_SIDE 255
+
+typedef struct HpaEdgeTriple {
+  uint32 from;
+  uint32 to;
+  uint32 cost;
+} HpaEdgeTriple;
+
+static inline HpaCluster *get_cluster(HpaGraph *graph, uint32 index) {
+  return (HpaCluster *)dynarray_get(&graph->clusters, index);
+}
+
+static inline HpaNode *get_node(HpaGraph *graph, uint32 index) {
+  return (HpaNode *)dynarray_get(&graph->nodes, index);
+}
+
+static uint32 cluster_of(const HpaGraph *graph, uint16 level, uint16 row,
+                         uint16 col) {
+  const HpaLevelInfo *info = &graph->levels[level];
+  return info->first_cluster +
+         (uint32)(row / info->cluster_rows) * info->clusters_across +
+         col / info->cluster_cols;
+}
+
+static bool point_valid(const HpaGraph *graph, HpaPoint p) {
+  if (p.level >= graph->num_levels)
+    return false;
+  const LevelGrid *grid = &graph->levels[p.level].grid;
+  return p.row < grid->rows && p.col < grid->cols;
+}
+
+static inline uint32 local_index(const HpaCluster *cl, uint16 row,
+                                 uint16 col) {
+  return (uint32)(row - cl->row0) * cl->cols + (col - cl->col0);
+}
+
+static inline uint16 min_side(uint32 left, uint16 side) {
+  return left < side ? left : side;
+}
+
+static uint16 clamp_side(uint16 side) {
+  if (side == 0)
+    return 1;
+  return side > HPA_MAX_CLUSTER_SIDE ? HPA_MAX_CLUSTER_SIDE : side;
+}
+
+// Breadth-first search from a cell that doesn't leave the cluster.
+// Fills bfs_dist and bfs_from, indexed by local_index.
+static void cluster_bfs(HpaGraph *graph, const HpaCluster *cl, uint16 row,
+                        uint16 col) {
+  const LevelGrid *grid = &graph->levels[cl->level].grid;
+  uint32 head = 0, tail = 0;
+  uint32 start = local_index(cl, row, col);
+
+  memset(graph->bfs_dist, 0xFF, (size_t)cl->rows * cl->cols * sizeof(uint16));
+  graph->bfs_dist[start] = 0;
+  graph->bfs_from[start] = DIR_NONE;
+  graph->bfs_queue[tail++] = start;
+  while (head < tail) {
+    uint32 cur = graph->bfs_queue[head++];
+    uint16 r = cl->row0 + cur / cl->cols;
+    uint16 c = cl->col0 + cur % cl->cols;
+    for (int d = DIR_NORTH; d <= DIR_WEST; ++d) {
+      int nr = r + dir_drow[d] - cl->row0, nc = c + dir_dcol[d] - cl->col0;
+      if (nr < 0 || nc < 0 || nr >= cl->rows || nc >= cl->cols)
+        continue;
+      uint32 next = (uint32)nr * cl->cols + nc;
+      if (graph->bfs_dist[next] != HPA_UNREACHED ||
+          !grid_can_move(grid, r, c, d))
+        continue;
+      graph->bfs_dist[next] = graph->bfs_dist[cur] + 1;
+      graph->bfs_from[next] = (d + 2) & 3;
+      graph->bfs_queue[tail++] = next;
+    }
+  }
+}
+
+// Appends the cells of the last cluster_bfs path that ends in (row, col)
+static void append_leg(HpaGraph *graph, const HpaCluster *cl, uint16 row,
+                       uint16 col, Dynarray *cells) {
+  uint32 base = cells->len;
+  uint16 len = graph->bfs_dist[local_index(cl, row, col)];
+  for (uint16 i = 0; i < len; ++i)
+    dynarray_push_inplace(cells);
+  for (uint16 i = len; i > 0; --i) {
+    HpaPoint *p = (HpaPoint *)dynarray_get(cells, base + i - 1);
+    p->level = cl->level;
+    p->row = row;
+    p->col = col;
+    GridDir d = graph->bfs_from[local_index(cl, row, col)];
+    row += dir_drow[d];
+    col += dir_dcol[d];
+  }
+}
+
+static uint32 add_node(HpaGraph *graph, uint16 level, uint16 row,
+                       uint16 col) {
+  uint32 cluster = cluster_of(graph, level, row, col);
+  HpaCluster *cl = get_cluster(graph, cluster);
+  for (unsigned i = 0; i < cl->nodes.len; ++i) {
+    uint32 index = *(uint32 *)dynarray_get(&cl->nodes, i);
+    HpaNode *node = get_node(graph, index);
+    if (node->pos.row == row && node->pos.col == col)
+      return index;
+  }
+  uint32 index = graph->nodes.len;
+  HpaNode node = {{level, row, col}, cluster};
+  dynarray_push(&graph->nodes, &node);
+  dynarray_push(&cl->nodes, &index);
+  return index;
+}
+
+static void add_edge(Dynarray *triples, uint32 from, uint32 to, uint32 cost) {
+  HpaEdgeTriple e = {from, to, cost};
+  dynarray_push(triples, &e);
+}
+
+static bool can_cross(const LevelGrid *grid, uint16 row, uint16 col,
+                      GridDir dir) {
+  return grid_cell_open(grid, row, col) && grid_can_move(grid, row, col, dir);
+}
+
+static void add_entrance(HpaGraph *graph, Dynarray *triples, uint16 level,
+                         uint16 row, uint16 col, GridDir dir) {
+  uint32 a = add_node(graph, level, row, col);
+  uint32 b = add_node(graph, level, row + dir_drow[dir], col + dir_dcol[dir]);
+  add_edge(triples, a, b, 1);
+  add_edge(triples, b, a, 1);
+}
+
+// Puts an entrance in the middle of every open stretch of a cluster border.
+// Cells (row, col) walk along the border, the other side is in direction dir.
+// A stretch ends where a wall runs across the border on either side.
+static void add_border_entrances(HpaGraph *graph, Dynarray *triples,
+                                 uint16 level, uint16 row, uint16 col,
+                                 uint16 length, GridDir dir) {
+  const LevelGrid *grid = &graph->levels[level].grid;
+  GridDir along = dir == DIR_EAST ? DIR_SOUTH : DIR_EAST;
+  int step_row = dir_drow[along], step_col = dir_dcol[along];
+  uint16 run_start = 0;
+  bool in_run = false;
+  for (uint16 i = 0; i <= length; ++i) {
+    uint16 r = row + i * step_row, c = col + i * step_col;
+    bool open = i < length && can_cross(grid, r, c, dir);
+    bool joined = open && in_run &&
+                  grid_can_move(grid, r - step_row, c - step_col, along) &&
+                  grid_can_move(grid, r - step_row + dir_drow[dir],
+                                c - step_col + dir_dcol[dir], along);
+    if (in_run && !joined) {
+      uint16 mid = run_start + (i - run_start) / 2;
+      add_entrance(graph, triples, level, row + mid * step_row,
+                   col + mid * step_col, dir);
+      in_run = false;
+    }
+    if (open && !in_run) {
+      run_start = i;
+      in_run = true;
+    }
+  }
+}
+
+static void add_level_entrances(HpaGraph *graph, Dynarray *triples,
+                                uint16 level) {
+  const HpaLevelInfo *info = &graph->levels[level];
+  uint16 rows = info->grid.rows, cols = info->grid.cols;
+  for (uint32 c = info->cluster_cols; c < cols; c += info->cluster_cols)
+    for (uint32 r = 0; r < rows; r += info->cluster_rows) {
+      uint16 len = min_side(rows - r, info->cluster_rows);
+      add_border_entrances(graph, triples, level, r, c - 1, len, DIR_EAST);
+    }
+  for (uint32 r = info->cluster_rows; r < rows; r += info->cluster_rows)
+    for (uint32 c = 0; c < cols; c += info->cluster_cols) {
+      uint16 len = min_side(cols - c, info->cluster_cols);
+      add_border_entrances(graph, triples, level, r - 1, c, len, DIR_SOUTH);
+    }
+}
+
+static void add_cluster_paths(HpaGraph *graph, Dynarray *triples,
+                              HpaCluster *cl) {
+  for (unsigned i = 0; i < cl->nodes.len; ++i) {
+    uint32 from = *(uint32 *)dynarray_get(&cl->nodes, i);
+    HpaNode *node = get_node(graph, from);
+    cluster_bfs(graph, cl, node->pos.row, node->pos.col);
+    for (unsigned j = 0; j < cl->nodes.len; ++j) {
+      uint32 to = *(uint32 *)dynarray_get(&cl->nodes, j);
+      HpaNode *other = get_node(graph, to);
+      uint16 dist =
+          graph->bfs_dist[local_index(cl, other->pos.row, other->pos.col)];
+      if (i != j && dist != HPA_UNREACHED)
+        add_edge(triples, from, to, dist);
+    }
+  }
+}
+
+RESULT hpa_build(HpaGraph *graph, const GmmLevel *levels, uint16 num_levels,
+                 const RiffChunkMapLinks *links, uint16 default_cluster) {
+  Dynarray triples = make_dynarray(sizeof(HpaEdgeTriple), 256);
+  uint32 max_area = 1;
+
+  memset(graph, 0, sizeof(HpaGraph));
+  graph->num_levels = num_levels;
+  graph->clusters = make_dynarray(sizeof(HpaCluster), 64);
+  graph->nodes = make_dynarray(sizeof(HpaNode), 256);
+  graph->levels = calloc(num_levels ? num_levels : 1, sizeof(HpaLevelInfo));
+  OOMERROR(graph->levels);
+
+  // Cut levels into clusters
+  for (uint16 l = 0; l < num_levels; ++l) {
+    HpaLevelInfo *info = &graph->levels[l];
+    const RiffChunkLevelRegn *regn = levels[l].regn;
+    CHECKERR(level_grid_from_level(&levels[l], &info->grid) != RES_OK,
+             "Level %u has no expanded cell layers\n", l);
+    if (regn && regn->enable_regions && regn->rows_per_region &&
+        regn->columns_per_region) {
+      info->cluster_rows = clamp_side(regn->rows_per_region);
+      info->cluster_cols = clamp_side(regn->columns_per_region);
+    } else {
+      info->cluster_rows = clamp_side(default_cluster);
+      info->cluster_cols = clamp_side(default_cluster);
+    }
+    const LevelGrid *grid = &info->grid;
+    uint16 down = (grid->rows + info->cluster_rows - 1) / info->cluster_rows;
+    info->clusters_across =
+        (grid->cols + info->cluster_cols - 1) / info->cluster_cols;
+    info->first_cluster = graph->clusters.len;
+    for (uint16 y = 0; y < down; ++y)
+      for (uint16 x = 0; x < info->clusters_across; ++x) {
+        HpaCluster cl;
+        cl.level = l;
+        cl.row0 = y * info->cluster_rows;
+        cl.col0 = x * info->cluster_cols;
+        cl.rows = min_side(grid->rows - cl.row0, info->cluster_rows);
+        cl.cols = min_side(grid->cols - cl.col0, info->cluster_cols);
+        cl.nodes = make_dynarray(sizeof(uint32), 8);
+        dynarray_push(&graph->clusters, &cl);
+        if ((uint32)cl.rows * cl.cols > max_area)
+          max_area = (uint32)cl.rows * cl.cols;
+      }
+  }
+  graph->bfs_dist = malloc(max_area * sizeof(uint16));
+  OOMERROR(graph->bfs_dist);
+  graph->bfs_from = malloc(max_area);
+  OOMERROR(graph->bfs_from);
+  graph->bfs_queue = malloc(max_area * sizeof(uint32));
+  OOMERROR(graph->bfs_queue);
+
+  // Abstract nodes and the edges between clusters
+  for (uint16 l = 0; l < num_levels; ++l)
+    add_level_entrances(graph, &triples, l);
+  for (uint16 i = 0; links && i < links->num_links; ++i) {
+    const MapLinksRecord *rec = &links->records[i];
+    HpaPoint src = {rec->src_level_index, rec->src_row, rec->src_column};
+    HpaPoint dest = {rec->dest_level_index, rec->dest_row, rec->dest_column};
+    if (!point_valid(graph, src) || !point_valid(graph, dest))
+      continue;
+    uint32 a = add_node(graph, src.level, src.row, src.col);
+    uint32 b = add_node(graph, dest.level, dest.row, dest.col);
+    add_edge(&triples, a, b, 1);
+    add_edge(&triples, b, a, 1);
+  }
+  // Walking distances inside clusters
+  for (unsigned i = 0; i < graph->clusters.len; ++i)
+    add_cluster_paths(graph, &triples, get_cluster(graph, i));
+
+  // Pack the edges by source node
+  uint32 num_nodes = graph->nodes.len;
+  graph->edge_first = calloc(num_nodes + 1, sizeof(uint32));
+  OOMERROR(graph->edge_first);
+  graph->edges = malloc((triples.len ? triples.len : 1) * sizeof(HpaEdge));
+  OOMERROR(graph->edges);
+  for (unsigned i = 0; i < triples.len; ++i)
+    graph->edge_first[((HpaEdgeTriple *)dynarray_get(&triples, i))->from + 1]++;
+  for (uint32 i = 0; i < num_nodes; ++i)
+    graph->edge_first[i + 1] += graph->edge_first[i];
+  for (unsigned i = 0; i < triples.len; ++i) {
+    HpaEdgeTriple *t = (HpaEdgeTriple *)dynarray_get(&triples, i);
+    // edge_first[from] is used as the fill cursor and restored below
+    HpaEdge *e = &graph->edges[graph->edge_first[t->from]++];
+    e->to = t->to;
+    e->cost = t->cost;
+  }
+  for (uint32 i = num_nodes; i > 0; --i)
+    graph->edge_first[i] = graph->edge_first[i - 1];
+  graph->edge_first[0] = 0;
+
+  uint32 count = num_nodes ? num_nodes : 1;
+  graph->node_dist = malloc(count * sizeof(uint32));
+  OOMERROR(graph->node_dist);
+  graph->node_prev = malloc(count * sizeof(uint32));
+  OOMERROR(graph->node_prev);
+  graph->node_goal = malloc(count * sizeof(uint32));
+  OOMERROR(graph->node_goal);
+  memset(graph->node_goal, 0xFF, count * sizeof(uint32));
+  // Every relaxation pushes at most one item, plus the initial seeds
+  graph->heap = malloc((triples.len + count) * sizeof(HpaHeapItem));
+  OOMERROR(graph->heap);
+  dynarray_free(&triples);
+  return RES_OK;
+onerror:
+  dynarray_free(&triples);
+  hpa_free(graph);
+  return RES_ERR;
+onoom:
+  exit(EXIT_FAILURE);
+}
+
+void hpa_free(HpaGraph *graph) {
+  for (unsigned i = 0; i < graph->clusters.len; ++i)
+    dynarray_free(&get_cluster(graph, i)->nodes);
+  dynarray_free(&graph->clusters);
+  dynarray_free(&graph->nodes);
+  free(graph->levels);
+  free(graph->edge_first);
+  free(graph->edges);
+  free(graph->bfs_dist);
+  free(graph->bfs_from);
+  free(graph->bfs_queue);
+  free(graph->node_dist);
+  free(graph->node_prev);
+  free(graph->node_goal);
+  free(graph->heap);
+  memset(graph, 0, sizeof(HpaGraph));
+}
+
+void hpa_path_init(HpaPath *path) {
+  path->waypoints = make_dynarray(sizeof(HpaPoint), 16);
+  path->first_leg = make_dynarray(sizeof(HpaPoint), 32);
+  path->cost = 0;
+}
+
+void hpa_path_free(HpaPath *path) {
+  dynarray_free(&path->waypoints);
+  dynarray_free(&path->first_leg);
+}
+
+static void heap_push(HpaGraph *graph, uint32 *len, uint32 cost,
+                      uint32 node) {
+  uint32 i = (*len)++;
+  while (i > 0) {
+    uint32 parent = (i - 1) / 2;
+    if (graph->heap[parent].cost <= cost)
+      break;
+    graph->heap[i] = graph->heap[parent];
+    i = parent;
+  }
+  graph->heap[i].cost = cost;
+  graph->heap[i].node = node;
+}
+
+static HpaHeapItem heap_pop(HpaGraph *graph, uint32 *len) {
+  HpaHeapItem top = graph->heap[0];
+  HpaHeapItem last = graph->heap[--(*len)];
+  uint32 i = 0;
+  for (;;) {
+    uint32 child = 2 * i + 1;
+    if (child >= *len)
+      break;
+    if (child + 1 < *len &&
+        graph->heap[child + 1].cost < graph->heap[child].cost)
+      child++;
+    if (last.cost <= graph->heap[child].cost)
+      break;
+    graph->heap[i] = graph->heap[child];
+    i = child;
+  }
+  if (*len > 0)
+    graph->heap[i] = last;
+  return top;
+}
+
+RESULT hpa_find_path(HpaGraph *graph, HpaPoint start, HpaPoint goal,
+                     HpaPath *path) {
+  path->waypoints.len = 0;
+  path->first_leg.len = 0;
+  path->cost = 0;
+  CHECKERR(!point_valid(graph, start) || !point_valid(graph, goal),
+           "Path endpoint is outside of the map\n");
+  HpaCluster *start_cl =
+      get_cluster(graph, cluster_of(graph, start.level, start.row, start.col));
+  HpaCluster *goal_cl =
+      get_cluster(graph, cluster_of(graph, goal.level, goal.row, goal.col));
+
+  // Same cluster: a direct walk is never longer than a detour through the
+  // abstract graph, as long as it exists
+  if (start_cl == goal_cl) {
+    cluster_bfs(graph, start_cl, start.row, start.col);
+    uint16 dist = graph->bfs_dist[local_index(goal_cl, goal.row, goal.col)];
+    if (dist != HPA_UNREACHED) {
+      path->cost = dist;
+      dynarray_push(&path->waypoints, &goal);
+      append_leg(graph, start_cl, goal.row, goal.col, &path->first_leg);
+      return RES_OK;
+    }
+  }
+
+  // Remaining distance to the goal from the nodes of its cluster
+  cluster_bfs(graph, goal_cl, goal.row, goal.col);
+  for (unsigned i = 0; i < goal_cl->nodes.len; ++i) {
+    uint32 n = *(uint32 *)dynarray_get(&goal_cl->nodes, i);
+    HpaNode *node = get_node(graph, n);
+    uint16 dist =
+        graph->bfs_dist[local_index(goal_cl, node->pos.row, node->pos.col)];
+    graph->node_goal[n] = dist == HPA_UNREACHED ? HPA_INFINITY : dist;
+  }
+
+  // Dijkstra over the abstract graph, seeded by the nodes the start reaches.
+  // The start BFS is done last so append_leg can use it afterwards.
+  memset(graph->node_dist, 0xFF, graph->nodes.len * sizeof(uint32));
+  memset(graph->node_prev, 0xFF, graph->nodes.len * sizeof(uint32));
+  cluster_bfs(graph, start_cl, start.row, start.col);
+  uint32 heap_len = 0;
+  for (unsigned i = 0; i < start_cl->nodes.len; ++i) {
+    uint32 n = *(uint32 *)dynarray_get(&start_cl->nodes, i);
+    HpaNode *node = get_node(graph, n);
+    uint16 dist =
+        graph->bfs_dist[local_index(start_cl, node->pos.row, node->pos.col)];
+    if (dist == HPA_UNREACHED)
+      continue;
+    graph->node_dist[n] = dist;
+    heap_push(graph, &heap_len, dist, n);
+  }
+  uint32 best = HPA_INFINITY, best_node = HPA_NONE;
+  while (heap_len > 0) {
+    HpaHeapItem item = heap_pop(graph, &heap_len);
+    if (item.cost >= best)
+      break;
+    if (item.cost != graph->node_dist[item.node])
+      continue;
+    uint32 to_goal = graph->node_goal[item.node];
+    if (to_goal != HPA_INFINITY && item.cost + to_goal < best) {
+      best = item.cost + to_goal;
+      best_node = item.node;
+    }
+    for (uint32 e = graph->edge_first[item.node];
+         e < graph->edge_first[item.node + 1]; ++e) {
+      uint32 cost = item.cost + graph->edges[e].cost;
+      uint32 to = graph->edges[e].to;
+      if (cost < graph->node_dist[to]) {
+        graph->node_dist[to] = cost;
+        graph->node_prev[to] = item.node;
+        heap_push(graph, &heap_len, cost, to);
+      }
+    }
+  }
+  for (unsigned i = 0; i < goal_cl->nodes.len; ++i)
+    graph->node_goal[*(uint32 *)dynarray_get(&goal_cl->nodes, i)] =
+        HPA_INFINITY;
+  if (best_node == HPA_NONE)
+    return RES_ERR;
+
+  // Walk back over the node chain, then reverse it in place
+  for (uint32 n = best_node; n != HPA_NONE; n = graph->node_prev[n])
+    dynarray_push(&path->waypoints, &get_node(graph, n)->pos);
+  for (unsigned i = 0, j = path->waypoints.len - 1; i < j; ++i, --j) {
+    HpaPoint *a = (HpaPoint *)dynarray_get(&path->waypoints, i);
+    HpaPoint *b = (HpaPoint *)dynarray_get(&path->waypoints, j);
+    HpaPoint tmp = *a;
+    *a = *b;
+    *b = tmp;
+  }
+  HpaPoint *last =
+      (HpaPoint *)dynarray_get(&path->waypoints, path->waypoints.len - 1);
+  if (last->level != goal.level || last->row != goal.row ||
+      last->col != goal.col)
+    dynarray_push(&path->waypoints, &goal);
+  HpaPoint *first = (HpaPoint *)dynarray_get(&path->waypoints, 0);
+  append_leg(graph, start_cl, first->row, first->col, &path->first_leg);
+  path->cost = best;
+  return RES_OK;
+onerror:
+  return RES_ERR;
+}
+
+RESULT hpa_refine_leg(HpaGraph *graph, HpaPoint from, HpaPoint to,
+                      Dynarray *cells) {
+  CHECKERR(!point_valid(graph, from) || !point_valid(graph, to),
+           "Path endpoint is outside of the map\n");
+  uint32 cluster = cluster_of(graph, from.level, from.row, from.col);
+  CHECKERR(cluster != cluster_of(graph, to.level, to.row, to.col),
+           "Leg endpoints are in different clusters\n");
+  HpaCluster *cl = get_cluster(graph, cluster);
+  cluster_bfs(graph, cl, from.row, from.col);
+  if (graph->bfs_dist[local_index(cl, to.row, to.col)] == HPA_UNREACHED)
+    return RES_ERR;
+  append_leg(graph, cl, to.row, to.col, cells);
+  return RES_OK;
+onerror:
+  return RES_ERR;
+}
@@ -0,0 +1,116 @@
+/*
+    gmm2json: program that reads Gridmonger's GMM file and converts it into
+   JSON format
+    Copyright (C) 2025 Jagholin (github.com/Jagholin)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see
+   <https://www.gnu.org/licenses/>
+*/
+#ifndef HPA_H
+#define HPA_H
+
+#include "defs.h"
+#include "dynarray.h"
+#include "gmm_file.h"
+#include "level_grid.h"
+
+// Hierarchical path planner over all levels of a map.
+//
+// Every level is cut into clusters, one per Gridmonger region (or squares of
+// default_cluster cells if the level has no regions). Where two clusters
+// touch and the wall between them is walkable, the cells on both sides become
+// abstract nodes, connected by an edge of cost 1. Map links connect their two
+// endpoints the same way, in both directions. hpa_build also computes the
+// walking distances between all nodes of each cluster, so a query only has to
+// search the small abstract graph and then refine the first leg on the grid.
+
+typedef struct HpaPoint {
+  uint16 level;
+  uint16 row;
+  uint16 col;
+} HpaPoint;
+
+typedef struct HpaEdge {
+  uint32 to;
+  uint32 cost;
+} HpaEdge;
+
+typedef struct HpaNode {
+  HpaPoint pos;
+  uint32 cluster;
+} HpaNode;
+
+typedef struct HpaCluster {
+  uint16 level;
+  uint16 row0;
+  uint16 col0;
+  uint16 rows;
+  uint16 cols;
+  Dynarray nodes; // uint32 node indices
+} HpaCluster;
+
+typedef struct HpaHeapItem {
+  uint32 cost;
+  uint32 node;
+} HpaHeapItem;
+
+typedef struct HpaLevelInfo {
+  LevelGrid grid;
+  uint16 cluster_rows;
+  uint16 cluster_cols;
+  uint16 clusters_across;
+  uint32 first_cluster;
+} HpaLevelInfo;
+
+typedef struct HpaGraph {
+  uint16 num_levels;
+  HpaLevelInfo *levels;
+  Dynarray clusters; // HpaCluster
+  Dynarray nodes;    // HpaNode
+  // Edges of node i are edges[edge_first[i]] .. edges[edge_first[i + 1] - 1]
+  uint32 *edge_first;
+  HpaEdge *edges;
+  // Scratch memory for queries, allocated once in hpa_build
+  uint16 *bfs_dist;
+  uint8 *bfs_from; // GridDir pointing back towards the BFS origin
+  uint32 *bfs_queue;
+  uint32 *node_dist;
+  uint32 *node_prev;
+  uint32 *node_goal;
+  HpaHeapItem *heap;
+} HpaGraph;
+
+typedef struct HpaPath {
+  // Abstract nodes from the start cluster on, ending with the goal itself
+  Dynarray waypoints; // HpaPoint
+  // Grid cells from the start (exclusive) to the first waypoint (inclusive)
+  Dynarray first_leg; // HpaPoint
+  uint32 cost;
+} HpaPath;
+
+RESULT hpa_build(HpaGraph *graph, const GmmLevel *levels, uint16 num_levels,
+                 const RiffChunkMapLinks *links, uint16 default_cluster);
+void hpa_free(HpaGraph *graph);
+
+void hpa_path_init(HpaPath *path);
+void hpa_path_free(HpaPath *path);
+
+// Returns RES_ERR if the goal can't be reached
+RESULT hpa_find_path(HpaGraph *graph, HpaPoint start, HpaPoint goal,
+                     HpaPath *path);
+// Grid path between two cells of the same cluster, appended to cells
+RESULT hpa_refine_leg(HpaGraph *graph, HpaPoint from, HpaPoint to,
+                      Dynarray *cells);
+
+#endif // HPA_H
@@ -0,0 +1,153 @@
+/*
+    gmm2json: program that reads Gridmonger's GMM file and converts it into
+   JSON format
+    Copyright (C) 2025 Jagholin (github.com/Jagholin)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see
+   <https://www.gnu.org/licenses/>
+*/
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "layer_cache.h"
+
+#define LAYER_CACHE_BUCKETS 256
+
+typedef struct LayerHeader {
+  struct LayerHeader *next; // in the bucket
+  size_t size;
+  uint32 hash;
+  uint32 refs;
+  bool cached;
+} LayerHeader;
+
+// Keeps the cells after the header aligned
+typedef union LayerBlock {
+  LayerHeader head;
+  double align;
+} LayerBlock;
+
+static LayerHeader *buckets[LAYER_CACHE_BUCKETS];
+static uint32 interned;
+
+static LayerHeader *header_of(uint8 *layer) {
+  return &((LayerBlock *)layer - 1)->head;
+}
+
+static uint8 *cells_of(LayerHeader *header) {
+  return (uint8 *)((LayerBlock *)header + 1);
+}
+
+// FNV-1a over 32 bit words, the tail byte by byte
+static uint32 hash_layer(const uint8 *cells, size_t size) {
+  uint32 hash = 2166136261u;
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    uint32 word;
+    memcpy(&word, cells + i, 4);
+    hash = (hash ^ word) * 16777619u;
+  }
+  for (; i < size; ++i)
+    hash = (hash ^ cells[i]) * 16777619u;
+  return hash ^ (uint32)size;
+}
+
+static void unlink_layer(LayerHeader *header) {
+  LayerHeader **link = &buckets[header->hash % LAYER_CACHE_BUCKETS];
+  while (*link != header)
+    link = &(*link)->next;
+  *link = header->next;
+  header->cached = false;
+}
+
+uint8 *layer_cache_alloc(size_t size) {
+  LayerBlock *block = malloc(sizeof(LayerBlock) + size);
+  OOMERROR(block);
+  block->head.next = NULL;
+  block->head.size = size;
+  block->head.hash = 0;
+  block->head.refs = 1;
+  block->head.cached = false;
+  return cells_of(&block->head);
+onoom:
+  exit(EXIT_FAILURE);
+}
+
+uint8 *layer_cache_intern(uint8 *layer) {
+  LayerHeader *header = header_of(layer);
+  if (header->cached)
+    return layer;
+  uint32 hash = hash_layer(layer, header->size);
+  LayerHeader **bucket = &buckets[hash % LAYER_CACHE_BUCKETS];
+  interned++;
+  for (LayerHeader *other = *bucket; other != NULL; other = other->next)
+    if (other->hash == hash && other->size == header->size &&
+        memcmp(cells_of(other), layer, header->size) == 0) {
+      layer_cache_release(layer);
+      other->refs++;
+      return cells_of(other);
+    }
+  header->hash = hash;
+  header->cached = true;
+  header->next = *bucket;
+  *bucket = header;
+  return layer;
+}
+
+uint8 *layer_cache_retain(uint8 *layer) {
+  header_of(layer)->refs++;
+  return layer;
+}
+
+void layer_cache_release(uint8 *layer) {
+  if (layer == NULL)
+    return;
+  LayerHeader *header = header_of(layer);
+  if (--header->refs > 0)
+    return;
+  if (header->cached)
+    unlink_layer(header);
+  free(header);
+}
+
+uint8 *layer_make_writable(uint8 **layer) {
+  LayerHeader *header = header_of(*layer);
+  if (header->refs == 1) {
+    if (header->cached)
+      unlink_layer(header);
+    return *layer;
+  }
+  uint8 *copy = layer_cache_alloc(header->size);
+  memcpy(copy, *layer, header->size);
+  layer_cache_release(*layer);
+  *layer = copy;
+  return copy;
+}
+
+size_t layer_cache_share(const uint8 *layer) {
+  const LayerHeader *header = &((const LayerBlock *)layer - 1)->head;
+  return header->size / header->refs;
+}
+
+void layer_cache_stats(LayerCacheStats *stats) {
+  memset(stats, 0, sizeof(*stats));
+  stats->interned = interned;
+  for (int i = 0; i < LAYER_CACHE_BUCKETS; ++i)
+    for (LayerHeader *h = buckets[i]; h != NULL; h = h->next) {
+      stats->unique++;
+      stats->bytes_wanted += h->size * h->refs;
+      stats->bytes_stored += h->size;
+    }
+}
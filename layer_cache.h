@@ -0,0 +1,58 @@
+/*
+    gmm2json: program that reads Gridmonger's GMM file and converts it into
+   JSON format
+    Copyright (C) 2025 Jagholin (github.com/Jagholin)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see
+   <https://www.gnu.org/licenses/>
+*/
+#ifndef LAYER_CACHE_H
+#define LAYER_CACHE_H
+
+#include <stddef.h>
+
+#include "defs.h"
+
+// Reference counted cell layers, shared between levels by content.
+//
+// Every layer block starts with a header (see layer_cache.c) in front of the
+// cells, so a layer is still passed around as a plain uint8 pointer. Interned
+// layers are kept in a hash table keyed by their content and must not be
+// written to; layer_make_writable gives the caller a private copy first.
+
+// Allocates a private layer of size cells with one reference
+uint8 *layer_cache_alloc(size_t size);
+// Returns the shared layer with the same content and releases layer, or adds
+// layer to the cache and returns it
+uint8 *layer_cache_intern(uint8 *layer);
+uint8 *layer_cache_retain(uint8 *layer);
+// Frees the layer when its last reference goes away. NULL is ignored.
+void layer_cache_release(uint8 *layer);
+// Makes *layer private to the caller before it gets written to. Copies it if
+// it has other references, otherwise just takes it out of the cache.
+uint8 *layer_make_writable(uint8 **layer);
+// Cells of the layer divided among its references, what each holder of the
+// layer accounts for in memory budgets
+size_t layer_cache_share(const uint8 *layer);
+
+typedef struct LayerCacheStats {
+  uint32 interned;      // layers handed out by layer_cache_intern
+  uint32 unique;        // layers in the cache
+  size_t bytes_wanted;  // cells of all references to cached layers
+  size_t bytes_stored;  // cells actually stored in the cache
+} LayerCacheStats;
+
+void layer_cache_stats(LayerCacheStats *stats);
+
+#endif // LAYER_CACHE_H
@@ -0,0 +1,220 @@
+/*
+    gmm2json: program that reads Gridmonger's GMM file and converts it into
+   JSON format
+    Copyright (C) 2025 Jagholin (github.com/Jagholin)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see
+   <https://www.gnu.org/licenses/>
+*/
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "layer_query.h"
+
+static inline bool pred_match(LayerPredicate pred, uint8 value) {
+  switch (pred.kind) {
+  case LAYER_PRED_EQ:
+    return value == pred.a;
+  case LAYER_PRED_NE:
+    return value != pred.a;
+  case LAYER_PRED_RANGE:
+    return (uint8)(value - pred.a) <= (uint8)(pred.b - pred.a);
+  case LAYER_PRED_MASK:
+    return (value & pred.a) != 0;
+  }
+  return false;
+}
+
+#ifdef __SSE2__
+// Match mask of 16 cells, bit i is set if p[i] matches
+static inline uint32 match16(const uint8 *p, LayerPredicate pred) {
+  __m128i v = _mm_loadu_si128((const __m128i *)p);
+  __m128i a = _mm_set1_epi8((char)pred.a);
+  switch (pred.kind) {
+  case LAYER_PRED_EQ:
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(v, a));
+  case LAYER_PRED_NE:
+    return ~_mm_movemask_epi8(_mm_cmpeq_epi8(v, a)) & 0xFFFF;
+  case LAYER_PRED_RANGE: {
+    // Unsigned (value - a) <= (b - a), as min(x, limit) == x
+    __m128i limit = _mm_set1_epi8((char)(uint8)(pred.b - pred.a));
+    __m128i x = _mm_sub_epi8(v, a);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(x, limit), x));
+  }
+  case LAYER_PRED_MASK: {
+    __m128i zero = _mm_setzero_si128();
+    __m128i masked = _mm_and_si128(v, a);
+    return ~_mm_movemask_epi8(_mm_cmpeq_epi8(masked, zero)) & 0xFFFF;
+  }
+  }
+  return 0;
+}
+#endif
+
+// Fills words with the match bits of one row, bits past cols stay clear
+static void scan_row(const uint8 *row, uint16 cols, LayerPredicate pred,
+                     uint32 *words) {
+  uint32 col = 0;
+  memset(words, 0, ((cols + 31) >> 5) * sizeof(uint32));
+#ifdef __SSE2__
+  for (; col + 16 <= cols; col += 16)
+    words[col >> 5] |= match16(row + col, pred) << (col & 31);
+#endif
+  for (; col < cols; ++col)
+    if (pred_match(pred, row[col]))
+      words[col >> 5] |= 1u << (col & 31);
+}
+
+static inline uint32 popcount(uint32 x) { return __builtin_popcount(x); }
+
+RESULT layer_view_from_level(const GmmLevel *level, GmmLayer layer,
+                             LayerView *out) {
+  if (level->prop == NULL || level->cell == NULL ||
+      level->cell->floor == NULL || layer >= GMM_LAYER_COUNT)
+    return RES_BAD_INPUT;
+  const RiffChunkLevelCell *cell = level->cell;
+  const uint8 *planes[GMM_LAYER_COUNT] = {
+      cell->floor,      cell->floor_orientation, cell->floor_color,
+      cell->wall_north, cell->wall_west,         cell->trail};
+  out->data = planes[layer];
+  out->rows = level->prop->num_rows;
+  out->cols = level->prop->num_columns;
+  out->stride = cell->row_len;
+  return RES_OK;
+}
+
+RESULT layer_bitset_init(LayerBitset *set, uint16 rows, uint16 cols) {
+  set->rows = rows;
+  set->cols = cols;
+  set->words_per_row = (cols + 31) >> 5;
+  set->words = calloc((size_t)rows * set->words_per_row + 1, sizeof(uint32));
+  OOMERROR(set->words);
+  return RES_OK;
+onoom:
+  exit(EXIT_FAILURE);
+}
+
+void layer_bitset_free(LayerBitset *set) {
+  free(set->words);
+  set->words = NULL;
+}
+
+// Scratch row of match bits, big enough for any row of the view
+static uint32 *alloc_row_words(const LayerView *view) {
+  uint32 *words = malloc((((view->cols + 31) >> 5) + 1) * sizeof(uint32));
+  OOMERROR(words);
+  return words;
+onoom:
+  exit(EXIT_FAILURE);
+}
+
+uint32 layer_count(const LayerView *view, LayerPredicate pred) {
+  uint32 words_per_row = (view->cols + 31) >> 5, count = 0;
+  uint32 *words = alloc_row_words(view);
+  for (uint16 r = 0; r < view->rows; ++r) {
+    scan_row(view->data + (uint32)r * view->stride, view->cols, pred, words);
+    for (uint32 w = 0; w < words_per_row; ++w)
+      count += popcount(words[w]);
+  }
+  free(words);
+  return count;
+}
+
+uint32 layer_select(const LayerView *view, LayerPredicate pred,
+                    LayerBitset *set) {
+  uint32 count = 0;
+  for (uint16 r = 0; r < view->rows; ++r) {
+    uint32 *words = set->words + (uint32)r * set->words_per_row;
+    scan_row(view->data + (uint32)r * view->stride, view->cols, pred, words);
+    for (uint32 w = 0; w < set->words_per_row; ++w)
+      count += popcount(words[w]);
+  }
+  return count;
+}
+
+uint32 layer_select_indices(const LayerView *view, LayerPredicate pred,
+                            Dynarray *indices) {
+  uint32 words_per_row = (view->cols + 31) >> 5, count = 0;
+  uint32 *words = alloc_row_words(view);
+  for (uint16 r = 0; r < view->rows; ++r) {
+    uint32 base = (uint32)r * view->stride;
+    scan_row(view->data + base, view->cols, pred, words);
+    for (uint32 w = 0; w < words_per_row; ++w)
+      for (uint32 bits = words[w]; bits != 0; bits &= bits - 1) {
+        uint32 index = base + (w << 5) + __builtin_ctz(bits);
+        dynarray_push(indices, &index);
+        count++;
+      }
+  }
+  free(words);
+  return count;
+}
+
+void layer_histogram(const LayerView *view, uint32 hist[256]) {
+  // Four partial histograms, so runs of equal values don't serialize on a
+  // single counter
+  uint32 part[4][256];
+  memset(part, 0, sizeof(part));
+  for (uint16 r = 0; r < view->rows; ++r) {
+    const uint8 *row = view->data + (uint32)r * view->stride;
+    uint16 c = 0;
+    for (; c + 4 <= view->cols; c += 4) {
+      part[0][row[c]]++;
+      part[1][row[c + 1]]++;
+      part[2][row[c + 2]]++;
+      part[3][row[c + 3]]++;
+    }
+    for (; c < view->cols; ++c)
+      part[0][row[c]]++;
+  }
+  for (int v = 0; v < 256; ++v)
+    hist[v] = part[0][v] + part[1][v] + part[2][v] + part[3][v];
+}
+
+bool layer_bbox(const LayerView *view, LayerPredicate pred, LayerBox *box) {
+  uint32 words_per_row = (view->cols + 31) >> 5;
+  uint32 *words = alloc_row_words(view);
+  bool found = false;
+  for (uint16 r = 0; r < view->rows; ++r) {
+    scan_row(view->data + (uint32)r * view->stride, view->cols, pred, words);
+    uint32 first = 0, last = 0;
+    bool any = false;
+    for (uint32 w = 0; w < words_per_row; ++w) {
+      if (words[w] == 0)
+        continue;
+      if (!any)
+        first = (w << 5) + __builtin_ctz(words[w]);
+      last = (w << 5) + 31 - __builtin_clz(words[w]);
+      any = true;
+    }
+    if (!any)
+      continue;
+    if (!found) {
+      box->row_min = r;
+      box->col_min = first;
+      box->col_max = last;
+      found = true;
+    }
+    box->row_max = r;
+    if (first < box->col_min)
+      box->col_min = first;
+    if (last > box->col_max)
+      box->col_max = last;
+  }
+  free(words);
+  return found;
+}
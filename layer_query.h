@@ -0,0 +1,116 @@
+/*
+    gmm2json: program that reads Gridmonger's GMM file and converts it into
+   JSON format
+    Copyright (C) 2025 Jagholin (github.com/Jagholin)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see
+   <https://www.gnu.org/licenses/>
+*/
+#ifndef LAYER_QUERY_H
+#define LAYER_QUERY_H
+
+#include <stdbool.h>
+
+#include "defs.h"
+#include "dynarray.h"
+#include "gmm_file.h"
+
+// Scans over the byte planes of a decoded level.
+// Rows are matched 16 cells at a time with SSE2 compare/movemask when the
+// compiler targets SSE2, and one cell at a time otherwise (386 build).
+
+typedef enum LayerPredKind {
+  LAYER_PRED_EQ,    // value == a
+  LAYER_PRED_NE,    // value != a
+  LAYER_PRED_RANGE, // a <= value <= b, wraps past 255 if a > b
+  LAYER_PRED_MASK,  // (value & a) != 0
+} LayerPredKind;
+
+typedef struct LayerPredicate {
+  LayerPredKind kind;
+  uint8 a;
+  uint8 b;
+} LayerPredicate;
+
+// The rows x cols visible cells of a byte plane with stride bytes per row
+typedef struct LayerView {
+  const uint8 *data;
+  uint16 rows;
+  uint16 cols;
+  uint16 stride;
+} LayerView;
+
+// One bit per visible cell, every row starts on a new word
+typedef struct LayerBitset {
+  uint32 *words;
+  uint16 rows;
+  uint16 cols;
+  uint32 words_per_row;
+} LayerBitset;
+
+typedef struct LayerBox {
+  uint16 row_min;
+  uint16 col_min;
+  uint16 row_max;
+  uint16 col_max;
+} LayerBox;
+
+static inline LayerPredicate layer_pred_eq(uint8 value) {
+  LayerPredicate pred = {LAYER_PRED_EQ, value, value};
+  return pred;
+}
+
+static inline LayerPredicate layer_pred_ne(uint8 value) {
+  LayerPredicate pred = {LAYER_PRED_NE, value, value};
+  return pred;
+}
+
+static inline LayerPredicate layer_pred_range(uint8 lo, uint8 hi) {
+  LayerPredicate pred = {LAYER_PRED_RANGE, lo, hi};
+  return pred;
+}
+
+static inline LayerPredicate layer_pred_mask(uint8 bits) {
+  LayerPredicate pred = {LAYER_PRED_MASK, bits, 0};
+  return pred;
+}
+
+// The level has to be decoded with its layers expanded
+RESULT layer_view_from_level(const GmmLevel *level, GmmLayer layer,
+                             LayerView *out);
+
+RESULT layer_bitset_init(LayerBitset *set, uint16 rows, uint16 cols);
+void layer_bitset_free(LayerBitset *set);
+
+static inline bool layer_bitset_test(const LayerBitset *set, uint16 row,
+                                     uint16 col) {
+  return (set->words[row * set->words_per_row + (col >> 5)] >> (col & 31)) & 1;
+}
+
+// Number of cells matching the predicate
+uint32 layer_count(const LayerView *view, LayerPredicate pred);
+// Marks matching cells in set, which must have the size of the view.
+// Returns the number of matches.
+uint32 layer_select(const LayerView *view, LayerPredicate pred,
+                    LayerBitset *set);
+// Appends the plane index (row * stride + col) of every match to a Dynarray
+// of uint32. Returns the number of matches.
+uint32 layer_select_indices(const LayerView *view, LayerPredicate pred,
+                            Dynarray *indices);
+// Counts of every value
+void layer_histogram(const LayerView *view, uint32 hist[256]);
+// Returns false if no cell matches
+bool layer_bbox(const LayerView *view, LayerPredicate pred, LayerBox *box);
+
+#endif // LAYER_QUERY_H
@@ -0,0 +1,128 @@
+/*
+    gmm2json: program that reads Gridmonger's GMM file and converts it into
+   JSON format
+    Copyright (C) 2025 Jagholin (github.com/Jagholin)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see
+   <https://www.gnu.org/licenses/>
+*/
+#ifndef LEVEL_GRID_H
+#define LEVEL_GRID_H
+
+#include <stdbool.h>
+
+#include "defs.h"
+#include "gmm_file.h"
+
+// Gridmonger floor and wall values that the game logic cares about
+#define GMM_FLOOR_EMPTY 0
+
+#define GMM_WALL_NONE 0
+#define GMM_WALL_WALL 10
+#define GMM_WALL_ILLUSORY 11
+#define GMM_WALL_INVISIBLE 12
+#define GMM_WALL_DOOR 20
+#define GMM_WALL_LOCKED_DOOR 21
+#define GMM_WALL_ARCHWAY 22
+#define GMM_WALL_SECRET_DOOR 23
+#define GMM_WALL_ONE_WAY_DOOR 24
+
+typedef enum GridDir {
+  DIR_NORTH = 0,
+  DIR_EAST,
+  DIR_SOUTH,
+  DIR_WEST,
+  DIR_NONE,
+} GridDir;
+
+static const int dir_drow[4] = {-1, 0, 1, 0};
+static const int dir_dcol[4] = {0, 1, 0, -1};
+
+// View of the layers of a level that movement depends on.
+// Layers have (rows + 1) * stride cells, the extra row and column hold the
+// south and east walls of the last row and column.
+typedef struct LevelGrid {
+  uint16 rows;
+  uint16 cols;
+  uint16 stride;
+  const uint8 *floor;
+  const uint8 *wall_north;
+  const uint8 *wall_west;
+} LevelGrid;
+
+// Fills the grid from a decoded level. The level has to be decoded with its
+// layers expanded (without GMM_DECODE_RLE_LAYERS).
+static inline RESULT level_grid_from_level(const GmmLevel *level,
+                                           LevelGrid *out) {
+  if (level->prop == NULL || level->cell == NULL ||
+      level->cell->floor == NULL)
+    return RES_BAD_INPUT;
+  out->rows = level->prop->num_rows;
+  out->cols = level->prop->num_columns;
+  out->stride = level->cell->row_len;
+  out->floor = level->cell->floor;
+  out->wall_north = level->cell->wall_north;
+  out->wall_west = level->cell->wall_west;
+  return RES_OK;
+}
+
+static inline bool wall_walkable(uint8 wall) {
+  return wall == GMM_WALL_NONE || wall == GMM_WALL_ILLUSORY ||
+         wall == GMM_WALL_DOOR || wall == GMM_WALL_ARCHWAY ||
+         wall == GMM_WALL_SECRET_DOOR || wall == GMM_WALL_ONE_WAY_DOOR;
+}
+
+// Walls that light and sight pass through
+static inline bool wall_transparent(uint8 wall) {
+  return wall == GMM_WALL_NONE || wall == GMM_WALL_ARCHWAY;
+}
+
+static inline uint32 grid_index(const LevelGrid *grid, uint16 row,
+                                uint16 col) {
+  return (uint32)row * grid->stride + col;
+}
+
+static inline bool grid_cell_open(const LevelGrid *grid, uint16 row,
+                                  uint16 col) {
+  return grid->floor[grid_index(grid, row, col)] != GMM_FLOOR_EMPTY;
+}
+
+// Wall on the given side of the cell
+static inline uint8 grid_edge(const LevelGrid *grid, uint16 row, uint16 col,
+                              GridDir dir) {
+  switch (dir) {
+  case DIR_NORTH:
+    return grid->wall_north[grid_index(grid, row, col)];
+  case DIR_SOUTH:
+    return grid->wall_north[grid_index(grid, row + 1, col)];
+  case DIR_WEST:
+    return grid->wall_west[grid_index(grid, row, col)];
+  case DIR_EAST:
+    return grid->wall_west[grid_index(grid, row, col + 1)];
+  default:
+    return GMM_WALL_WALL;
+  }
+}
+
+// Can we walk from the cell to its neighbour in the given direction
+static inline bool grid_can_move(const LevelGrid *grid, uint16 row,
+                                 uint16 col, GridDir dir) {
+  int nrow = row + dir_drow[dir], ncol = col + dir_dcol[dir];
+  if (nrow < 0 || ncol < 0 || nrow >= grid->rows || ncol >= grid->cols)
+    return false;
+  return grid_cell_open(grid, nrow, ncol) &&
+         wall_walkable(grid_edge(grid, row, col, dir));
+}
+
+#endif // LEVEL_GRID_H
@@ -0,0 +1,347 @@
+/*
+    gmm2json: program that reads Gridmonger's GMM file and converts it into
+   JSON format
+    Copyright (C) 2025 Jagholin (github.com/Jagholin)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see
+   <https://www.gnu.org/licenses/>
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "level_manager.h"
+
+// Reads a whole chunk from the file and decodes it
+static RESULT decode_block(LevelManager *mgr, uint32 offset, uint32 size,
+                           Dynarray *out) {
+  uint8 *data = malloc(size);
+  OOMERROR(data);
+  CHECKERR(fseek(mgr->file, offset, SEEK_SET) != 0,
+           "Can't seek to offset %u\n", offset);
+  CHECKERR(fread(data, 1, size, mgr->file) != size,
+           "Can't read %u bytes at offset %u\n", size, offset);
+  RiffFile block = {size, data, NULL};
+  *out = decode_chunks_with_flags(&block, mgr->decode_flags);
+  free(data);
+  return RES_OK;
+onerror:
+  free(data);
+  return RES_ERR;
+onoom:
+  exit(EXIT_FAILURE);
+}
+
+static RESULT load_links(LevelManager *mgr, uint32 offset, uint32 size) {
+  Dynarray chunks;
+  CHECKERR(decode_block(mgr, offset, size, &chunks) != RES_OK,
+           "Can't decode map links\n");
+  GmmChunk *ck = (GmmChunk *)dynarray_get(&chunks, 0);
+  if (ck != NULL && ck->ctype == GMM_MAP_LINKS) {
+    // Take over the records, the rest of the chunk isn't needed
+    free(mgr->links);
+    mgr->links = ck->map_links_chunk.records;
+    mgr->num_links = ck->map_links_chunk.num_links;
+    ck->ctype = GMM_UNKNOWN;
+  }
+  free_chunks(&chunks);
+  return RES_OK;
+onerror:
+  return RES_ERR;
+}
+
+// Walks the chunk headers in [pos, end) without decoding the chunks, and
+// records the levels and the links.
+static RESULT index_chunks(LevelManager *mgr, uint32 pos, uint32 end) {
+  while (pos + 8 <= end) {
+    PACKED_STRUCT {
+      char ckId[4];
+      uint32 ckSize;
+    }
+    header;
+    char list_type[4];
+    CHECKERR(fseek(mgr->file, pos, SEEK_SET) != 0 ||
+                 fread(&header, sizeof(header), 1, mgr->file) != 1,
+             "Can't read chunk header at offset %u\n", pos);
+    uint32 padded_size = header.ckSize + header.ckSize % 2;
+    CHECKERR(pos + 8 + header.ckSize > end,
+             "Chunk %.4s at offset %u is larger than its parent\n",
+             header.ckId, pos);
+
+    if (strncmp(header.ckId, "LIST", 4) == 0) {
+      CHECKERR(fread(list_type, 4, 1, mgr->file) != 1,
+               "Can't read list type at offset %u\n", pos);
+      if (strncmp(list_type, "lvl ", 4) == 0) {
+        LevelSpan span = {pos, 8 + header.ckSize};
+        dynarray_push(&mgr->spans, &span);
+      } else if (index_chunks(mgr, pos + 12, pos + 8 + header.ckSize) !=
+                 RES_OK) {
+        goto onerror;
+      }
+    } else if (strncmp(header.ckId, "lnks", 4) == 0) {
+      if (load_links(mgr, pos, 8 + header.ckSize) != RES_OK)
+        goto onerror;
+    }
+    pos += 8 + padded_size;
+  }
+  return RES_OK;
+onerror:
+  return RES_ERR;
+}
+
+static int compare_uint32(const void *a, const void *b) {
+  uint32 x = *(const uint32 *)a, y = *(const uint32 *)b;
+  return x < y ? -1 : x > y;
+}
+
+// Builds the level adjacency lists from the map links. Links are followed in
+// both directions, since a level has to be ready whichever side we come from.
+static void build_adjacency(LevelManager *mgr) {
+  uint16 num_levels = level_manager_num_levels(mgr);
+  Dynarray pairs = make_dynarray(sizeof(uint32), 2 * mgr->num_links + 1);
+  for (uint16 i = 0; i < mgr->num_links; ++i) {
+    uint16 a = mgr->links[i].src_level_index;
+    uint16 b = mgr->links[i].dest_level_index;
+    if (a == b || a >= num_levels || b >= num_levels)
+      continue;
+    uint32 ab = ((uint32)a << 16) | b, ba = ((uint32)b << 16) | a;
+    dynarray_push(&pairs, &ab);
+    dynarray_push(&pairs, &ba);
+  }
+  qsort(pairs.data, pairs.len, sizeof(uint32), compare_uint32);
+
+  mgr->adj_first = calloc(num_levels + 1, sizeof(uint32));
+  mgr->adj_list = malloc(sizeof(uint16) * (pairs.len + 1));
+  OOMERROR(mgr->adj_first);
+  OOMERROR(mgr->adj_list);
+  uint32 count = 0;
+  for (unsigned int i = 0; i < pairs.len; ++i) {
+    uint32 pair = *(uint32 *)dynarray_get(&pairs, i);
+    if (i > 0 && pair == *(uint32 *)dynarray_get(&pairs, i - 1))
+      continue;
+    mgr->adj_list[count++] = pair & 0xFFFF;
+    mgr->adj_first[(pair >> 16) + 1]++;
+  }
+  for (uint16 i = 0; i < num_levels; ++i)
+    mgr->adj_first[i + 1] += mgr->adj_first[i];
+  dynarray_free(&pairs);
+  return;
+onoom:
+  exit(EXIT_FAILURE);
+}
+
+RESULT level_manager_open(LevelManager *mgr, FILE *file, size_t budget,
+                          unsigned int decode_flags) {
+  memset(mgr, 0, sizeof(LevelManager));
+  mgr->file = file;
+  mgr->decode_flags = decode_flags;
+  mgr->budget = budget;
+  mgr->spans = make_dynarray(sizeof(LevelSpan), 8);
+  mgr->resident = make_dynarray(sizeof(ResidentLevel *), 4);
+  mgr->prefetch_queue = make_dynarray(sizeof(uint16), 4);
+
+  PACKED_STRUCT {
+    uint8 ckId[4];
+    uint32 ckSize;
+    uint8 formType[4];
+  }
+  header;
+  CHECKERR(fseek(file, 0, SEEK_SET) != 0 ||
+               fread(&header, sizeof(header), 1, file) != 1,
+           "Couldn't read the RIFF header\n");
+  CHECKERR(strncmp((const char *)header.ckId, "RIFF", 4),
+           "The file is not a RIFF file\n");
+  CHECKERR(strncmp((const char *)header.formType, "GRMM", 4),
+           "The file is not a valid GMM file\n");
+  CHECKERR(index_chunks(mgr, 12, 8 + header.ckSize) != RES_OK,
+           "Couldn't index the GMM file\n");
+  build_adjacency(mgr);
+  mgr->current = 0;
+  return RES_OK;
+onerror:
+  level_manager_close(mgr);
+  return RES_ERR;
+}
+
+static void evict_at(LevelManager *mgr, unsigned int i) {
+  ResidentLevel **slot = (ResidentLevel **)dynarray_get(&mgr->resident, i);
+  ResidentLevel *res = *slot;
+  if (mgr->on_evicting != NULL)
+    mgr->on_evicting(mgr->hook_user, res->level_index, &res->level);
+  mgr->used -= res->memory;
+  free_chunks(&res->chunks);
+  free(res);
+  // Order doesn't matter, move the last one into the hole
+  *slot = *(ResidentLevel **)dynarray_get(&mgr->resident,
+                                          mgr->resident.len - 1);
+  dynarray_pop(&mgr->resident);
+}
+
+void level_manager_close(LevelManager *mgr) {
+  while (mgr->resident.len > 0)
+    evict_at(mgr, mgr->resident.len - 1);
+  dynarray_free(&mgr->resident);
+  dynarray_free(&mgr->prefetch_queue);
+  dynarray_free(&mgr->spans);
+  free(mgr->links);
+  free(mgr->adj_first);
+  free(mgr->adj_list);
+  mgr->links = NULL;
+  mgr->adj_first = NULL;
+  mgr->adj_list = NULL;
+}
+
+static ResidentLevel *find_resident(LevelManager *mgr, uint16 level_index) {
+  for (unsigned int i = 0; i < mgr->resident.len; ++i) {
+    ResidentLevel *res = *(ResidentLevel **)dynarray_get(&mgr->resident, i);
+    if (res->level_index == level_index)
+      return res;
+  }
+  return NULL;
+}
+
+static bool is_neighbour(LevelManager *mgr, uint16 level_index) {
+  for (uint32 i = mgr->adj_first[mgr->current];
+       i < mgr->adj_first[mgr->current + 1]; ++i)
+    if (mgr->adj_list[i] == level_index)
+      return true;
+  return false;
+}
+
+// Recomputes the memory of the resident levels. It changes after loading:
+// layers get copied private by layer_make_writable, and shared layers are
+// split between the levels that hold them at the time.
+static size_t update_memory(LevelManager *mgr) {
+  mgr->used = 0;
+  for (unsigned int i = 0; i < mgr->resident.len; ++i) {
+    ResidentLevel *res = *(ResidentLevel **)dynarray_get(&mgr->resident, i);
+    res->memory = sizeof(ResidentLevel) +
+                  chunk_memory_size((GmmChunk *)dynarray_get(&res->chunks, 0));
+    mgr->used += res->memory;
+  }
+  return mgr->used;
+}
+
+// Evicts least recently used levels until we are within the budget.
+// Returns false if that wasn't possible.
+static bool evict_over_budget(LevelManager *mgr, bool keep_neighbours) {
+  while (update_memory(mgr) > mgr->budget) {
+    int victim = -1;
+    uint32 oldest = 0;
+    for (unsigned int i = 0; i < mgr->resident.len; ++i) {
+      ResidentLevel *res = *(ResidentLevel **)dynarray_get(&mgr->resident, i);
+      if (res->level_index == mgr->current)
+        continue;
+      if (keep_neighbours && is_neighbour(mgr, res->level_index))
+        continue;
+      if (victim < 0 || res->last_used < oldest) {
+        victim = i;
+        oldest = res->last_used;
+      }
+    }
+    if (victim < 0)
+      return false;
+    evict_at(mgr, victim);
+  }
+  return true;
+}
+
+static ResidentLevel *load_level(LevelManager *mgr, uint16 level_index) {
+  LevelSpan *span = (LevelSpan *)dynarray_get(&mgr->spans, level_index);
+  ResidentLevel *res = malloc(sizeof(ResidentLevel));
+  bool decoded = false;
+  OOMERROR(res);
+  res->level_index = level_index;
+  res->last_used = mgr->clock;
+  CHECKERR(decode_block(mgr, span->offset, span->size, &res->chunks) != RES_OK,
+           "Couldn't load level %u\n", level_index);
+  decoded = true;
+  GmmChunk *list = (GmmChunk *)dynarray_get(&res->chunks, 0);
+  CHECKERR(list == NULL || gmm_level_from_list(list, &res->level) != RES_OK,
+           "Level %u has no level list\n", level_index);
+  res->memory = sizeof(ResidentLevel) + chunk_memory_size(list);
+  mgr->used += res->memory;
+  dynarray_push(&mgr->resident, &res);
+  if (mgr->on_loaded != NULL)
+    mgr->on_loaded(mgr->hook_user, level_index, &res->level);
+  return res;
+onerror:
+  if (decoded)
+    free_chunks(&res->chunks);
+  free(res);
+  return NULL;
+onoom:
+  exit(EXIT_FAILURE);
+}
+
+GmmLevel *level_manager_peek(LevelManager *mgr, uint16 level_index) {
+  ResidentLevel *res = find_resident(mgr, level_index);
+  if (res == NULL)
+    return NULL;
+  res->last_used = ++mgr->clock;
+  return &res->level;
+}
+
+GmmLevel *level_manager_enter(LevelManager *mgr, uint16 level_index) {
+  CHECKERR(level_index >= level_manager_num_levels(mgr),
+           "Level %u doesn't exist\n", level_index);
+  ResidentLevel *res = find_resident(mgr, level_index);
+  if (res == NULL)
+    res = load_level(mgr, level_index);
+  CHECKERR(res == NULL, "Couldn't enter level %u\n", level_index);
+  mgr->current = level_index;
+
+  // Neighbours that are already resident get refreshed, so that they are
+  // the last to go, the others are queued for pump.
+  mgr->prefetch_queue.len = 0;
+  for (uint32 i = mgr->adj_first[level_index];
+       i < mgr->adj_first[level_index + 1]; ++i) {
+    uint16 neighbour = mgr->adj_list[i];
+    ResidentLevel *nres = find_resident(mgr, neighbour);
+    if (nres != NULL)
+      nres->last_used = ++mgr->clock;
+    else
+      dynarray_push(&mgr->prefetch_queue, &neighbour);
+  }
+  res->last_used = ++mgr->clock;
+  evict_over_budget(mgr, false);
+  return &res->level;
+onerror:
+  return NULL;
+}
+
+bool level_manager_pump(LevelManager *mgr) {
+  while (mgr->prefetch_queue.len > 0) {
+    uint16 level_index = *(uint16 *)dynarray_get(
+        &mgr->prefetch_queue, mgr->prefetch_queue.len - 1);
+    dynarray_pop(&mgr->prefetch_queue);
+    if (find_resident(mgr, level_index) != NULL)
+      continue;
+
+    ResidentLevel *res = load_level(mgr, level_index);
+    if (res == NULL)
+      continue;
+    res->last_used = ++mgr->clock;
+    if (!evict_over_budget(mgr, true)) {
+      // The budget can't hold the current level and all its neighbours,
+      // give up on prefetching the rest.
+      for (unsigned int i = 0; i < mgr->resident.len; ++i)
+        if (*(ResidentLevel **)dynarray_get(&mgr->resident, i) == res)
+          evict_at(mgr, i);
+      mgr->prefetch_queue.len = 0;
+    }
+    break;
+  }
+  return mgr->prefetch_queue.len > 0;
+}
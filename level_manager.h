@@ -0,0 +1,97 @@
+/*
+    gmm2json: program that reads Gridmonger's GMM file and converts it into
+   JSON format
+    Copyright (C) 2025 Jagholin (github.com/Jagholin)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see
+   <https://www.gnu.org/licenses/>
+*/
+#ifndef LEVEL_MANAGER_H
+#define LEVEL_MANAGER_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "defs.h"
+#include "dynarray.h"
+#include "gmm_file.h"
+
+// Keeps the levels of a GMM file resident on demand.
+//
+// level_manager_open only indexes the file: it records where every 'lvl '
+// LIST chunk starts and decodes the map links. Levels are decoded when they
+// are entered, and the levels linked to the current one are queued for
+// prefetching. Call level_manager_pump in idle time (between frames) to decode
+// the queue one level at a time, so that moving to a neighbour finds it
+// already resident. Whenever the decoded levels take more than the memory
+// budget, the least recently used ones are evicted. The current level is
+// never evicted, and prefetching never evicts a neighbour of the current
+// level.
+
+// Called with hook_user right after a level has been decoded, and right
+// before a resident level is freed
+typedef void (*LevelHookFn)(void *user, uint16 level_index, GmmLevel *level);
+
+typedef struct LevelSpan {
+  uint32 offset; // file offset of the LIST chunk header
+  uint32 size;   // size of the whole chunk, header included
+} LevelSpan;
+
+typedef struct ResidentLevel {
+  uint16 level_index;
+  Dynarray chunks; // decode result, a single 'lvl ' LIST chunk
+  GmmLevel level;
+  size_t memory; // as of the last budget check, see evict_over_budget
+  uint32 last_used;
+} ResidentLevel;
+
+typedef struct LevelManager {
+  FILE *file;
+  unsigned int decode_flags; // GmmDecodeFlags
+  Dynarray spans;            // LevelSpan for every level, in file order
+  uint16 num_links;
+  MapLinksRecord *links;
+  // Level adjacency from the map links, neighbours of level i are
+  // adj_list[adj_first[i]] .. adj_list[adj_first[i + 1] - 1]
+  uint32 *adj_first;
+  uint16 *adj_list;
+  Dynarray resident;       // ResidentLevel
+  Dynarray prefetch_queue; // uint16 level indices
+  size_t budget;
+  size_t used;
+  uint32 clock;
+  uint16 current;
+  // Either can be NULL
+  LevelHookFn on_loaded;
+  LevelHookFn on_evicting;
+  void *hook_user;
+} LevelManager;
+
+RESULT level_manager_open(LevelManager *mgr, FILE *file, size_t budget,
+                          unsigned int decode_flags);
+void level_manager_close(LevelManager *mgr);
+
+static inline uint16 level_manager_num_levels(const LevelManager *mgr) {
+  return (uint16)mgr->spans.len;
+}
+
+// Makes the level current and returns it, decoding it first if it isn't
+// resident. Queues its neighbours for prefetching. Returns NULL on error.
+GmmLevel *level_manager_enter(LevelManager *mgr, uint16 level_index);
+// Returns the level if it is resident, NULL otherwise
+GmmLevel *level_manager_peek(LevelManager *mgr, uint16 level_index);
+// Decodes at most one queued level. Returns true if there's more work left.
+bool level_manager_pump(LevelManager *mgr);
+
+#endif // LEVEL_MANAGER_H
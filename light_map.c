@@ -0,0 +1,172 @@
+/*
+    gmm2json: program that reads Gridmonger's GMM file and converts it into
+   JSON format
+    Copyright (C) 2025 Jagholin (github.com/Jagholin)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see
+   <https://www.gnu.org/licenses/>
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "light_map.h"
+
+// Can light spread between the cell and its neighbour in the given direction.
+// Must be symmetric, or the removal wave misses light that came in one way.
+static inline bool light_passes(const LevelGrid *grid, uint16 row, uint16 col,
+                                GridDir dir) {
+  int nrow = row + dir_drow[dir], ncol = col + dir_dcol[dir];
+  if (nrow < 0 || ncol < 0 || nrow >= grid->rows || ncol >= grid->cols)
+    return false;
+  return grid_cell_open(grid, row, col) && grid_cell_open(grid, nrow, ncol) &&
+         wall_transparent(grid_edge(grid, row, col, dir));
+}
+
+RESULT light_map_init(LightMap *map, const LevelGrid *grid) {
+  map->grid = *grid;
+  map->num_cells = (uint32)grid->rows * grid->stride;
+  map->light = calloc(map->num_cells, 1);
+  OOMERROR(map->light);
+  map->emit = calloc(map->num_cells, 1);
+  OOMERROR(map->emit);
+  map->queued = calloc(map->num_cells, 1);
+  OOMERROR(map->queued);
+  map->add_queue = malloc(map->num_cells * sizeof(uint32));
+  OOMERROR(map->add_queue);
+  map->remove_queue = malloc(map->num_cells * sizeof(uint32));
+  OOMERROR(map->remove_queue);
+  map->remove_level = malloc(map->num_cells);
+  OOMERROR(map->remove_level);
+  map->add_head = 0;
+  map->add_len = 0;
+  return RES_OK;
+onoom:
+  exit(EXIT_FAILURE);
+}
+
+void light_map_free(LightMap *map) {
+  free(map->light);
+  free(map->emit);
+  free(map->queued);
+  free(map->add_queue);
+  free(map->remove_queue);
+  free(map->remove_level);
+  map->light = map->emit = map->queued = map->remove_level = NULL;
+  map->add_queue = map->remove_queue = NULL;
+}
+
+void light_map_clear(LightMap *map) {
+  memset(map->light, 0, map->num_cells);
+  memset(map->emit, 0, map->num_cells);
+}
+
+static void enqueue_add(LightMap *map, uint32 index) {
+  if (map->queued[index])
+    return;
+  map->queued[index] = 1;
+  map->add_queue[(map->add_head + map->add_len++) % map->num_cells] = index;
+}
+
+// Spreads the light of every queued cell, and its source, to its neighbours
+static void propagate_add(LightMap *map) {
+  const LevelGrid *grid = &map->grid;
+  while (map->add_len > 0) {
+    uint32 cur = map->add_queue[map->add_head];
+    map->add_head = (map->add_head + 1) % map->num_cells;
+    map->add_len--;
+    map->queued[cur] = 0;
+    uint8 level = map->light[cur];
+    if (map->emit[cur] > level)
+      level = map->light[cur] = map->emit[cur];
+    if (level <= 1)
+      continue;
+    uint16 r = cur / grid->stride, c = cur % grid->stride;
+    for (int d = DIR_NORTH; d <= DIR_WEST; ++d) {
+      if (!light_passes(grid, r, c, d))
+        continue;
+      uint32 next = grid_index(grid, r + dir_drow[d], c + dir_dcol[d]);
+      if (map->light[next] >= level - 1)
+        continue;
+      map->light[next] = level - 1;
+      enqueue_add(map, next);
+    }
+  }
+}
+
+// Clears the light that may have come from the seed cell. Brighter cells at
+// the border of the cleared area, and sources inside it, are queued to spread
+// their light back in.
+static void remove_from(LightMap *map, uint32 seed) {
+  const LevelGrid *grid = &map->grid;
+  uint32 head = 0, tail = 0;
+
+  map->remove_queue[tail] = seed;
+  map->remove_level[tail++] = map->light[seed];
+  map->light[seed] = 0;
+  if (map->emit[seed])
+    enqueue_add(map, seed);
+  while (head < tail) {
+    uint32 cur = map->remove_queue[head];
+    uint8 level = map->remove_level[head++];
+    uint16 r = cur / grid->stride, c = cur % grid->stride;
+    for (int d = DIR_NORTH; d <= DIR_WEST; ++d) {
+      if (!light_passes(grid, r, c, d))
+        continue;
+      uint32 next = grid_index(grid, r + dir_drow[d], c + dir_dcol[d]);
+      uint8 next_level = map->light[next];
+      if (next_level == 0)
+        continue;
+      if (next_level < level) {
+        map->light[next] = 0;
+        map->remove_queue[tail] = next;
+        map->remove_level[tail++] = next_level;
+        if (map->emit[next])
+          enqueue_add(map, next);
+      } else {
+        enqueue_add(map, next);
+      }
+    }
+  }
+}
+
+void light_map_set_source(LightMap *map, uint16 row, uint16 col,
+                          uint8 intensity) {
+  uint32 index = grid_index(&map->grid, row, col);
+  uint8 old = map->emit[index];
+  map->emit[index] = intensity;
+  if (intensity < old && map->light[index] == old)
+    remove_from(map, index);
+  else if (intensity > map->light[index])
+    enqueue_add(map, index);
+  propagate_add(map);
+}
+
+void light_map_edge_changed(LightMap *map, uint16 row, uint16 col,
+                            GridDir dir) {
+  const LevelGrid *grid = &map->grid;
+  int nrow = row + dir_drow[dir], ncol = col + dir_dcol[dir];
+  if (nrow < 0 || ncol < 0 || nrow >= grid->rows || ncol >= grid->cols)
+    return;
+  uint32 a = grid_index(grid, row, col), b = grid_index(grid, nrow, ncol);
+  if (wall_transparent(grid_edge(grid, row, col, dir))) {
+    enqueue_add(map, a);
+    enqueue_add(map, b);
+  } else if (map->light[a] > map->light[b]) {
+    // Only the darker side can have been lit through the wall
+    remove_from(map, b);
+  } else if (map->light[b] > map->light[a]) {
+    remove_from(map, a);
+  }
+  propagate_add(map);
+}
@@ -0,0 +1,63 @@
+/*
+    gmm2json: program that reads Gridmonger's GMM file and converts it into
+   JSON format
+    Copyright (C) 2025 Jagholin (github.com/Jagholin)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see
+   <https://www.gnu.org/licenses/>
+*/
+#ifndef LIGHT_MAP_H
+#define LIGHT_MAP_H
+
+#include "defs.h"
+#include "level_grid.h"
+
+// Per-cell light levels of a level. Light loses one level per step and only
+// spreads between non-empty cells, through transparent walls.
+//
+// Changes are applied incrementally: light that depended on a removed source
+// or a closed wall is cleared by a removal wave, then the cells bordering the
+// cleared area, and the sources inside it, spread their light back in.
+typedef struct LightMap {
+  LevelGrid grid;
+  uint8 *light;
+  uint8 *emit;   // intensity of the light source in each cell
+  uint8 *queued; // set while a cell is in add_queue
+  // add_queue is a ring buffer, every cell is in it at most once
+  uint32 *add_queue;
+  uint32 add_head;
+  uint32 add_len;
+  uint32 *remove_queue;
+  uint8 *remove_level;
+  uint32 num_cells;
+} LightMap;
+
+RESULT light_map_init(LightMap *map, const LevelGrid *grid);
+void light_map_free(LightMap *map);
+
+// Removes all light and all sources
+void light_map_clear(LightMap *map);
+// Sets the intensity of the source in a cell, 0 removes it
+void light_map_set_source(LightMap *map, uint16 row, uint16 col,
+                          uint8 intensity);
+// Call after changing the wall on the given side of a cell in the layers
+void light_map_edge_changed(LightMap *map, uint16 row, uint16 col,
+                            GridDir dir);
+
+static inline uint8 light_map_get(const LightMap *map, uint16 row,
+                                  uint16 col) {
+  return map->light[grid_index(&map->grid, row, col)];
+}
+
+#endif // LIGHT_MAP_H
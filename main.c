@@ -1,66 +1,122 @@
+#ifdef __DJGPP__
 #include <crt0.h>
-#include <math.h>
+#endif
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "defs.h"
 // #include "SBLASTER.H"
+#include "mixer.h"
 #include "sb.h"
+#include "synth.h"
 
+#ifdef __DJGPP__
 int _crt0_startup_flags = _CRT0_FLAG_LOCK_MEMORY | _CRT0_FLAG_NONMOVE_SBRK;
+#endif
 
-void stream_test_sound() {
-  static int run_count = 0;
-  // Make up some sound to output with sin waveform
+#define BED_RATE 22050
+#define BED_LENGTH 2205 // a tenth of a second, 22 periods of 220 Hz
+
+// A quiet looping triangle wave for the mixer to play under the effects
+static void make_bed(int8 *samples) {
+  for (uint32 i = 0; i < BED_LENGTH; ++i) {
+    uint32 phase = (i * 22 * 65536 / BED_LENGTH) & 0xFFFF;
+    int32 triangle = phase < 0x8000 ? phase : 0xFFFF - phase;
+    samples[i] = (int8)((triangle >> 8) - 64);
+  }
+}
+
+// Plays the synth presets one after another over the mixer. Returns the
+// number of frames passed to StreamReady.
+size_t stream_test_sound(Mixer *mixer, Synth *synth) {
+  static int effect = 0;
   size_t len;
-  static float x = 0.0;
-  // Special step so that we have a whole cycle count at the end of the buffer
-  // (Assuming buffer is 2048 bytes or multiple)
-  static float x_step = 0.049087385;
   unsigned char *stream = StreamBuf(&len);
   if (stream) {
-    if (run_count > 1) {
-      StreamReady();
-      return;
+    StreamFormat format;
+    StreamGetFormat(&format);
+    size_t frames = len / (format.bits / 8 * format.channels);
+    if (!synth_playing(synth)) {
+      SynthParams params;
+      synth_preset(&params, effect % SYNTH_PRESET_COUNT,
+                   effect / SYNTH_PRESET_COUNT);
+      synth_play(synth, &params);
+      effect++;
+      putchar('*');
+      fflush(stdout);
     }
-    // We are waiting on more bytes to stream
-    for (unsigned char *cursor = stream; cursor != stream + len; cursor++) {
-      *cursor = (unsigned char)(sinf(x) * 100 + 128.0);
-      x += x_step;
+    if (format.bits == 16) {
+      mixer_render_s16(mixer, (int16 *)stream, frames, format.channels);
+      synth_mix_s16(synth, (int16 *)stream, frames, format.channels);
+    } else {
+      mixer_render(mixer, stream, frames);
+      synth_mix_u8(synth, stream, frames);
     }
-    putchar('*');
-    fflush(stdout);
-    run_count++;
     StreamReady();
+    return frames;
   }
+  return 0;
 }
 
-int main() {
+// game [sb | wav:PATH | null | null:realtime [SECONDS]]
+// Without SECONDS the sound plays until a key is pressed.
+int main(int argc, char **argv) {
+  const int rate = 44100; // previously was 22050
+  unsigned long long frames_left = 0;
+  int use_sb;
+  StreamFormat format;
+  Mixer mixer;
+  Synth synth;
+  static int8 bed[BED_LENGTH];
   printf("Welcome to the game.\n");
-  printf("Initializing sound card...\n");
-  RESULT result;
-  if (!sb_init()) {
-    printf("Can't init sound card \n");
+  if (argc > 1 && stream_use(argv[1]) != RES_OK)
     return 1;
+  if (argc > 2)
+    frames_left = strtoull(argv[2], NULL, 10) * rate;
+  use_sb = stream_backend() == &sb_stream_backend;
+  if (use_sb) {
+    printf("Initializing sound card...\n");
+    if (!sb_init()) {
+      printf("Can't init sound card \n");
+      return 1;
+    }
+    short minor, major;
+    sb_dsp_version(&major, &minor);
+    printf("DSP version: %hd.%d\n", major, minor);
   }
-  short minor, major;
-  sb_dsp_version(&major, &minor);
-  printf("DSP version: %hd.%d\n", major, minor);
-  StreamStart(44100); // previously was 22050
-  printf("Initialization successful\nPress any key to exit\n");
+  StreamStart(rate);
+  StreamGetFormat(&format);
+  mixer_init(&mixer, STREAM_CHUNK_FRAMES);
+  make_bed(bed);
+  mixer_play(&mixer, bed, BED_LENGTH, mixer_step(BED_RATE, format.rate),
+             MIXER_VOLUME_MAX / 4, 0, BED_LENGTH);
+  synth_init(&synth, STREAM_CHUNK_FRAMES, format.rate);
+  printf("Initialization successful\n");
+  if (frames_left == 0)
+    printf("Press any key to exit\n");
   // CHECKRESULTP(init_blaster(),
   //              "Initialization failure. Don't you have a sound card?\n");
   for (;;) {
-    stream_test_sound();
-    if (kbhit()) {
+    size_t frames = stream_test_sound(&mixer, &synth);
+    if (frames_left != 0) {
+      if (frames >= frames_left)
+        break;
+      frames_left -= frames;
+    } else if (kbhit()) {
+      getchar();
       break;
     }
   }
-  getchar();
   // ints = get_interrupt_counter();
   // printf("Interrupt counter is %d\n", ints);
 onreturn:
   StreamStop();
-  sb_cleanup();
+  printf("\nSilent blocks: %lu\n", StreamSilentBlocks());
+  if (use_sb)
+    sb_cleanup();
+  synth_free(&synth);
+  mixer_free(&mixer);
 onerror:
   return 0;
 }
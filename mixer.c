@@ -0,0 +1,408 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "mixer.h"
+
+// Polyphase filter: MIXER_FIR_TAPS samples around the position, from
+// MIXER_FIR_LEFT before it, weighted by the row picked by the top bits of
+// the fraction. Rows sum to 1 << 14.
+#define MIXER_FIR_TAPS 8
+#define MIXER_FIR_LEFT 3
+#define MIXER_FIR_PHASE_BITS 6
+#define MIXER_FIR_PHASES (1 << MIXER_FIR_PHASE_BITS)
+#define MIXER_FIR_CUTOFF 0.45 // of the sample rate of the voice
+
+static int16 mixer_fir[MIXER_FIR_PHASES][MIXER_FIR_TAPS];
+static bool mixer_fir_ready = false;
+
+// Blackman windowed sinc
+static void build_fir(void) {
+  const double pi = 3.14159265358979323846;
+  const double half = MIXER_FIR_TAPS / 2;
+  for (int phase = 0; phase < MIXER_FIR_PHASES; ++phase) {
+    double weights[MIXER_FIR_TAPS], sum = 0;
+    for (int k = 0; k < MIXER_FIR_TAPS; ++k) {
+      double d = k - MIXER_FIR_LEFT - (double)phase / MIXER_FIR_PHASES;
+      double x = 2 * MIXER_FIR_CUTOFF * d;
+      double sinc = x == 0 ? 1 : sin(pi * x) / (pi * x);
+      double window =
+          0.42 + 0.5 * cos(pi * d / half) + 0.08 * cos(2 * pi * d / half);
+      weights[k] = sinc * window;
+      sum += weights[k];
+    }
+    int total = 0;
+    for (int k = 0; k < MIXER_FIR_TAPS; ++k) {
+      mixer_fir[phase][k] = (int16)lrint(weights[k] / sum * (1 << 14));
+      total += mixer_fir[phase][k];
+    }
+    // Rounding leftovers go to the tap closest to the position
+    int center = MIXER_FIR_LEFT + (phase >= MIXER_FIR_PHASES / 2);
+    mixer_fir[phase][center] += (1 << 14) - total;
+  }
+  mixer_fir_ready = true;
+}
+
+RESULT mixer_init(Mixer *mixer, uint32 max_frames) {
+  if (!mixer_fir_ready)
+    build_fir();
+  memset(mixer->voices, 0, sizeof(mixer->voices));
+  mixer->max_frames = max_frames;
+  mixer->interp = MIXER_INTERP_LINEAR;
+  mixer->adpcm_cache = NULL;
+  mixer->accum = malloc((max_frames ? max_frames : 1) * sizeof(int32));
+  OOMERROR(mixer->accum);
+  return RES_OK;
+onoom:
+  exit(EXIT_FAILURE);
+}
+
+void mixer_free(Mixer *mixer) {
+  free(mixer->accum);
+  free(mixer->adpcm_cache);
+  mixer->accum = NULL;
+  mixer->adpcm_cache = NULL;
+}
+
+static int play_voice(Mixer *mixer, const int8 *samples,
+                      const AdpcmSound *adpcm, uint32 length, uint32 step,
+                      uint16 volume, uint32 loop_start, uint32 loop_end) {
+  for (int i = 0; i < MIXER_VOICES; ++i) {
+    MixVoice *v = &mixer->voices[i];
+    if (v->active)
+      continue;
+    if (loop_end > length)
+      loop_end = length;
+    if (loop_start >= loop_end)
+      loop_start = MIXER_NO_LOOP;
+    v->samples = samples;
+    v->adpcm = adpcm;
+    v->cache = adpcm != NULL ? mixer->adpcm_cache + i * MIXER_ADPCM_CACHE
+                             : NULL;
+    v->cache_start = 0;
+    v->cache_len = 0;
+    v->length = length;
+    v->loop_start = loop_start;
+    v->loop_end = loop_end;
+    v->pos = 0;
+    v->frac = 0;
+    v->step = step;
+    v->volume = volume > MIXER_VOLUME_MAX ? MIXER_VOLUME_MAX : volume;
+    v->interp = mixer->interp;
+    v->active = length > 0;
+    return v->active ? i : -1;
+  }
+  return -1;
+}
+
+int mixer_play(Mixer *mixer, const int8 *samples, uint32 length, uint32 step,
+               uint16 volume, uint32 loop_start, uint32 loop_end) {
+  return play_voice(mixer, samples, NULL, length, step, volume, loop_start,
+                    loop_end);
+}
+
+int mixer_play_adpcm(Mixer *mixer, const AdpcmSound *sound, uint32 step,
+                     uint16 volume, uint32 loop_start, uint32 loop_end) {
+  if (mixer->adpcm_cache == NULL) {
+    mixer->adpcm_cache = malloc(MIXER_VOICES * MIXER_ADPCM_CACHE);
+    OOMERROR(mixer->adpcm_cache);
+  }
+  return play_voice(mixer, NULL, sound, sound->length, step, volume,
+                    loop_start, loop_end);
+onoom:
+  exit(EXIT_FAILURE);
+}
+
+void mixer_stop(Mixer *mixer, int voice) {
+  if (voice >= 0 && voice < MIXER_VOICES)
+    mixer->voices[voice].active = false;
+}
+
+void mixer_set_interp(Mixer *mixer, int voice, MixInterp interp) {
+  if (voice >= 0 && voice < MIXER_VOICES)
+    mixer->voices[voice].interp = interp;
+}
+
+// Number of output samples before the position moves dist samples ahead.
+// Long distances are cut short, the caller just mixes another run.
+static uint32 frames_until(uint32 dist, uint32 frac, uint32 step) {
+  if (dist > 0x7FFF)
+    dist = 0x7FFF;
+  return ((dist << 16) - frac + step - 1) / step;
+}
+
+// Adds run samples of the voice to accum. The caller makes sure the voice
+// doesn't go past its end within the run, including the samples after the
+// position the interpolation reads.
+static void mix_run_nearest(MixVoice *v, int32 *accum, uint32 run) {
+  const int8 *src = v->samples + v->pos;
+  int32 volume = v->volume;
+  uint32 frac = v->frac, step = v->step, p = 0, i = 0;
+
+#ifdef __SSE2__
+  if (step == 0x10000) {
+    __m128i vol = _mm_set1_epi16((short)volume);
+    for (; i + 8 <= run; i += 8) {
+      __m128i s = _mm_loadl_epi64((const __m128i *)(src + i));
+      // Sign extend to 16 bits, the product of a sample and the volume fits
+      s = _mm_srai_epi16(_mm_unpacklo_epi8(s, s), 8);
+      __m128i prod = _mm_mullo_epi16(s, vol);
+      __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(prod, prod), 16);
+      __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(prod, prod), 16);
+      __m128i *acc = (__m128i *)(accum + i);
+      _mm_storeu_si128(acc, _mm_add_epi32(_mm_loadu_si128(acc), lo));
+      _mm_storeu_si128(acc + 1, _mm_add_epi32(_mm_loadu_si128(acc + 1), hi));
+    }
+    p = i;
+  }
+#endif
+  for (; i < run; ++i) {
+    accum[i] += src[p] * volume;
+    frac += step;
+    p += frac >> 16;
+    frac &= 0xFFFF;
+  }
+  v->pos += p;
+  v->frac = frac;
+}
+
+// The interpolated samples are 8.8 fixed point, scaled back after the volume
+static void mix_run_linear(MixVoice *v, int32 *accum, uint32 run) {
+  const int8 *src = v->samples + v->pos;
+  int32 volume = v->volume;
+  uint32 frac = v->frac, step = v->step, p = 0;
+  for (uint32 i = 0; i < run; ++i) {
+    int32 a = src[p], b = src[p + 1];
+    int32 s = a * 256 + (b - a) * (int32)(frac >> 8);
+    accum[i] += (s * volume) >> 8;
+    frac += step;
+    p += frac >> 16;
+    frac &= 0xFFFF;
+  }
+  v->pos += p;
+  v->frac = frac;
+}
+
+static void mix_run_polyphase(MixVoice *v, int32 *accum, uint32 run) {
+  const int8 *src = v->samples + v->pos - MIXER_FIR_LEFT;
+  int32 volume = v->volume;
+  uint32 frac = v->frac, step = v->step, p = 0;
+  for (uint32 i = 0; i < run; ++i) {
+    const int16 *c = mixer_fir[frac >> (16 - MIXER_FIR_PHASE_BITS)];
+    const int8 *x = src + p;
+    int32 s = x[0] * c[0] + x[1] * c[1] + x[2] * c[2] + x[3] * c[3] +
+              x[4] * c[4] + x[5] * c[5] + x[6] * c[6] + x[7] * c[7];
+    accum[i] += ((s >> 6) * volume) >> 8;
+    frac += step;
+    p += frac >> 16;
+    frac &= 0xFFFF;
+  }
+  v->pos += p;
+  v->frac = frac;
+}
+
+static void mix_run(MixVoice *v, int32 *accum, uint32 run) {
+  if (v->interp == MIXER_INTERP_NEAREST ||
+      ((v->step & 0xFFFF) == 0 && v->frac == 0))
+    mix_run_nearest(v, accum, run);
+  else if (v->interp == MIXER_INTERP_LINEAR)
+    mix_run_linear(v, accum, run);
+  else
+    mix_run_polyphase(v, accum, run);
+}
+
+// Samples the interpolation of a voice reads before and after its position
+static uint32 taps_before(const MixVoice *v) {
+  return v->interp == MIXER_INTERP_POLYPHASE ? MIXER_FIR_LEFT : 0;
+}
+
+static uint32 taps_after(const MixVoice *v) {
+  if (v->interp == MIXER_INTERP_POLYPHASE)
+    return MIXER_FIR_TAPS - MIXER_FIR_LEFT - 1;
+  return v->interp == MIXER_INTERP_LINEAR;
+}
+
+static int8 voice_sample(const MixVoice *v, uint32 index) {
+  if (v->adpcm == NULL)
+    return v->samples[index];
+  if (index - v->cache_start < v->cache_len)
+    return v->cache[index - v->cache_start];
+  return (int8)(adpcm_sample_at(v->adpcm, index) >> 8);
+}
+
+// Silence before the start and after the end, the loop after the loop end
+static int8 sample_at(const MixVoice *v, int32 index, uint32 end) {
+  if (index < 0)
+    return 0;
+  if ((uint32)index < end)
+    return voice_sample(v, index);
+  if (v->loop_start == MIXER_NO_LOOP)
+    return 0;
+  return voice_sample(v, v->loop_start +
+                             ((uint32)index - end) % (end - v->loop_start));
+}
+
+// Decodes the block holding the first tap of the position and the one after
+// it. The taps of a position reach less than a block either way, so they are
+// all in the cache afterwards. Playing on into the second block keeps it and
+// only decodes the next one.
+static void fill_cache(MixVoice *v, uint32 before) {
+  uint32 block = (v->pos - before) / ADPCM_BLOCK_SAMPLES;
+  uint32 start = block * ADPCM_BLOCK_SAMPLES, k = 0;
+  if (v->cache_len > ADPCM_BLOCK_SAMPLES &&
+      start == v->cache_start + ADPCM_BLOCK_SAMPLES) {
+    v->cache_len -= ADPCM_BLOCK_SAMPLES;
+    memmove(v->cache, v->cache + ADPCM_BLOCK_SAMPLES, v->cache_len);
+    k = 1;
+  } else {
+    v->cache_len = 0;
+  }
+  v->cache_start = start;
+  for (; k < 2 && start + v->cache_len < v->length; ++k) {
+    uint32 count = v->length - start - v->cache_len;
+    if (count > ADPCM_BLOCK_SAMPLES)
+      count = ADPCM_BLOCK_SAMPLES;
+    adpcm_decode_block8(v->adpcm->data + (block + k) * ADPCM_BLOCK_BYTES,
+                        v->cache + v->cache_len, count);
+    v->cache_len += count;
+  }
+}
+
+// Mixes a run of an ADPCM voice from its cache
+static void mix_cached(MixVoice *v, int32 *accum, uint32 run) {
+  MixVoice cached = *v;
+  cached.samples = v->cache;
+  cached.pos = v->pos - v->cache_start;
+  mix_run(&cached, accum, run);
+  v->pos = cached.pos + v->cache_start;
+  v->frac = cached.frac;
+}
+
+// Mixes one sample whose taps reach past the start or the end, from a copy
+// of them
+static void mix_edge(MixVoice *v, int32 *accum, uint32 end) {
+  int8 window[MIXER_FIR_TAPS];
+  for (int k = 0; k < MIXER_FIR_TAPS; ++k)
+    window[k] = sample_at(v, (int32)v->pos - MIXER_FIR_LEFT + k, end);
+  MixVoice edge = *v;
+  edge.samples = window + MIXER_FIR_LEFT;
+  edge.pos = 0;
+  mix_run(&edge, accum, 1);
+  v->pos += edge.pos;
+  v->frac = edge.frac;
+}
+
+static void mix_voice(MixVoice *v, int32 *accum, uint32 frames) {
+  uint32 before = taps_before(v), after = taps_after(v);
+  uint32 done = 0;
+  while (done < frames) {
+    bool looped = v->loop_start != MIXER_NO_LOOP;
+    uint32 end = looped ? v->loop_end : v->length;
+    if (v->pos >= end) {
+      if (!looped) {
+        v->active = false;
+        return;
+      }
+      v->pos = v->loop_start + (v->pos - end) % (end - v->loop_start);
+      continue;
+    }
+    if (v->pos < before || v->pos + after >= end) {
+      mix_edge(v, accum + done, end);
+      done++;
+      continue;
+    }
+    uint32 run = frames - done, limit = end - after;
+    if (v->adpcm != NULL) {
+      if (v->pos - before < v->cache_start ||
+          v->pos + after >= v->cache_start + v->cache_len)
+        fill_cache(v, before);
+      if (limit > v->cache_start + v->cache_len - after)
+        limit = v->cache_start + v->cache_len - after;
+    }
+    if (v->step != 0) {
+      uint32 left = frames_until(limit - v->pos, v->frac, v->step);
+      if (left < run)
+        run = left;
+    }
+    if (v->adpcm != NULL)
+      mix_cached(v, accum + done, run);
+    else
+      mix_run(v, accum + done, run);
+    done += run;
+  }
+}
+
+// Sums all active voices into accum, returns the number of frames mixed
+static uint32 mix_all(Mixer *mixer, uint32 frames) {
+  if (frames > mixer->max_frames)
+    frames = mixer->max_frames;
+  memset(mixer->accum, 0, frames * sizeof(int32));
+  for (int i = 0; i < MIXER_VOICES; ++i)
+    if (mixer->voices[i].active)
+      mix_voice(&mixer->voices[i], mixer->accum, frames);
+  return frames;
+}
+
+void mixer_render(Mixer *mixer, uint8 *out, uint32 frames) {
+  int32 *accum = mixer->accum;
+  frames = mix_all(mixer, frames);
+
+  uint32 i = 0;
+#ifdef __SSE2__
+  // Both packs saturate, flipping the sign bit turns int8 into biased uint8
+  __m128i bias = _mm_set1_epi8((char)0x80);
+  for (; i + 16 <= frames; i += 16) {
+    const __m128i *acc = (const __m128i *)(accum + i);
+    __m128i a = _mm_srai_epi32(_mm_loadu_si128(acc), 8);
+    __m128i b = _mm_srai_epi32(_mm_loadu_si128(acc + 1), 8);
+    __m128i c = _mm_srai_epi32(_mm_loadu_si128(acc + 2), 8);
+    __m128i d = _mm_srai_epi32(_mm_loadu_si128(acc + 3), 8);
+    __m128i s = _mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+    _mm_storeu_si128((__m128i *)(out + i), _mm_xor_si128(s, bias));
+  }
+#endif
+  for (; i < frames; ++i) {
+    int32 s = accum[i] >> 8;
+    if (s > 127)
+      s = 127;
+    else if (s < -128)
+      s = -128;
+    out[i] = (uint8)(s + 128);
+  }
+}
+
+void mixer_render_s16(Mixer *mixer, int16 *out, uint32 frames,
+                      int channels) {
+  int32 *accum = mixer->accum;
+  frames = mix_all(mixer, frames);
+
+  uint32 i = 0;
+#ifdef __SSE2__
+  if (channels == 1)
+    for (; i + 8 <= frames; i += 8) {
+      const __m128i *acc = (const __m128i *)(accum + i);
+      __m128i s = _mm_packs_epi32(_mm_loadu_si128(acc),
+                                  _mm_loadu_si128(acc + 1));
+      _mm_storeu_si128((__m128i *)(out + i), s);
+    }
+#endif
+  for (; i < frames; ++i) {
+    int32 s = accum[i];
+    if (s > 32767)
+      s = 32767;
+    else if (s < -32768)
+      s = -32768;
+    for (int c = 0; c < channels; ++c)
+      out[i * channels + c] = (int16)s;
+  }
+}
+
+void mixer_convert_u8(int8 *samples, uint32 length) {
+  uint8 *bytes = (uint8 *)samples;
+  for (uint32 i = 0; i < length; ++i)
+    bytes[i] ^= 0x80;
+}
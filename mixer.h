@@ -0,0 +1,95 @@
+#ifndef MIXER_H
+#define MIXER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "adpcm.h"
+#include "defs.h"
+
+// Software mixer for the sound stream.
+//
+// Voices play signed 8-bit samples at a 16.16 fixed-point step per output
+// sample, so a sample recorded at rate r plays at its pitch with
+// mixer_step(r, output rate). The step is taken on the fly, so 11025 and
+// 22050 Hz sounds stay that small in memory; between samples the voice picks
+// the nearest one, interpolates linearly or runs an 8 tap polyphase filter.
+// Every mode does the same work for each output sample whatever the step,
+// and integer steps skip the interpolation. All voices are summed into
+// 32-bit integers and then saturated to the unsigned 8-bit or signed 16-bit
+// format the stream plays. The inner loops only use integer math, the host
+// build adds an SSE2 path.
+//
+// IMA ADPCM sounds take a quarter of the memory of 16-bit ones and half of
+// 8-bit ones. Their voices decode two blocks at a time into a cache of their
+// own and mix from there like any other voice, so the extra work is one
+// decode per sample played and the memory is MIXER_ADPCM_CACHE per voice.
+
+#define MIXER_VOICES 32
+#define MIXER_VOLUME_MAX 256
+#define MIXER_NO_LOOP 0xFFFFFFFFu
+#define MIXER_ADPCM_CACHE (2 * ADPCM_BLOCK_SAMPLES)
+
+typedef enum MixInterp {
+  MIXER_INTERP_NEAREST,
+  MIXER_INTERP_LINEAR,
+  // Windowed sinc with 64 phases, for sounds played at or above their rate
+  MIXER_INTERP_POLYPHASE,
+} MixInterp;
+
+typedef struct MixVoice {
+  const int8 *samples;
+  const AdpcmSound *adpcm; // played instead of samples if set
+  int8 *cache;             // adpcm samples from cache_start on
+  uint32 cache_start;
+  uint32 cache_len;
+  uint32 length;     // samples
+  uint32 loop_start; // MIXER_NO_LOOP to stop at the end
+  uint32 loop_end;   // one past the last looped sample
+  uint32 pos;        // integer part of the position
+  uint32 frac;       // fraction of the position, below 0x10000
+  uint32 step;       // 16.16
+  uint16 volume;     // 0 .. MIXER_VOLUME_MAX
+  uint8 interp;      // MixInterp
+  bool active;
+} MixVoice;
+
+typedef struct Mixer {
+  MixVoice voices[MIXER_VOICES];
+  int32 *accum;
+  int8 *adpcm_cache; // MIXER_ADPCM_CACHE for each voice, once one is played
+  uint32 max_frames;
+  uint8 interp; // given to voices by mixer_play, linear after mixer_init
+} Mixer;
+
+// max_frames is the longest buffer mixer_render will be asked for
+RESULT mixer_init(Mixer *mixer, uint32 max_frames);
+void mixer_free(Mixer *mixer);
+
+// output_rate must be below 65536
+static inline uint32 mixer_step(uint32 sample_rate, uint32 output_rate) {
+  return ((sample_rate / output_rate) << 16) +
+         ((sample_rate % output_rate) << 16) / output_rate;
+}
+
+// Starts a voice, returns its index or -1 if all voices are busy. Pass
+// MIXER_NO_LOOP as loop_start for one-shot sounds.
+int mixer_play(Mixer *mixer, const int8 *samples, uint32 length, uint32 step,
+               uint16 volume, uint32 loop_start, uint32 loop_end);
+// Same for an ADPCM sound, the step comes from mixer_step(sound->rate, ...)
+int mixer_play_adpcm(Mixer *mixer, const AdpcmSound *sound, uint32 step,
+                     uint16 volume, uint32 loop_start, uint32 loop_end);
+void mixer_stop(Mixer *mixer, int voice);
+void mixer_set_interp(Mixer *mixer, int voice, MixInterp interp);
+
+// Mixes frames samples of all active voices into out, as unsigned 8-bit
+void mixer_render(Mixer *mixer, uint8 *out, uint32 frames);
+
+// Same, as signed 16-bit samples repeated on every channel
+void mixer_render_s16(Mixer *mixer, int16 *out, uint32 frames,
+                      int channels);
+
+// Turns unsigned 8-bit samples (as in WAV and VOC files) into signed ones
+void mixer_convert_u8(int8 *samples, uint32 length);
+
+#endif // MIXER_H
@@ -0,0 +1,371 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "mixer.h"
+#include "music.h"
+
+typedef PACKED_STRUCT MusicChunkHeader {
+  char id[4];
+  uint32 size;
+}
+MusicChunkHeader;
+
+typedef PACKED_STRUCT WavFmt {
+  uint16 format_tag; // 1 for PCM
+  uint16 channels;
+  uint32 rate;
+  uint32 byte_rate;
+  uint16 block_align;
+  uint16 bits;
+}
+WavFmt;
+
+static const char voc_magic[] = "Creative Voice File\x1A";
+
+typedef PACKED_STRUCT VocFileHeader {
+  char magic[20];
+  uint16 data_offset;
+  uint16 version;
+  uint16 checksum;
+}
+VocFileHeader;
+
+// Block 9, followed by the samples
+typedef PACKED_STRUCT VocSoundInfo {
+  uint32 rate;
+  uint8 bits;
+  uint8 channels;
+  uint16 codec; // 0 for 8-bit unsigned, 4 for 16-bit signed PCM
+  uint32 reserved;
+}
+VocSoundInfo;
+
+static RESULT wav_open(MusicStream *music) {
+  FILE *f = music->file;
+  MusicChunkHeader chunk;
+  char wave[4];
+  bool have_fmt = false;
+  CHECKERR(fread(&chunk, sizeof(chunk), 1, f) != 1 ||
+               fread(wave, sizeof(wave), 1, f) != 1 ||
+               memcmp(wave, "WAVE", 4) != 0,
+           "Not a WAV file\n");
+  for (;;) {
+    CHECKERR(fread(&chunk, sizeof(chunk), 1, f) != 1, "WAV file has no data\n");
+    if (memcmp(chunk.id, "fmt ", 4) == 0) {
+      WavFmt fmt;
+      CHECKERR(chunk.size < sizeof(fmt) || fread(&fmt, sizeof(fmt), 1, f) != 1,
+               "Bad WAV format chunk\n");
+      CHECKERR(fmt.format_tag != 1 || (fmt.bits != 8 && fmt.bits != 16) ||
+                   fmt.channels < 1 || fmt.channels > 2 || fmt.rate == 0 ||
+                   fmt.rate > 65535,
+               "Unsupported WAV format\n");
+      music->channels = music->block_channels = fmt.channels;
+      music->rate = music->block_rate = fmt.rate;
+      music->block_bits = fmt.bits;
+      have_fmt = true;
+      chunk.size -= sizeof(fmt);
+    } else if (memcmp(chunk.id, "data", 4) == 0) {
+      CHECKERR(!have_fmt || chunk.size == 0, "WAV file has no data\n");
+      music->data_start = ftell(f);
+      music->data_size = music->block_left = chunk.size;
+      return RES_OK;
+    }
+    CHECKERR(fseek(f, chunk.size + (chunk.size & 1), SEEK_CUR) != 0,
+             "Truncated WAV file\n");
+  }
+onerror:
+  return RES_ERR;
+}
+
+// Reads block headers up to the next samples or silence. Blocks that don't
+// play anything are skipped, the end of the file sets at_end.
+static RESULT voc_next_block(MusicStream *music) {
+  FILE *f = music->file;
+  for (;;) {
+    uint8 head[4];
+    if (fread(head, 1, 1, f) != 1 || head[0] == 0) {
+      music->at_end = true;
+      return RES_OK;
+    }
+    CHECKERR(fread(head + 1, 3, 1, f) != 1, "Truncated VOC file\n");
+    uint32 size = head[1] | head[2] << 8 | (uint32)head[3] << 16;
+    switch (head[0]) {
+    case 1: {
+      uint8 info[2]; // time constant, codec
+      CHECKERR(size < 2 || fread(info, 2, 1, f) != 1, "Bad VOC block\n");
+      CHECKERR(info[1] != 0, "Packed VOC samples aren't supported\n");
+      music->block_bits = 8;
+      if (music->voc_ext_channels) {
+        music->block_channels = music->voc_ext_channels;
+        music->block_rate = music->voc_ext_rate;
+        music->voc_ext_channels = 0;
+      } else {
+        music->block_channels = 1;
+        music->block_rate = 1000000 / (256 - info[0]);
+      }
+      music->block_left = size - 2;
+      return RES_OK;
+    }
+    case 2:
+      CHECKERR(music->block_bits == 0, "VOC data before its format\n");
+      music->block_left = size;
+      return RES_OK;
+    case 3: {
+      uint8 info[3]; // length - 1, time constant
+      CHECKERR(size < 3 || fread(info, 3, 1, f) != 1, "Bad VOC block\n");
+      music->silence_left = (info[0] | info[1] << 8) + 1u;
+      CHECKERR(fseek(f, size - 3, SEEK_CUR) != 0, "Truncated VOC file\n");
+      return RES_OK;
+    }
+    case 8: {
+      uint8 info[4]; // time constant (16 bits), codec, stereo
+      CHECKERR(size < 4 || fread(info, 4, 1, f) != 1, "Bad VOC block\n");
+      CHECKERR(info[2] != 0, "Packed VOC samples aren't supported\n");
+      music->voc_ext_channels = info[3] ? 2 : 1;
+      music->voc_ext_rate = 256000000u / (65536u - (info[0] | info[1] << 8)) /
+                            music->voc_ext_channels;
+      size -= 4;
+      break;
+    }
+    case 9: {
+      VocSoundInfo info;
+      CHECKERR(size < sizeof(info) || fread(&info, sizeof(info), 1, f) != 1,
+               "Bad VOC block\n");
+      CHECKERR(!(info.codec == 0 && info.bits == 8) &&
+                   !(info.codec == 4 && info.bits == 16),
+               "Unsupported VOC codec %u\n", info.codec);
+      CHECKERR(info.channels < 1 || info.channels > 2 || info.rate == 0 ||
+                   info.rate > 65535,
+               "Unsupported VOC format\n");
+      music->block_bits = info.bits;
+      music->block_channels = info.channels;
+      music->block_rate = info.rate;
+      music->block_left = size - sizeof(info);
+      return RES_OK;
+    }
+    }
+    CHECKERR(fseek(f, size, SEEK_CUR) != 0, "Truncated VOC file\n");
+  }
+onerror:
+  return RES_ERR;
+}
+
+// Takes the rate and channels from the first sound block, then goes back
+static RESULT voc_open(MusicStream *music) {
+  VocFileHeader header;
+  CHECKERR(fread(&header, sizeof(header), 1, music->file) != 1 ||
+               memcmp(header.magic, voc_magic, sizeof(header.magic)) != 0,
+           "Not a VOC file\n");
+  music->voc = true;
+  music->data_start = header.data_offset;
+  CHECKERR(fseek(music->file, music->data_start, SEEK_SET) != 0,
+           "Truncated VOC file\n");
+  while (music->block_left == 0) {
+    music->silence_left = 0;
+    CHECKERR(voc_next_block(music) != RES_OK, "Can't read the VOC file\n");
+    CHECKERR(music->at_end, "VOC file has no samples\n");
+  }
+  music->channels = music->block_channels;
+  music->rate = music->block_rate;
+  CHECKERR(fseek(music->file, music->data_start, SEEK_SET) != 0,
+           "Truncated VOC file\n");
+  music->block_left = 0;
+  music->block_bits = 0;
+  return RES_OK;
+onerror:
+  return RES_ERR;
+}
+
+RESULT music_open(MusicStream *music, const char *path, bool loop) {
+  char magic[4];
+  memset(music, 0, sizeof(*music));
+  music->loop = loop;
+  music->volume = 256;
+  music->file = fopen(path, "rb");
+  CHECKERR(music->file == NULL, "Can't open %s\n", path);
+  CHECKERR(fread(magic, sizeof(magic), 1, music->file) != 1,
+           "%s is too short\n", path);
+  rewind(music->file);
+  if (memcmp(magic, "RIFF", 4) == 0) {
+    CHECKERR(wav_open(music) != RES_OK, "Can't play %s\n", path);
+  } else {
+    CHECKERR(voc_open(music) != RES_OK, "Can't play %s\n", path);
+  }
+
+  // A power of two, frames are 2 or 4 bytes
+  music->ring_frames = MUSIC_RING_BYTES / (sizeof(int16) * music->channels);
+  music->ring = malloc(MUSIC_RING_BYTES + MUSIC_READ_BYTES);
+  OOMERROR(music->ring);
+  music->staging = (uint8 *)music->ring + MUSIC_RING_BYTES;
+  return RES_OK;
+onerror:
+  if (music->file != NULL)
+    fclose(music->file);
+  music->file = NULL;
+  return RES_ERR;
+onoom:
+  exit(EXIT_FAILURE);
+}
+
+void music_close(MusicStream *music) {
+  if (music->file != NULL)
+    fclose(music->file);
+  free(music->ring);
+  music->file = NULL;
+  music->ring = NULL;
+  music->staging = NULL;
+  music->head = music->tail = 0;
+  music->at_end = true;
+}
+
+bool music_finished(const MusicStream *music) {
+  return music->at_end && music->head == music->tail;
+}
+
+// Starts over for loop, unless the last pass didn't play anything
+static void music_end_of_data(MusicStream *music) {
+  if (!music->loop || music->head == music->loop_head ||
+      fseek(music->file, music->data_start, SEEK_SET) != 0) {
+    music->at_end = true;
+    return;
+  }
+  music->loop_head = music->head;
+  music->block_left = music->voc ? 0 : music->data_size;
+  music->silence_left = 0;
+  music->voc_ext_channels = 0;
+}
+
+// Converts frames from the staging buffer into the ring
+static void music_put(MusicStream *music, uint32 frames) {
+  const uint8 *src = music->staging;
+  for (uint32 i = 0; i < frames; ++i) {
+    int16 s[2];
+    for (int c = 0; c < music->block_channels; ++c) {
+      if (music->block_bits == 8) {
+        s[c] = (int16)((src[0] - 128) * 256);
+        src++;
+      } else {
+        s[c] = (int16)(src[0] | src[1] << 8);
+        src += 2;
+      }
+    }
+    int16 *dst = &music->ring[(music->head & (music->ring_frames - 1)) *
+                              music->channels];
+    if (music->channels == 1)
+      dst[0] = music->block_channels == 1 ? s[0] : (s[0] + s[1]) / 2;
+    else {
+      dst[0] = s[0];
+      dst[1] = music->block_channels == 1 ? s[0] : s[1];
+    }
+    music->head++;
+  }
+}
+
+void music_fill(MusicStream *music) {
+  while (!music->at_end) {
+    uint32 free_frames = music->ring_frames - (music->head - music->tail);
+    if (music->silence_left) {
+      uint32 n = music->silence_left < free_frames ? music->silence_left
+                                                   : free_frames;
+      if (n == 0)
+        return;
+      for (uint32 i = 0; i < n; ++i) {
+        int16 *dst = &music->ring[(music->head & (music->ring_frames - 1)) *
+                                  music->channels];
+        dst[0] = dst[music->channels - 1] = 0;
+        music->head++;
+      }
+      music->silence_left -= n;
+      continue;
+    }
+    if (music->block_left == 0) {
+      if (!music->voc) {
+        music_end_of_data(music);
+      } else if (voc_next_block(music) != RES_OK) {
+        music->at_end = true;
+      } else if (music->at_end) {
+        music->at_end = false;
+        music_end_of_data(music);
+      }
+      continue;
+    }
+
+    uint32 frame_bytes = music->block_bits / 8 * music->block_channels;
+    uint32 bytes = music->block_left < MUSIC_READ_BYTES ? music->block_left
+                                                        : MUSIC_READ_BYTES;
+    bytes -= bytes % frame_bytes;
+    if (bytes == 0) { // half a frame at the end of the block
+      fseek(music->file, music->block_left, SEEK_CUR);
+      music->block_left = 0;
+      continue;
+    }
+    if (free_frames < bytes / frame_bytes)
+      return; // wait until the whole block fits
+    size_t got = fread(music->staging, 1, bytes, music->file);
+    music_put(music, (uint32)(got / frame_bytes));
+    if (got < bytes) { // truncated file
+      music->block_left = 0;
+      music_end_of_data(music);
+      continue;
+    }
+    music->block_left -= bytes;
+  }
+}
+
+// Linear interpolation between the frame at tail and the next one, as far as
+// they are in the ring. Returns false if there is nothing to play.
+static bool music_next(MusicStream *music, uint32 step, int32 *left,
+                       int32 *right) {
+  uint32 avail = music->head - music->tail;
+  if (avail == 0 || (avail == 1 && !music->at_end)) {
+    if (!music_finished(music))
+      music->underruns++;
+    return false;
+  }
+  uint32 mask = music->ring_frames - 1;
+  int channels = music->channels;
+  const int16 *a = &music->ring[(music->tail & mask) * channels];
+  const int16 *b =
+      avail > 1 ? &music->ring[((music->tail + 1) & mask) * channels] : a;
+  int32 t = (int32)(music->frac >> 2); // 14 bits, keeps the product in range
+  *left = a[0] + (((b[0] - a[0]) * t) >> 14);
+  *right = a[channels - 1] + (((b[channels - 1] - a[channels - 1]) * t) >> 14);
+
+  music->frac += step;
+  uint32 advance = music->frac >> 16;
+  music->frac &= 0xFFFF;
+  music->tail += advance < avail ? advance : avail;
+  return true;
+}
+
+void music_mix_s16(MusicStream *music, int16 *out, uint32 frames,
+                   int channels, unsigned int output_rate) {
+  uint32 step = mixer_step(music->rate, output_rate);
+  int32 volume = music->volume;
+  for (uint32 i = 0; i < frames; ++i, out += channels) {
+    int32 left, right;
+    if (!music_next(music, step, &left, &right))
+      continue;
+    left = left * volume >> 8;
+    right = right * volume >> 8;
+    if (channels == 1)
+      left = right = (left + right) / 2;
+    for (int c = 0; c < channels; ++c) {
+      int32 s = out[c] + (c == 0 ? left : right);
+      out[c] = (int16)(s > 32767 ? 32767 : s < -32768 ? -32768 : s);
+    }
+  }
+}
+
+void music_mix_u8(MusicStream *music, uint8 *out, uint32 frames,
+                  unsigned int output_rate) {
+  uint32 step = mixer_step(music->rate, output_rate);
+  int32 volume = music->volume;
+  for (uint32 i = 0; i < frames; ++i) {
+    int32 left, right;
+    if (!music_next(music, step, &left, &right))
+      continue;
+    int32 s = out[i] - 128 + (((left + right) / 2 * volume) >> 16);
+    out[i] = (uint8)((s > 127 ? 127 : s < -128 ? -128 : s) + 128);
+  }
+}
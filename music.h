@@ -0,0 +1,68 @@
+#ifndef MUSIC_H
+#define MUSIC_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "defs.h"
+
+// Background music streamed from a WAV or Creative VOC file.
+//
+// music_fill reads the file in MUSIC_READ_BYTES blocks into a ring of 16-bit
+// frames, call it between frames or whenever there is time to spare. The
+// music_mix functions only take frames out of the ring and add them to a
+// stream buffer, resampled to the output rate. They never touch the file, so
+// neither the main loop nor the interrupt waits for the disk. If the ring
+// runs dry the missing frames are silent and counted in underruns.
+//
+// WAV files hold 8 or 16-bit PCM. VOC files may use blocks 1 and 8 (8-bit),
+// 9 (8 or 16-bit PCM), 2 (more data), 3 (silence) and 0 (end). The first
+// sound block sets the rate and channels of the whole file.
+
+#define MUSIC_RING_BYTES 32768
+#define MUSIC_READ_BYTES 4096
+
+typedef struct MusicStream {
+  FILE *file;
+  bool voc;
+  bool loop;
+  bool at_end;   // nothing more to read
+  uint16 volume; // 0 .. 256, 256 after music_open
+  int channels;
+  unsigned int rate;
+  long data_start;  // file offset of the data chunk, or of the first block
+  uint32 data_size; // of the WAV data chunk
+  // Current chunk or VOC block
+  int block_bits;
+  int block_channels;
+  unsigned int block_rate;
+  uint32 block_left;   // bytes of samples
+  uint32 silence_left; // frames of a VOC silence block
+  int voc_ext_channels; // from a block 8, for the block 1 after it
+  unsigned int voc_ext_rate;
+  // Ring of int16 frames, head and tail count frames
+  int16 *ring;
+  uint32 ring_frames;
+  uint32 head, tail;
+  uint32 loop_head; // head when the file was last started over
+  uint8 *staging;   // MUSIC_READ_BYTES of raw file data
+  uint32 frac;      // 16.16 position between frame tail and the next
+  unsigned long underruns; // output frames mixed while the ring was empty
+} MusicStream;
+
+RESULT music_open(MusicStream *music, const char *path, bool loop);
+void music_close(MusicStream *music);
+
+// Reads blocks while a whole one fits in the ring
+void music_fill(MusicStream *music);
+// Everything has been played, never true for looped music
+bool music_finished(const MusicStream *music);
+
+// Add frames at output_rate to signed 16-bit or unsigned 8-bit mono samples,
+// saturating
+void music_mix_s16(MusicStream *music, int16 *out, uint32 frames,
+                   int channels, unsigned int output_rate);
+void music_mix_u8(MusicStream *music, uint8 *out, uint32 frames,
+                  unsigned int output_rate);
+
+#endif // MUSIC_H
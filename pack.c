@@ -0,0 +1,173 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(__DJGPP__) && defined(__unix__)
+#define PACK_USE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "defs.h"
+#include "pack.h"
+
+// Lower case and '/' for '\\', as names are compared and hashed
+static uint8 fold_name_char(char c) {
+  if (c >= 'A' && c <= 'Z')
+    c += 'a' - 'A';
+  else if (c == '\\')
+    c = '/';
+  return (uint8)c;
+}
+
+uint32 pack_hash_name(const char *name) {
+  uint32 hash = 2166136261u;
+  for (; *name != '\0'; ++name) {
+    hash ^= fold_name_char(*name);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+int pack_compare_names(const char *a, const char *b) {
+  for (;; ++a, ++b) {
+    uint8 x = fold_name_char(*a), y = fold_name_char(*b);
+    if (x != y)
+      return x < y ? -1 : 1;
+    if (x == '\0')
+      return 0;
+  }
+}
+
+RESULT pack_open(AssetPack *pack, const char *path) {
+  PackHeader header;
+  memset(pack, 0, sizeof(AssetPack));
+  pack->file = fopen(path, "rb");
+  CHECKERR(pack->file == NULL, "Can't open asset pack %s\n", path);
+  CHECKERR(fread(&header, sizeof(header), 1, pack->file) != 1,
+           "Can't read the header of asset pack %s\n", path);
+  CHECKERR(strncmp(header.magic, PACK_MAGIC, 4) != 0 ||
+               header.version != PACK_VERSION,
+           "%s is not an asset pack\n", path);
+
+  // The header comes from the file too, so the table of contents has to fit
+  // in it before anything is allocated
+  long file_end;
+  CHECKERR(fseek(pack->file, 0, SEEK_END) != 0 ||
+               (file_end = ftell(pack->file)) < (long)sizeof(header) ||
+               fseek(pack->file, sizeof(header), SEEK_SET) != 0,
+           "Can't get the size of asset pack %s\n", path);
+  uint32 file_size = (uint32)file_end;
+  uint32 space = file_size - sizeof(header);
+  CHECKERR(header.num_entries > space / sizeof(PackEntry) ||
+               header.names_size >
+                   space - sizeof(PackEntry) * header.num_entries,
+           "The table of contents of %s is larger than the file\n", path);
+
+  // TOC and names are read with one read as well
+  size_t toc_size = sizeof(PackEntry) * header.num_entries;
+  pack->entries = malloc(toc_size + header.names_size + 1);
+  OOMERROR(pack->entries);
+  CHECKERR(fread(pack->entries, 1, toc_size + header.names_size, pack->file) !=
+               toc_size + header.names_size,
+           "Can't read the table of contents of %s\n", path);
+  pack->num_entries = header.num_entries;
+  pack->names = (char *)pack->entries + toc_size;
+  pack->names[header.names_size] = '\0';
+  for (uint32 i = 0; i < header.num_entries; ++i) {
+    const PackEntry *entry = &pack->entries[i];
+    CHECKERR(entry->name_offset >= header.names_size ||
+                 entry->size > file_size ||
+                 entry->offset > file_size - entry->size,
+             "Entry %u of asset pack %s is out of bounds\n", i, path);
+  }
+
+#ifdef PACK_USE_MMAP
+  struct stat st;
+  if (fstat(fileno(pack->file), &st) == 0 && st.st_size > 0) {
+    void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+                         fileno(pack->file), 0);
+    if (mapping != MAP_FAILED) {
+      pack->mapping = mapping;
+      pack->mapping_size = st.st_size;
+    }
+  }
+#endif
+  return RES_OK;
+onerror:
+  pack_close(pack);
+  return RES_ERR;
+onoom:
+  exit(EXIT_FAILURE);
+}
+
+void pack_close(AssetPack *pack) {
+#ifdef PACK_USE_MMAP
+  if (pack->mapping)
+    munmap((void *)pack->mapping, pack->mapping_size);
+#endif
+  if (pack->file)
+    fclose(pack->file);
+  free(pack->entries);
+  memset(pack, 0, sizeof(AssetPack));
+}
+
+const PackEntry *pack_find(const AssetPack *pack, const char *name) {
+  uint32 hash = pack_hash_name(name);
+  // Find the first entry with this hash
+  uint32 lo = 0, hi = pack->num_entries;
+  while (lo < hi) {
+    uint32 mid = (lo + hi) >> 1;
+    if (pack->entries[mid].name_hash < hash)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  // Hash collisions are possible, so compare the names too
+  for (; lo < pack->num_entries && pack->entries[lo].name_hash == hash; ++lo)
+    if (pack_compare_names(pack->names + pack->entries[lo].name_offset,
+                           name) == 0)
+      return &pack->entries[lo];
+  return NULL;
+}
+
+const uint8 *pack_data(const AssetPack *pack, const PackEntry *entry) {
+  if (pack->mapping == NULL ||
+      (size_t)entry->offset + entry->size > pack->mapping_size)
+    return NULL;
+  return pack->mapping + entry->offset;
+}
+
+RESULT pack_read(AssetPack *pack, const PackEntry *entry, void *dest) {
+  const uint8 *mapped = pack_data(pack, entry);
+  if (mapped != NULL) {
+    memcpy(dest, mapped, entry->size);
+    return RES_OK;
+  }
+  CHECKERR(fseek(pack->file, entry->offset, SEEK_SET) != 0,
+           "Can't seek to asset at offset %u\n", entry->offset);
+  CHECKERR(fread(dest, 1, entry->size, pack->file) != entry->size,
+           "Can't read %u bytes of asset at offset %u\n", entry->size,
+           entry->offset);
+  return RES_OK;
+onerror:
+  return RES_ERR;
+}
+
+uint8 *pack_load(AssetPack *pack, const char *name, uint32 *size) {
+  const PackEntry *entry = pack_find(pack, name);
+  uint8 *result = NULL;
+  if (entry == NULL)
+    return NULL;
+  // Keep at least one byte so that empty assets aren't mistaken for errors
+  result = malloc(entry->size + 1);
+  OOMERROR(result);
+  if (pack_read(pack, entry, result) != RES_OK) {
+    free(result);
+    return NULL;
+  }
+  *size = entry->size;
+  return result;
+onoom:
+  exit(EXIT_FAILURE);
+}
@@ -0,0 +1,69 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include <stdio.h>
+
+#include "defs.h"
+
+/*
+ * Asset pack: all game assets in a single file, so startup pays one open
+ * instead of one per asset.
+ *
+ * Layout (all numbers little endian):
+ *   PackHeader
+ *   PackEntry[num_entries]   sorted by name_hash
+ *   names                    names_size bytes of NUL terminated names
+ *   asset data               every asset aligned to 1 << align_log2
+ */
+
+#define PACK_MAGIC "GPAK"
+#define PACK_VERSION 1
+
+typedef PACKED_STRUCT PackHeader {
+  char magic[4];
+  uint16 version;
+  uint16 reserved;
+  uint32 num_entries;
+  uint32 names_size;
+}
+PackHeader;
+
+typedef PACKED_STRUCT PackEntry {
+  uint32 name_hash;
+  uint32 name_offset; // into the names block
+  uint32 offset;      // from the start of the file
+  uint32 size;
+  uint16 align_log2;
+  uint16 reserved;
+}
+PackEntry;
+
+typedef struct AssetPack {
+  FILE *file;
+  uint32 num_entries;
+  PackEntry *entries;
+  char *names;
+  // Whole file mapped into memory, only on hosts that have mmap
+  const uint8 *mapping;
+  size_t mapping_size;
+} AssetPack;
+
+// FNV-1a of the name, case insensitive and with '\' treated as '/'
+uint32 pack_hash_name(const char *name);
+// Orders names like strcmp, folded the same way as pack_hash_name
+int pack_compare_names(const char *a, const char *b);
+
+RESULT pack_open(AssetPack *pack, const char *path);
+void pack_close(AssetPack *pack);
+
+// Returns the entry of the asset or NULL if there's no such asset
+const PackEntry *pack_find(const AssetPack *pack, const char *name);
+// Reads the asset into dest, which must hold entry->size bytes
+RESULT pack_read(AssetPack *pack, const PackEntry *entry, void *dest);
+// Reads the asset into a malloc'd buffer. Returns NULL if there's no such
+// asset.
+uint8 *pack_load(AssetPack *pack, const char *name, uint32 *size);
+// Pointer to the asset data if the pack is memory mapped, NULL otherwise
+const uint8 *pack_data(const AssetPack *pack, const PackEntry *entry);
+
+#endif // PACK_H
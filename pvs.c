@@ -0,0 +1,177 @@
+/*
+    gmm2json: program that reads Gridmonger's GMM file and converts it into
+   JSON format
+    Copyright (C) 2025 Jagholin (github.com/Jagholin)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see
+   <https://www.gnu.org/licenses/>
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "pvs.h"
+
+static inline bool sight_passes(const LevelGrid *grid, uint16 row, uint16 col,
+                                GridDir dir) {
+  return wall_transparent(grid_edge(grid, row, col, dir)) &&
+         grid_cell_open(grid, row + dir_drow[dir], col + dir_dcol[dir]);
+}
+
+// Walks the cells the line between the centres passes through, in order.
+// Where the line goes exactly through a corner, either way around will do.
+bool pvs_line_of_sight(const LevelGrid *grid, uint16 row, uint16 col,
+                       uint16 to_row, uint16 to_col) {
+  int drow = (int)to_row - row, dcol = (int)to_col - col;
+  int nrow = drow < 0 ? -drow : drow, ncol = dcol < 0 ? -dcol : dcol;
+  GridDir vdir = drow < 0 ? DIR_NORTH : DIR_SOUTH;
+  GridDir hdir = dcol < 0 ? DIR_WEST : DIR_EAST;
+  int irow = 0, icol = 0;
+
+  while (irow < nrow || icol < ncol) {
+    // Compare where the line crosses the next column and row boundaries
+    int decision = (1 + 2 * icol) * nrow - (1 + 2 * irow) * ncol;
+    if (decision == 0) {
+      bool via_col = sight_passes(grid, row, col, hdir) &&
+                     sight_passes(grid, row, col + dir_dcol[hdir], vdir);
+      bool via_row = sight_passes(grid, row, col, vdir) &&
+                     sight_passes(grid, row + dir_drow[vdir], col, hdir);
+      if (!via_col && !via_row)
+        return false;
+      row += dir_drow[vdir];
+      col += dir_dcol[hdir];
+      irow++;
+      icol++;
+    } else if (decision < 0) {
+      if (!sight_passes(grid, row, col, hdir))
+        return false;
+      col += dir_dcol[hdir];
+      icol++;
+    } else {
+      if (!sight_passes(grid, row, col, vdir))
+        return false;
+      row += dir_drow[vdir];
+      irow++;
+    }
+  }
+  return true;
+}
+
+RESULT pvs_bake_level(const LevelGrid *grid, uint16 radius, PvsLevel *out) {
+  int side = 2 * radius + 1;
+
+  out->rows = grid->rows;
+  out->cols = grid->cols;
+  out->radius = radius;
+  out->data = NULL;
+  CHECKERR(radius > PVS_MAX_RADIUS, "Visibility radius %u is too large\n",
+           radius);
+  CHECKERR((unsigned long long)out->rows * out->cols *
+                   pvs_window_bytes(out) >
+               0xFFFFFFFFu,
+           "Level of %ux%u is too large for visibility sets\n", out->rows,
+           out->cols);
+  // Closed cells see nothing, their windows stay zero
+  out->data = calloc(pvs_level_bytes(out) ? pvs_level_bytes(out) : 1, 1);
+  OOMERROR(out->data);
+
+  for (uint16 r = 0; r < grid->rows; ++r)
+    for (uint16 c = 0; c < grid->cols; ++c) {
+      if (!grid_cell_open(grid, r, c))
+        continue;
+      uint8 *window = (uint8 *)pvs_cell_window(out, r, c);
+      for (int dr = -radius; dr <= radius; ++dr)
+        for (int dc = -radius; dc <= radius; ++dc) {
+          int tr = r + dr, tc = c + dc;
+          if (tr < 0 || tc < 0 || tr >= grid->rows || tc >= grid->cols ||
+              !grid_cell_open(grid, tr, tc) ||
+              !pvs_line_of_sight(grid, r, c, tr, tc))
+            continue;
+          uint32 bit = (uint32)(dr + radius) * side + (dc + radius);
+          window[bit >> 3] |= 1 << (bit & 7);
+        }
+    }
+  return RES_OK;
+onerror:
+  return RES_ERR;
+onoom:
+  exit(EXIT_FAILURE);
+}
+
+void pvs_level_free(PvsLevel *level) {
+  free(level->data);
+  level->data = NULL;
+}
+
+RESULT pvs_write(FILE *f, const PvsLevel *levels, uint16 num_levels) {
+  PvsFileHeader header;
+  memcpy(header.magic, PVS_MAGIC, 4);
+  header.version = PVS_VERSION;
+  header.num_levels = num_levels;
+  CHECKERR(fwrite(&header, sizeof(header), 1, f) != 1,
+           "Can't write visibility header\n");
+  for (uint16 i = 0; i < num_levels; ++i) {
+    const PvsLevel *level = &levels[i];
+    PvsLevelHeader lheader = {level->rows, level->cols, level->radius, 0,
+                              pvs_level_bytes(level)};
+    CHECKERR(fwrite(&lheader, sizeof(lheader), 1, f) != 1 ||
+                 fwrite(level->data, 1, lheader.data_size, f) !=
+                     lheader.data_size,
+             "Can't write visibility sets of level %u\n", i);
+  }
+  return RES_OK;
+onerror:
+  return RES_ERR;
+}
+
+RESULT pvs_read(FILE *f, PvsLevel **levels, uint16 *num_levels) {
+  PvsFileHeader header;
+  PvsLevel *result = NULL;
+  uint16 count = 0;
+
+  CHECKERR(fread(&header, sizeof(header), 1, f) != 1,
+           "Can't read visibility header\n");
+  CHECKERR(strncmp(header.magic, PVS_MAGIC, 4) != 0 ||
+               header.version != PVS_VERSION,
+           "Not a visibility file, or unsupported version\n");
+  result = calloc(header.num_levels ? header.num_levels : 1, sizeof(PvsLevel));
+  OOMERROR(result);
+  for (; count < header.num_levels; ++count) {
+    PvsLevelHeader lheader;
+    PvsLevel *level = &result[count];
+    CHECKERR(fread(&lheader, sizeof(lheader), 1, f) != 1,
+             "Can't read visibility sets of level %u\n", count);
+    level->rows = lheader.rows;
+    level->cols = lheader.cols;
+    level->radius = lheader.radius;
+    CHECKERR(lheader.radius > PVS_MAX_RADIUS ||
+                 (unsigned long long)level->rows * level->cols *
+                         pvs_window_bytes(level) !=
+                     lheader.data_size,
+             "Corrupt visibility sets in level %u\n", count);
+    level->data = malloc(lheader.data_size ? lheader.data_size : 1);
+    OOMERROR(level->data);
+    CHECKERR(fread(level->data, 1, lheader.data_size, f) != lheader.data_size,
+             "Can't read visibility sets of level %u\n", count);
+  }
+  *levels = result;
+  *num_levels = count;
+  return RES_OK;
+onerror:
+  for (uint16 i = 0; result && i <= count && i < header.num_levels; ++i)
+    pvs_level_free(&result[i]);
+  free(result);
+  return RES_ERR;
+onoom:
+  exit(EXIT_FAILURE);
+}
@@ -0,0 +1,114 @@
+/*
+    gmm2json: program that reads Gridmonger's GMM file and converts it into
+   JSON format
+    Copyright (C) 2025 Jagholin (github.com/Jagholin)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see
+   <https://www.gnu.org/licenses/>
+*/
+#ifndef PVS_H
+#define PVS_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "defs.h"
+#include "level_grid.h"
+
+// Potentially visible sets, baked per level.
+//
+// Every open cell stores which cells of the (2 * radius + 1)^2 window around
+// it can be seen: a cell is visible if the line between the two cell centres
+// only crosses transparent walls and open cells. The window bitsets are kept
+// as they are, one fixed-size window per cell, so a set is tested in place.
+// The GMM cell layer RLE saved only about 1% on them and needed an offset
+// table and a decoding pass per lookup. They are stored in a .pvs file next
+// to the map.
+#define PVS_MAGIC "GPVS"
+#define PVS_VERSION 2
+#define PVS_MAX_RADIUS 127
+
+typedef PACKED_STRUCT PvsFileHeader {
+  char magic[4];
+  uint16 version;
+  uint16 num_levels;
+}
+PvsFileHeader;
+
+// Followed by data_size bytes of data, rows * cols windows
+typedef PACKED_STRUCT PvsLevelHeader {
+  uint16 rows;
+  uint16 cols;
+  uint16 radius;
+  uint16 reserved;
+  uint32 data_size;
+}
+PvsLevelHeader;
+
+typedef struct PvsLevel {
+  uint16 rows;
+  uint16 cols;
+  uint16 radius;
+  // Set of cell i is the pvs_window_bytes starting at data[i * window bytes]
+  uint8 *data;
+} PvsLevel;
+
+// Fails if radius is over PVS_MAX_RADIUS or the sets don't fit in 4 GiB
+RESULT pvs_bake_level(const LevelGrid *grid, uint16 radius, PvsLevel *out);
+void pvs_level_free(PvsLevel *level);
+
+RESULT pvs_write(FILE *f, const PvsLevel *levels, uint16 num_levels);
+// Allocates *levels, free every level and then the array
+RESULT pvs_read(FILE *f, PvsLevel **levels, uint16 *num_levels);
+
+// Line of sight between two cell centres of the same level
+bool pvs_line_of_sight(const LevelGrid *grid, uint16 row, uint16 col,
+                       uint16 to_row, uint16 to_col);
+
+static inline uint32 pvs_window_bytes(const PvsLevel *level) {
+  uint32 side = 2 * level->radius + 1;
+  return (side * side + 7) / 8;
+}
+
+static inline uint32 pvs_level_bytes(const PvsLevel *level) {
+  return (uint32)level->rows * level->cols * pvs_window_bytes(level);
+}
+
+// The set of a cell, the cell must be inside the level
+static inline const uint8 *pvs_cell_window(const PvsLevel *level, uint16 row,
+                                           uint16 col) {
+  return level->data +
+         ((uint32)row * level->cols + col) * pvs_window_bytes(level);
+}
+
+// Tests the window of a cell for the cell at the given offset from its centre
+static inline bool pvs_window_test(const PvsLevel *level, const uint8 *window,
+                                   int drow, int dcol) {
+  int radius = level->radius, side = 2 * radius + 1;
+  if (drow < -radius || drow > radius || dcol < -radius || dcol > radius)
+    return false;
+  uint32 bit = (uint32)(drow + radius) * side + (dcol + radius);
+  return (window[bit >> 3] >> (bit & 7)) & 1;
+}
+
+// Whether the cell at to_row, to_col can be seen from row, col
+static inline bool pvs_visible(const PvsLevel *level, uint16 row, uint16 col,
+                               uint16 to_row, uint16 to_col) {
+  if (row >= level->rows || col >= level->cols)
+    return false;
+  return pvs_window_test(level, pvs_cell_window(level, row, col),
+                         (int)to_row - row, (int)to_col - col);
+}
+
+#endif // PVS_H
@@ -0,0 +1,188 @@
+/*
+    gmm2json: program that reads Gridmonger's GMM file and converts it into
+   JSON format
+    Copyright (C) 2025 Jagholin (github.com/Jagholin)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see
+   <https://www.gnu.org/licenses/>
+*/
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "rle_layer.h"
+
+struct RunWriter {
+  RleLayer *layer; // NULL while counting runs
+  uint8 *bytes;    // expanded cells, if not NULL
+  bool xor_bytes;  // xor the runs into bytes instead of storing them
+  uint32 num_runs;
+  uint32 pos; // number of cells emitted so far
+  uint8 last_value;
+};
+
+static void emit_run(struct RunWriter *w, uint8 value, uint32 count) {
+  if (count == 0)
+    return;
+  if (w->bytes && w->xor_bytes) {
+    if (value != 0)
+      for (uint32 i = 0; i < count; ++i)
+        w->bytes[w->pos + i] ^= value;
+  } else if (w->bytes) {
+    memset(w->bytes + w->pos, value, count);
+  }
+  // Runs may span several rows, row_first_run takes care of that
+  if (w->num_runs == 0 || value != w->last_value) {
+    if (w->layer) {
+      w->layer->run_start[w->num_runs] = w->pos;
+      w->layer->run_value[w->num_runs] = value;
+    }
+    w->num_runs++;
+    w->last_value = value;
+  }
+  w->pos += count;
+}
+
+// Walks the layer payload and emits its runs. Returns RES_OK when the payload
+// decodes to exactly size cells.
+static RESULT walk_layer(struct RunWriter *w, uint8 compression,
+                         const uint8 *data, size_t data_len, uint32 size) {
+  if (compression == 0) {
+    CHECKERR(data_len < size, "Raw cell layer is shorter than the level\n");
+    for (uint32 i = 0; i < size; ++i)
+      emit_run(w, data[i], 1);
+  } else if (compression == 1) {
+    const uint8 *end = data + data_len;
+    while (data < end) {
+      if (*data & 0x80) {
+        uint32 repeat_len = (*data & 0x7f) + 1;
+        CHECKERR(data + 1 == end,
+                 "compressed_data unexpectedly run out on line %d\n", __LINE__);
+        CHECKERR(w->pos + repeat_len > size,
+                 "Possible buffer overflow in rle_layer_build, line %d.\n",
+                 __LINE__);
+        emit_run(w, data[1], repeat_len);
+        data += 2;
+      } else {
+        CHECKERR(w->pos + 1 > size,
+                 "Possible buffer overflow in rle_layer_build, line %d.\n",
+                 __LINE__);
+        emit_run(w, *data, 1);
+        data += 1;
+      }
+    }
+    // decode_cell_layer leaves the tail zeroed
+    emit_run(w, 0, size - w->pos);
+  } else if (compression == 2) {
+    emit_run(w, 0, size);
+  } else {
+    last_error = RES_BAD_INPUT;
+    goto onerror;
+  }
+  return RES_OK;
+onerror:
+  return RES_ERR;
+}
+
+RESULT rle_layer_build(RleLayer *out, uint8 compression, const uint8 *data,
+                       size_t data_len, uint32 size, uint16 row_len) {
+  memset(out, 0, sizeof(RleLayer));
+  CHECKERR(size == 0 || row_len == 0, "Empty cell layer\n");
+
+  struct RunWriter counter = {NULL, NULL, false, 0, 0, 0};
+  CHECKERR(walk_layer(&counter, compression, data, data_len, size) != RES_OK,
+           "Can't decode cell layer\n");
+
+  out->size = size;
+  out->row_len = row_len;
+  out->num_rows = (size + row_len - 1) / row_len;
+  out->num_runs = counter.num_runs;
+  // One block: run starts, row index, then the run values
+  size_t block_size = sizeof(uint32) * (out->num_runs + out->num_rows) +
+                      sizeof(uint8) * out->num_runs;
+  out->run_start = malloc(block_size);
+  OOMERROR(out->run_start);
+  out->row_first_run = out->run_start + out->num_runs;
+  out->run_value = (uint8 *)(out->row_first_run + out->num_rows);
+
+  struct RunWriter writer = {out, NULL, false, 0, 0, 0};
+  walk_layer(&writer, compression, data, data_len, size);
+
+  // Fill in the row index with one pass over the runs
+  uint32 run = 0;
+  for (uint16 row = 0; row < out->num_rows; ++row) {
+    uint32 first_cell = (uint32)row * row_len;
+    while (run + 1 < out->num_runs && out->run_start[run + 1] <= first_cell)
+      run++;
+    out->row_first_run[row] = run;
+  }
+  return RES_OK;
+onerror:
+  return RES_ERR;
+onoom:
+  exit(EXIT_FAILURE);
+}
+
+void rle_layer_free(RleLayer *layer) {
+  free(layer->run_start);
+  layer->run_start = NULL;
+  layer->run_value = NULL;
+  layer->row_first_run = NULL;
+}
+
+void rle_layer_expand(const RleLayer *layer, uint8 *dest) {
+  for (uint32 i = 0; i < layer->num_runs; ++i) {
+    uint32 end =
+        i + 1 < layer->num_runs ? layer->run_start[i + 1] : layer->size;
+    memset(dest + layer->run_start[i], layer->run_value[i],
+           end - layer->run_start[i]);
+  }
+}
+
+size_t rle_layer_memory(const RleLayer *layer) {
+  return sizeof(uint32) * (layer->num_runs + layer->num_rows) +
+         sizeof(uint8) * layer->num_runs;
+}
+
+size_t rle_encode(const uint8 *src, uint32 len, uint8 *dest) {
+  uint8 *out = dest;
+  uint32 i = 0;
+  while (i < len) {
+    uint32 run = 1;
+    while (i + run < len && run < 128 && src[i + run] == src[i])
+      run++;
+    // Values with the high bit set can only be stored as runs
+    if (run == 1 && src[i] < 0x80) {
+      *out++ = src[i];
+    } else {
+      *out++ = 0x80 | (run - 1);
+      *out++ = src[i];
+    }
+    i += run;
+  }
+  return out - dest;
+}
+
+RESULT rle_decode(const uint8 *src, size_t src_len, uint8 *dest,
+                  uint32 size) {
+  struct RunWriter writer = {NULL, dest, false, 0, 0, 0};
+  return walk_layer(&writer, 1, src, src_len, size);
+}
+
+RESULT rle_decode_xor(const uint8 *src, size_t src_len, uint8 *dest,
+                      uint32 size) {
+  struct RunWriter writer = {NULL, dest, true, 0, 0, 0};
+  return walk_layer(&writer, 1, src, src_len, size);
+}
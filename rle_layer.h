@@ -0,0 +1,83 @@
+/*
+    gmm2json: program that reads Gridmonger's GMM file and converts it into
+   JSON format
+    Copyright (C) 2025 Jagholin (github.com/Jagholin)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see
+   <https://www.gnu.org/licenses/>
+*/
+#ifndef RLE_LAYER_H
+#define RLE_LAYER_H
+
+#include <stddef.h>
+
+#include "defs.h"
+
+// A cell layer kept in run-length form.
+// Runs are stored as two parallel arrays, run_start holds the index of the
+// first cell of every run in ascending order. row_first_run holds, for every
+// row, the run that contains the first cell of that row, so a lookup only has
+// to binary search the runs of a single row.
+// All arrays live in one allocation that starts at run_start.
+typedef struct RleLayer {
+  uint32 size;    // number of cells in the expanded layer
+  uint16 row_len; // cells per row
+  uint16 num_rows;
+  uint32 num_runs;
+  uint32 *run_start;
+  uint8 *run_value;
+  uint32 *row_first_run;
+} RleLayer;
+
+// Builds an RleLayer from the payload of a GMM cell layer.
+// compression is the compression type byte of the layer (0 = raw, 1 = RLE,
+// 2 = all zero), data/data_len the bytes that follow it.
+RESULT rle_layer_build(RleLayer *out, uint8 compression, const uint8 *data,
+                       size_t data_len, uint32 size, uint16 row_len);
+void rle_layer_free(RleLayer *layer);
+
+// Writes the expanded layer into dest, which must hold layer->size bytes
+void rle_layer_expand(const RleLayer *layer, uint8 *dest);
+
+// Bytes of memory used by the layer, not counting the RleLayer itself
+size_t rle_layer_memory(const RleLayer *layer);
+
+// Compresses len bytes with the GMM cell layer scheme. dest must hold up to
+// 2 * len bytes. Returns the compressed size.
+size_t rle_encode(const uint8 *src, uint32 len, uint8 *dest);
+// Expands data compressed by rle_encode into size bytes, zeroing the tail
+RESULT rle_decode(const uint8 *src, size_t src_len, uint8 *dest,
+                  uint32 size);
+// Like rle_decode, but xors the expanded bytes into dest
+RESULT rle_decode_xor(const uint8 *src, size_t src_len, uint8 *dest,
+                      uint32 size);
+
+static inline uint8 rle_layer_get(const RleLayer *layer, uint16 row,
+                                  uint16 col) {
+  uint32 index = (uint32)row * layer->row_len + col;
+  uint32 lo = layer->row_first_run[row];
+  uint32 hi = row + 1 < layer->num_rows ? layer->row_first_run[row + 1]
+                                        : layer->num_runs - 1;
+  // Find the last run that starts at or before index
+  while (lo < hi) {
+    uint32 mid = (lo + hi + 1) >> 1;
+    if (layer->run_start[mid] <= index)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return layer->run_value[lo];
+}
+
+#endif // RLE_LAYER_H
@@ -0,0 +1,333 @@
+/*
+    gmm2json: program that reads Gridmonger's GMM file and converts it into
+   JSON format
+    Copyright (C) 2025 Jagholin (github.com/Jagholin)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see
+   <https://www.gnu.org/licenses/>
+*/
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "layer_cache.h"
+#include "rle_layer.h"
+#include "savegame.h"
+
+static uint8 **cell_plane(RiffChunkLevelCell *cell, GmmLayer layer) {
+  uint8 **planes[GMM_LAYER_COUNT] = {
+      &cell->floor,      &cell->floor_orientation, &cell->floor_color,
+      &cell->wall_north, &cell->wall_west,         &cell->trail};
+  return planes[layer];
+}
+
+// Compresses cells_count bytes into a block of their own
+static uint8 *pack_layer(const uint8 *cells, uint32 cells_count,
+                         uint32 *size) {
+  uint8 *packed = malloc(2 * (size_t)cells_count + 1);
+  OOMERROR(packed);
+  *size = rle_encode(cells, cells_count, packed);
+  uint8 *shrunk = realloc(packed, *size + 1);
+  return shrunk != NULL ? shrunk : packed;
+onoom:
+  exit(EXIT_FAILURE);
+}
+
+static void drop_diff(SaveLayer *layer) {
+  free(layer->diff);
+  layer->diff = NULL;
+  layer->diff_size = 0;
+}
+
+// The live layer of a resident level, private to it, with the pristine
+// content kept before the first write
+static uint8 *writable_plane(SaveLevel *level, GmmLayer layer) {
+  uint8 **plane = cell_plane(level->cell, layer);
+  SaveLayer *saved = &level->layers[layer];
+  if (saved->pristine == NULL)
+    saved->pristine =
+        pack_layer(*plane, level->cells_count, &saved->pristine_size);
+  if (level->cell->shared_layers)
+    layer_make_writable(plane);
+  return *plane;
+}
+
+// Xors the live layer of a resident level with the pristine one into diff.
+// Returns false if they are the same.
+static bool diff_layer(const SaveLevel *level, GmmLayer layer, uint8 *diff) {
+  const SaveLayer *saved = &level->layers[layer];
+  if (saved->pristine == NULL)
+    return false;
+  rle_decode(saved->pristine, saved->pristine_size, diff, level->cells_count);
+  const uint8 *live = *cell_plane(level->cell, layer);
+  uint8 changed = 0;
+  for (uint32 i = 0; i < level->cells_count; ++i) {
+    diff[i] ^= live[i];
+    changed |= diff[i];
+  }
+  return changed != 0;
+}
+
+// Brings the diffs kept while the level was away back into its cells
+static RESULT apply_diffs(SaveLevel *level, uint16 level_index) {
+  for (int l = 0; l < GMM_LAYER_COUNT; ++l) {
+    SaveLayer *saved = &level->layers[l];
+    if (saved->diff == NULL)
+      continue;
+    RESULT res = rle_decode_xor(saved->diff, saved->diff_size,
+                                writable_plane(level, l), level->cells_count);
+    drop_diff(saved);
+    CHECKERR(res != RES_OK, "Corrupt saved changes of level %u\n",
+             level_index);
+  }
+  return RES_OK;
+onerror:
+  return RES_ERR;
+}
+
+static void level_loaded(void *user, uint16 level_index, GmmLevel *gmm) {
+  SaveGame *save = user;
+  if (level_index >= save->num_levels || gmm->cell == NULL)
+    return;
+  SaveLevel *level = &save->levels[level_index];
+  if (level->cells_count != 0 &&
+      level->cells_count != gmm->cell->cells_count) {
+    printf("Saved changes don't match level %u, dropping them\n",
+           level_index);
+    for (int l = 0; l < GMM_LAYER_COUNT; ++l)
+      drop_diff(&level->layers[l]);
+  }
+  level->cell = gmm->cell;
+  level->cells_count = gmm->cell->cells_count;
+  apply_diffs(level, level_index);
+}
+
+// Keeps the changes of the level before the manager frees its cells
+static void level_evicting(void *user, uint16 level_index, GmmLevel *gmm) {
+  SaveGame *save = user;
+  (void)gmm;
+  if (level_index >= save->num_levels ||
+      save->levels[level_index].cell == NULL)
+    return;
+  SaveLevel *level = &save->levels[level_index];
+  uint8 *diff = malloc(level->cells_count);
+  OOMERROR(diff);
+  for (int l = 0; l < GMM_LAYER_COUNT; ++l)
+    if (diff_layer(level, l, diff))
+      level->layers[l].diff = pack_layer(diff, level->cells_count,
+                                         &level->layers[l].diff_size);
+  free(diff);
+  level->cell = NULL;
+  return;
+onoom:
+  exit(EXIT_FAILURE);
+}
+
+RESULT savegame_init(SaveGame *save, LevelManager *mgr) {
+  memset(save, 0, sizeof(SaveGame));
+  CHECKERR(mgr->decode_flags & GMM_DECODE_RLE_LAYERS,
+           "Save games need levels decoded as byte planes\n");
+  save->mgr = mgr;
+  save->num_levels = level_manager_num_levels(mgr);
+  save->levels = calloc(save->num_levels + 1, sizeof(SaveLevel));
+  OOMERROR(save->levels);
+  mgr->on_loaded = level_loaded;
+  mgr->on_evicting = level_evicting;
+  mgr->hook_user = save;
+  // Levels that are already resident are still pristine
+  for (unsigned int i = 0; i < mgr->resident.len; ++i) {
+    ResidentLevel *res = *(ResidentLevel **)dynarray_get(&mgr->resident, i);
+    level_loaded(save, res->level_index, &res->level);
+  }
+  return RES_OK;
+onerror:
+  return RES_ERR;
+onoom:
+  exit(EXIT_FAILURE);
+}
+
+void savegame_free(SaveGame *save) {
+  if (save->mgr != NULL && save->mgr->hook_user == save) {
+    save->mgr->on_loaded = NULL;
+    save->mgr->on_evicting = NULL;
+    save->mgr->hook_user = NULL;
+  }
+  for (uint16 i = 0; i < save->num_levels; ++i)
+    for (int l = 0; l < GMM_LAYER_COUNT; ++l) {
+      free(save->levels[i].layers[l].pristine);
+      free(save->levels[i].layers[l].diff);
+    }
+  free(save->levels);
+  memset(save, 0, sizeof(SaveGame));
+}
+
+uint8 *savegame_writable_layer(SaveGame *save, uint16 level_index,
+                               GmmLayer layer) {
+  if (level_index >= save->num_levels ||
+      save->levels[level_index].cell == NULL)
+    return NULL;
+  return writable_plane(&save->levels[level_index], layer);
+}
+
+void savegame_reset(SaveGame *save) {
+  uint8 *diff = NULL;
+  for (uint16 i = 0; i < save->num_levels; ++i) {
+    SaveLevel *level = &save->levels[i];
+    for (int l = 0; l < GMM_LAYER_COUNT; ++l)
+      drop_diff(&level->layers[l]);
+    if (level->cell == NULL)
+      continue;
+    uint8 *grown = realloc(diff, level->cells_count);
+    OOMERROR(grown);
+    diff = grown;
+    // Only layers that changed were made private, xor them back
+    for (int l = 0; l < GMM_LAYER_COUNT; ++l) {
+      if (!diff_layer(level, l, diff))
+        continue;
+      uint8 *live = writable_plane(level, l);
+      for (uint32 c = 0; c < level->cells_count; ++c)
+        live[c] ^= diff[c];
+    }
+  }
+  free(diff);
+  return;
+onoom:
+  exit(EXIT_FAILURE);
+}
+
+RESULT savegame_write(SaveGame *save, FILE *f) {
+  uint32 max_cells = 1;
+  uint16 num_levels = 0;
+  for (uint16 i = 0; i < save->num_levels; ++i) {
+    if (save->levels[i].cells_count == 0)
+      continue;
+    num_levels++;
+    if (save->levels[i].cells_count > max_cells)
+      max_cells = save->levels[i].cells_count;
+  }
+  // One diff per layer, so that the mask can be written before the data
+  uint8 *diff = malloc((size_t)GMM_LAYER_COUNT * max_cells);
+  uint8 *packed = malloc(2 * (size_t)max_cells);
+  OOMERROR(diff);
+  OOMERROR(packed);
+
+  SaveFileHeader header;
+  memcpy(header.magic, SAVE_MAGIC, 4);
+  header.version = SAVE_VERSION;
+  header.num_levels = num_levels;
+  CHECKERR(fwrite(&header, sizeof(header), 1, f) != 1,
+           "Can't write save game header\n");
+  for (uint16 i = 0; i < save->num_levels; ++i) {
+    const SaveLevel *level = &save->levels[i];
+    if (level->cells_count == 0)
+      continue;
+    // Resident levels are diffed now, the others have theirs already
+    SaveLevelHeader lheader = {i, 0, level->cells_count};
+    for (int l = 0; l < GMM_LAYER_COUNT; ++l)
+      if (level->cell != NULL
+              ? diff_layer(level, l, diff + (size_t)l * max_cells)
+              : level->layers[l].diff != NULL)
+        lheader.layer_mask |= 1u << l;
+    CHECKERR(fwrite(&lheader, sizeof(lheader), 1, f) != 1,
+             "Can't write save game level %u\n", i);
+    for (int l = 0; l < GMM_LAYER_COUNT; ++l) {
+      if (!(lheader.layer_mask & (1u << l)))
+        continue;
+      const uint8 *data = level->layers[l].diff;
+      uint32 size = level->layers[l].diff_size;
+      if (level->cell != NULL) {
+        size = rle_encode(diff + (size_t)l * max_cells, level->cells_count,
+                          packed);
+        data = packed;
+      }
+      CHECKERR(fwrite(&size, sizeof(size), 1, f) != 1 ||
+                   fwrite(data, 1, size, f) != size,
+               "Can't write save game level %u\n", i);
+    }
+  }
+  free(diff);
+  free(packed);
+  return RES_OK;
+onerror:
+  free(diff);
+  free(packed);
+  return RES_ERR;
+onoom:
+  exit(EXIT_FAILURE);
+}
+
+RESULT savegame_read(SaveGame *save, FILE *f) {
+  uint8 *packed = NULL, *check = NULL;
+  SaveFileHeader header;
+
+  CHECKERR(fread(&header, sizeof(header), 1, f) != 1,
+           "Can't read save game header\n");
+  CHECKERR(strncmp(header.magic, SAVE_MAGIC, 4) != 0 ||
+               header.version != SAVE_VERSION,
+           "Not a save game, or unsupported version\n");
+  savegame_reset(save);
+  for (uint16 n = 0; n < header.num_levels; ++n) {
+    SaveLevelHeader lheader;
+    CHECKERR(fread(&lheader, sizeof(lheader), 1, f) != 1,
+             "Can't read save game level header\n");
+    CHECKERR(lheader.level_index >= save->num_levels,
+             "Save game has unknown level %u\n", lheader.level_index);
+    SaveLevel *level = &save->levels[lheader.level_index];
+    CHECKERR(lheader.cells_count == 0 ||
+                 (level->cells_count != 0 &&
+                  lheader.cells_count != level->cells_count) ||
+                 lheader.layer_mask >> GMM_LAYER_COUNT,
+             "Save game doesn't match level %u\n", lheader.level_index);
+    level->cells_count = lheader.cells_count;
+    for (int l = 0; l < GMM_LAYER_COUNT; ++l) {
+      if (!(lheader.layer_mask & (1u << l)))
+        continue;
+      uint32 size;
+      CHECKERR(fread(&size, sizeof(size), 1, f) != 1,
+               "Can't read save game level %u\n", lheader.level_index);
+      CHECKERR(size > 2 * level->cells_count,
+               "Corrupt save game level %u\n", lheader.level_index);
+      packed = malloc(size + 1);
+      OOMERROR(packed);
+      CHECKERR(fread(packed, 1, size, f) != size,
+               "Can't read save game level %u\n", lheader.level_index);
+      if (level->cell != NULL) {
+        CHECKERR(rle_decode_xor(packed, size, writable_plane(level, l),
+                                level->cells_count) != RES_OK,
+                 "Corrupt save game level %u\n", lheader.level_index);
+        free(packed);
+      } else {
+        // Kept for when the level is loaded, but checked already
+        uint8 *grown = realloc(check, level->cells_count);
+        OOMERROR(grown);
+        check = grown;
+        CHECKERR(rle_decode(packed, size, check, level->cells_count) !=
+                     RES_OK,
+                 "Corrupt save game level %u\n", lheader.level_index);
+        drop_diff(&level->layers[l]);
+        level->layers[l].diff = packed;
+        level->layers[l].diff_size = size;
+      }
+      packed = NULL;
+    }
+  }
+  free(check);
+  return RES_OK;
+onerror:
+  free(packed);
+  free(check);
+  return RES_ERR;
+onoom:
+  exit(EXIT_FAILURE);
+}
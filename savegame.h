@@ -0,0 +1,95 @@
+/*
+    gmm2json: program that reads Gridmonger's GMM file and converts it into
+   JSON format
+    Copyright (C) 2025 Jagholin (github.com/Jagholin)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see
+   <https://www.gnu.org/licenses/>
+*/
+#ifndef SAVEGAME_H
+#define SAVEGAME_H
+
+#include <stdio.h>
+
+#include "defs.h"
+#include "gmm_file.h"
+#include "level_manager.h"
+
+// Save games store the cell layers of every level as a diff against the
+// pristine decoded map. Every layer is xored with its pristine copy, which
+// leaves zeroes wherever nothing changed, and the result is compressed with
+// the GMM cell layer RLE. Unchanged layers aren't written at all.
+//
+// A file is a SaveFileHeader, then for every level a SaveLevelHeader and, for
+// every bit of its layer_mask, a uint32 size and that many bytes of RLE.
+//
+// The live cells of a resident level are the level manager's own, changed
+// in place. Before a layer is written for the first time its pristine
+// content is kept as RLE, and when the manager evicts the level the changes
+// are kept as RLE diffs until it is loaded again. Layers nobody wrote to
+// cost nothing and stay shared in layer_cache.
+#define SAVE_MAGIC "GSAV"
+#define SAVE_VERSION 1
+
+typedef PACKED_STRUCT SaveFileHeader {
+  char magic[4];
+  uint16 version;
+  uint16 num_levels;
+}
+SaveFileHeader;
+
+typedef PACKED_STRUCT SaveLevelHeader {
+  uint16 level_index;
+  uint16 layer_mask; // bit i set if layer i (a GmmLayer) changed
+  uint32 cells_count;
+}
+SaveLevelHeader;
+
+typedef struct SaveLayer {
+  uint8 *pristine; // RLE of the map's layer, NULL until it is written
+  uint32 pristine_size;
+  uint8 *diff; // RLE of live ^ pristine, only while the level isn't resident
+  uint32 diff_size;
+} SaveLayer;
+
+typedef struct SaveLevel {
+  RiffChunkLevelCell *cell; // the manager's, NULL if the level isn't resident
+  uint32 cells_count;       // 0 until the level has been seen
+  SaveLayer layers[GMM_LAYER_COUNT];
+} SaveLevel;
+
+typedef struct SaveGame {
+  LevelManager *mgr;
+  uint16 num_levels;
+  SaveLevel *levels;
+} SaveGame;
+
+// Takes over the load and evict hooks of mgr, which must decode byte
+// planes (no GMM_DECODE_RLE_LAYERS). Free the save game before closing mgr.
+RESULT savegame_init(SaveGame *save, LevelManager *mgr);
+void savegame_free(SaveGame *save);
+
+// Returns a layer of a resident level that can be written to, or NULL if the
+// level isn't resident or has no cells
+uint8 *savegame_writable_layer(SaveGame *save, uint16 level_index,
+                               GmmLayer layer);
+// Sets every level back to the pristine map
+void savegame_reset(SaveGame *save);
+
+RESULT savegame_write(SaveGame *save, FILE *f);
+// Resets every level and then applies the diffs of the file. On error the
+// levels may be left partly loaded.
+RESULT savegame_read(SaveGame *save, FILE *f);
+
+#endif // SAVEGAME_H
@@ -38,8 +38,6 @@
 
 #include "sb.h"
 #include "defs.h"
-#include <dos.h>
-#include <pc.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -78,11 +76,6 @@ int sb_dmachan16;
 /* Is a sound currently playing or recorded ? */
 volatile int sb_dma_active = 0;
 
-/* Conventional memory buffers for DMA. */
-static volatile int sb_bufnum = 0;
-static char *sb_buf[2];
-static unsigned int sb_buflen[2];
-
 /* Info about current sample */
 static int HIGHSPEED; /* flag for normal/highspeed DMA */
 
@@ -106,19 +99,88 @@ static int HIGHSPEED; /* flag for normal/highspeed DMA */
  */
 #define DMA_CHUNK (2048)
 
-static unsigned char sb_stream_buf[DMA_CHUNK];
-static unsigned char sb_stream_silence[DMA_CHUNK];
-static volatile char sb_stream_ready = 0;
-
-// Interrupt routine
-void sb_intr_play(_go32_dpmi_registers *reg) {
-  register unsigned n = sb_bufnum; /* buffer we just played	*/
+/* Ring of slots in conventional memory. A slot holds DMA_CHUNK frames of the
+ * negotiated format (sb_slot_bytes bytes), so 16-bit stereo interrupts as
+ * often as 8-bit mono. The 8-bit ring is followed by one block of silence.
+ * All of it lives in a single 64K page, so no transfer crosses a DMA page
+ * boundary.
+ *
+ * The main loop is the only producer: StreamReady copies the rendered chunk
+ * into slot head and then advances head. The interrupt is the only consumer:
+ * it advances tail past the slot that just finished and starts the next one,
+ * or the silence block if the ring is empty. Neither side ever writes the
+ * other's index, so no locking is needed, and the ring gives the main loop
+ * SB_RING_SLOTS chunks of slack before we hear a gap.
+ * SB_RING_SLOTS must be a power of two. */
+#define SB_RING_SLOTS 8
+#define SB_SLOT_MAX_BYTES (DMA_CHUNK * 4)
+
+/* Output format, negotiated by sb_init */
+static StreamFormat sb_format = {8, 1, 0};
+static unsigned int sb_slot_bytes = DMA_CHUNK;
+static short sb_dsp_major, sb_dsp_minor;
+
+static unsigned long sb_ring_addr; /* linear address of slot 0 */
+static volatile unsigned int sb_ring_head = 0;
+static volatile unsigned int sb_ring_tail = 0;
+static volatile int sb_playing_silence = 1;
+static volatile unsigned long sb_silent_blocks = 0;
+
+static unsigned char sb_stream_buf[SB_SLOT_MAX_BYTES];
+static unsigned char sb_stream_silence[SB_SLOT_MAX_BYTES];
+
+static inline unsigned long sb_slot_addr(unsigned int slot) {
+  return sb_ring_addr + (slot & (SB_RING_SLOTS - 1)) * sb_slot_bytes;
+}
 
-  INP(sb_ioaddr + SB_DSP_DATA_AVAIL); /* Acknowledge soundblaster */
+static inline unsigned long sb_silence_addr(void) {
+  return sb_ring_addr + SB_RING_SLOTS * sb_slot_bytes;
+}
 
-  sb_play_buffer(1 - n); /* Start next buffer player */
+/* Auto-init transfers (DSP 2.0 and up, not in high speed mode) program the
+ * DMA once for the whole ring and have the DSP interrupt after every slot, so
+ * the DMA position and the ring stay in step by themselves. As the DSP has
+ * already moved on when the interrupt comes, an empty ring can't be covered
+ * with silence: the interrupt pauses the DSP instead, and StreamReady
+ * continues it. Older DSPs and high speed mode play one single-cycle
+ * transfer per slot. 16-bit output (DSP 4.x) always uses auto-init, on the
+ * high DMA channel. */
+static int sb_autoinit = 0;
+static volatile int sb_autoinit_running = 0;
+static volatile int sb_paused = 0;
+
+/* Start the oldest filled slot, or silence if there is none. */
+static void sb_play_next(void) {
+  if (sb_ring_tail != sb_ring_head) {
+    sb_playing_silence = 0;
+    sb_play_buffer(sb_slot_addr(sb_ring_tail), DMA_CHUNK);
+  } else {
+    sb_playing_silence = 1;
+    sb_silent_blocks++;
+    sb_play_buffer(sb_silence_addr(), DMA_CHUNK);
+  }
+}
 
-  sb_fill_buffer(n); /* Fill this buffer for next time around */
+// Interrupt routine
+void sb_intr_play(_go32_dpmi_registers *reg) {
+  if (sb_format.bits == 16)
+    INP(sb_ioaddr + SB_DSP_ACK_16); /* Acknowledge soundblaster */
+  else
+    INP(sb_ioaddr + SB_DSP_DATA_AVAIL);
+
+  if (sb_autoinit) {
+    sb_ring_tail++; /* The DSP is already playing the next slot */
+    if (sb_ring_tail == sb_ring_head) {
+      /* which is empty, wait for StreamReady */
+      sb_writedac(sb_format.bits == 16 ? SB_HALT_DMA_16 : SB_HALT_DMA);
+      sb_paused = 1;
+      sb_silent_blocks++;
+    }
+  } else {
+    if (!sb_playing_silence)
+      sb_ring_tail++; /* The slot we just played is free again */
+    sb_play_next();   /* Start next block */
+  }
 
   OUT(0x20, 0x20); /* Acknowledge the interrupt */
 
@@ -126,52 +188,47 @@ void sb_intr_play(_go32_dpmi_registers *reg) {
 }
 void sb_intr_play_end() {}
 
-/* Fill buffer n with the next data. */
-void sb_fill_buffer(register unsigned n) {
-  if (sb_stream_ready) {
-    sb_buflen[n] = DMA_CHUNK;
-    // TODO: move this out of interrupt routine
-    dosmemput(sb_stream_buf, DMA_CHUNK, (unsigned long)sb_buf[n]);
-    sb_stream_ready = 0;
-  } else {
-    sb_buflen[n] = DMA_CHUNK;
-    dosmemput(sb_stream_silence, DMA_CHUNK, (unsigned long)sb_buf[n]);
-  }
+static void sb_unmask_irq(void) {
+  unsigned char im, tm;
+  im = INP(0x21); /* Enable interrupts on PIC */
+  tm = ~(1 << sb_irq);
+  OUT(0x21, im & tm);
 }
-void sb_fill_buffer_end() {}
 
-void sb_play_buffer(register unsigned n) {
+/* Unmask our IRQ and program the DMA controller for len bytes at addr. */
+static void sb_program_dma(unsigned long addr, unsigned int len,
+                           unsigned char mode) {
   int t;
-  unsigned char im, tm;
-  if (sb_buflen[n] <= 0) { /* See if we're already done */
-    sb_dma_active = 0;
-    return;
-  }
   int interrupt_state = disable();
 
-  im = INP(0x21); /* Enable interrupts on PIC */
-  tm = ~(1 << sb_irq);
-  OUT(0x21, im & tm);
+  sb_unmask_irq();
 
   OUT(SB_DMA_MASK, 5); /* Set DMA mode 'play' */
   OUT(SB_DMA_FF, 0);
-  OUT(SB_DMA_MODE, 0x49);
+  OUT(SB_DMA_MODE, mode);
 
-  sb_bufnum = n; /* Set transfer address */
-  t = (int)((unsigned long)sb_buf[n] >> 16);
+  t = (int)(addr >> 16); /* Set transfer address */
   OUT(SB_DMAPAGE + 3, t);
-  t = (int)((unsigned long)sb_buf[n] & 0xFFFF);
+  t = (int)(addr & 0xFFFF);
   OUT(SB_DMA + 2 * sb_dmachan, t & 0xFF);
   OUT(SB_DMA + 2 * sb_dmachan, t >> 8);
   /* Set transfer length byte count */
-  OUT(SB_DMA + 2 * sb_dmachan + 1, (sb_buflen[n] - 1) & 0xFF);
-  OUT(SB_DMA + 2 * sb_dmachan + 1, (sb_buflen[n] - 1) >> 8);
+  OUT(SB_DMA + 2 * sb_dmachan + 1, (len - 1) & 0xFF);
+  OUT(SB_DMA + 2 * sb_dmachan + 1, (len - 1) >> 8);
 
   OUT(SB_DMA_MASK, sb_dmachan); /* Unmask DMA channel */
 
   // We don't want to enable interrupts early
   if (interrupt_state)
     enable();
+}
+
+void sb_play_buffer(unsigned long addr, unsigned int len) {
+  if (len == 0) { /* See if we're already done */
+    sb_dma_active = 0;
+    return;
+  }
+  sb_program_dma(addr, len, 0x49);
 
   if (HIGHSPEED) {
     sb_writedac(SB_SET_BLOCKSIZE); /* prepare block programming */
@@ -179,8 +236,8 @@ void sb_play_buffer(register unsigned n) {
     sb_writedac(SB_DMA_8_BIT_DAC); /* command byte for DMA DAC transfer */
   }
 
-  sb_writedac((sb_buflen[n] - 1) & 0xFF); /* sb_write length */
-  sb_writedac((sb_buflen[n] - 1) >> 8);
+  sb_writedac((len - 1) & 0xFF); /* sb_write length */
+  sb_writedac((len - 1) >> 8);
 
   if (HIGHSPEED)
     sb_writedac(SB_HIGH_DMA_8_BIT_DAC); /* command byte for high speed DMA DAC
@@ -190,6 +247,59 @@ void sb_play_buffer(register unsigned n) {
 }
 void sb_play_buffer_end() {}
 
+/* Same for the 16-bit controller, always in auto-init mode. It counts in
+ * words, addr must be even. */
+static void sb_program_dma16(unsigned long addr, unsigned int len) {
+  static const unsigned short addr_ports[] = {0xC0, 0xC4, 0xC8, 0xCC};
+  static const unsigned short count_ports[] = {0xC2, 0xC6, 0xCA, 0xCE};
+  static const unsigned short page_ports[] = {0x8F, 0x8B, 0x89, 0x8A};
+  int chan = sb_dmachan16 & 3;
+  unsigned long words = addr >> 1;
+  unsigned int count = len / 2 - 1;
+  int interrupt_state = disable();
+
+  sb_unmask_irq();
+
+  OUT(SB_DMA16_MASK, chan | 4); /* Mask the channel while we program it */
+  OUT(SB_DMA16_FF, 0);
+  OUT(SB_DMA16_MODE, 0x58 | chan); /* single, auto-init, read */
+
+  OUT(page_ports[chan], (addr >> 16) & 0xFE);
+  OUT(addr_ports[chan], words & 0xFF);
+  OUT(addr_ports[chan], (words >> 8) & 0xFF);
+  OUT(count_ports[chan], count & 0xFF);
+  OUT(count_ports[chan], count >> 8);
+
+  OUT(SB_DMA16_MASK, chan); /* Unmask DMA channel */
+
+  if (interrupt_state)
+    enable();
+}
+
+/* Loop over the whole ring, interrupting after every slot. */
+static void sb_play_autoinit(void) {
+  if (sb_format.bits == 16) {
+    unsigned int block = sb_slot_bytes / 2 - 1; /* in 16-bit samples */
+    sb_program_dma16(sb_ring_addr, SB_RING_SLOTS * sb_slot_bytes);
+    sb_writedac(SB_DMA_16_BIT_DAC_AUTO);
+    sb_writedac(SB_MODE_16_BIT_STEREO);
+    sb_writedac(block & 0xFF);
+    sb_writedac(block >> 8);
+    sb_autoinit_running = 1;
+    sb_dma_active = 1;
+    return;
+  }
+  sb_program_dma(sb_ring_addr, SB_RING_SLOTS * DMA_CHUNK, 0x59);
+
+  sb_writedac(SB_SET_BLOCKSIZE); /* interrupt after every slot */
+  sb_writedac((DMA_CHUNK - 1) & 0xFF);
+  sb_writedac((DMA_CHUNK - 1) >> 8);
+  sb_writedac(SB_DMA_8_BIT_DAC_AUTO);
+
+  sb_autoinit_running = 1;
+  sb_dma_active = 1;
+}
+
 /* Set sampling/playback rate.
  * Parameter is rate in Hz (samples per second).
  */
@@ -209,6 +319,14 @@ void sb_set_sample_rate(unsigned int rate) {
   sb_writedac(tc);               /* Sample rate time constant */
 }
 
+/* Set the output rate directly in Hz, DSP 4.x only */
+void sb_set_output_rate(unsigned int rate) {
+  HIGHSPEED = 0;
+  sb_writedac(SB_SET_OUTPUT_RATE);
+  sb_writedac(HIBYTE(rate));
+  sb_writedac(LOWBYTE(rate));
+}
+
 void sb_voice(int state) {
   sb_writedac(state ? SB_SPEAKER_ON : SB_SPEAKER_OFF);
 }
@@ -324,7 +442,7 @@ void sb_install_interrupts(void (*sb_intr)(_go32_dpmi_registers *)) {
 void sb_install_rm_interrupt(void (*sb_intr)(_go32_dpmi_registers *)) {
   int ret;
 
-  rm_si.pm_offset = (int)sb_intr;
+  rm_si.pm_offset = (unsigned long)sb_intr;
   ret = _go32_dpmi_allocate_real_mode_callback_iret(&rm_si, &rm_regs);
   if (ret != 0) {
     printf("cannot allocate real mode callback, error=%04x\n", ret);
@@ -354,7 +472,7 @@ void sb_install_pm_interrupt(void (*sb_intr)(_go32_dpmi_registers *)) {
   int ret;
   disable();
 
-  pm_si.pm_offset = (int)sb_intr;
+  pm_si.pm_offset = (unsigned long)sb_intr;
   /* changes to wrap by grzegorz */
   ret = _go32_dpmi_allocate_iret_wrapper(&pm_si);
   if (ret != 0) {
@@ -380,25 +498,39 @@ void sb_cleanup_pm_interrupt() {
   enable();
 }
 
-/* Allocate conventional memory for our DMA buffers.
- * Each DMA buffer must be aligned on a 64K boundary in physical memory. */
+/* Allocate conventional memory for the DMA ring.
+ * The ring must not cross a 64K boundary in physical memory, so we allocate
+ * enough to start it on the next one. */
 int sb_init_buffers() {
-  dosmem.size = 65536 * 3 / 16;
+  unsigned long ring_bytes = SB_RING_SLOTS * sb_slot_bytes;
+  if (sb_format.bits == 8)
+    ring_bytes += DMA_CHUNK; /* the silence block */
+  dosmem.size = (65536 + ring_bytes) / 16;
   if (_go32_dpmi_allocate_dos_memory(&dosmem)) {
     printf("Unable to allocate dos memory - max size is %lu\n", dosmem.size);
     dosmem.size = -1;
     return (0);
   }
 
-  unsigned long sb_buf_aux[2];
-
-  sb_buf_aux[0] = dosmem.rm_segment * 16;
-  sb_buf_aux[0] += 0x0FFFFL;
-  sb_buf_aux[0] &= 0xFFFF0000L;
-  sb_buf_aux[1] = sb_buf_aux[0] + 0x10000;
-  memcpy(sb_buf, sb_buf_aux, sizeof(sb_buf_aux));
+  sb_ring_addr = dosmem.rm_segment * 16;
+  sb_ring_addr += 0x0FFFFL;
+  sb_ring_addr &= 0xFFFF0000L;
   return (1);
 }
+/* Pick the output format: 16-bit stereo on DSP 4.x (SB16) if BLASTER names
+ * a high DMA channel, 8-bit mono on everything else. */
+static void sb_negotiate_format(void) {
+  sb_dsp_version(&sb_dsp_major, &sb_dsp_minor);
+  if (sb_dsp_major >= 4 && sb_dmachan16 >= 5 && sb_dmachan16 <= 7) {
+    sb_format.bits = 16;
+    sb_format.channels = 2;
+  } else {
+    sb_format.bits = 8;
+    sb_format.channels = 1;
+  }
+  sb_slot_bytes = DMA_CHUNK * (sb_format.bits / 8) * sb_format.channels;
+}
+
 /* Initliaze our internal buffers and the card itself to prepare
  * for sample playing.
  *
@@ -412,6 +544,8 @@ int sb_init() {
 
   sb_getparams(); /* Card card params and initialize card. */
   sb_initcard();
+  if (sb_ioaddr)
+    sb_negotiate_format();
 
   if (sb_ioaddr)
     /* Allocate buffers in conventional memory for double-buffering */
@@ -473,41 +607,95 @@ void kbclear(void) {
   dosmemput(&buffer, 2, 0x41c);
 }
 
-void StreamStart(int Rate) {
-  for (int i = 0; i != DMA_CHUNK; ++i) {
-    sb_stream_silence[i] = 128;
-  }
+static void sb_stream_start(int Rate) {
+  /* Unsigned 8-bit samples are silent at 128, signed 16-bit ones at 0 */
+  memset(sb_stream_silence, sb_format.bits == 16 ? 0 : 128, sb_slot_bytes);
+  if (sb_format.bits == 8)
+    dosmemput(sb_stream_silence, DMA_CHUNK, sb_silence_addr());
+  sb_ring_head = sb_ring_tail = 0;
+  sb_silent_blocks = 0;
+  sb_format.rate = Rate;
 
   sb_voice(1);
-  sb_set_sample_rate(Rate);
+  if (sb_format.bits == 16)
+    sb_set_output_rate(Rate);
+  else
+    sb_set_sample_rate(Rate);
+  sb_autoinit = sb_format.bits == 16 || (sb_dsp_major >= 2 && !HIGHSPEED);
 
   // TODO: do we need to do this all the time? Just put it into init func or
   // something
   sb_install_interrupts(sb_intr_play); /* Install our interrupt handlers */
 
-  sb_fill_buffer(0);
-  sb_fill_buffer(1);
-
-  sb_play_buffer(0); /* Start the first buffer playing.	*/
+  if (sb_autoinit) {
+    /* The DSP may play a few samples of a slot before it is paused */
+    for (int i = 0; i != SB_RING_SLOTS; ++i)
+      dosmemput(sb_stream_silence, sb_slot_bytes, sb_slot_addr(i));
+    /* Started by the first StreamReady */
+    sb_autoinit_running = 0;
+    sb_paused = 1;
+  } else {
+    sb_play_next(); /* Start the first block playing. */
+  }
 }
 
-unsigned char *StreamBuf(size_t *len) {
-  if (sb_stream_ready) {
+static unsigned char *sb_stream_get_buf(size_t *len) {
+  if (sb_ring_head - sb_ring_tail >= SB_RING_SLOTS) {
     return 0;
   }
-  *len = DMA_CHUNK;
+  *len = sb_slot_bytes;
   return (unsigned char *)sb_stream_buf;
 }
 
-void StreamReady() { sb_stream_ready = 1; }
+static void sb_stream_ready(void) {
+  if (sb_ring_head - sb_ring_tail >= SB_RING_SLOTS)
+    return;
+  /* Copy first, the interrupt may play the slot as soon as head moves */
+  dosmemput(sb_stream_buf, sb_slot_bytes, sb_slot_addr(sb_ring_head));
+  sb_ring_head++;
+  /* No interrupt comes while paused, so this doesn't race with it */
+  if (sb_paused) {
+    sb_paused = 0;
+    if (sb_autoinit_running) {
+      sb_writedac(sb_format.bits == 16 ? SB_CONTINUE_DMA_16 : SB_CONTINUE_DMA);
+    } else {
+      sb_play_autoinit();
+    }
+  }
+}
 
-void StreamStop() {
-  if (HIGHSPEED)
+static unsigned long sb_stream_silent_blocks(void) {
+  return sb_silent_blocks;
+}
+
+static void sb_stream_get_format(StreamFormat *format) {
+  *format = sb_format;
+}
+
+static void sb_stream_stop(void) {
+  if (HIGHSPEED) {
     sb_reset(); /* writedac blocked in HS mode */
-  else
-    sb_writedac(SB_HALT_DMA);
+  } else {
+    if (sb_autoinit_running) {
+      sb_writedac(sb_format.bits == 16 ? SB_EXIT_AUTO_DMA_16
+                                       : SB_EXIT_AUTO_DMA);
+    }
+    sb_writedac(sb_format.bits == 16 ? SB_HALT_DMA_16 : SB_HALT_DMA);
+  }
+  sb_autoinit_running = 0;
+  sb_paused = 0;
 
-  // TODO: see comment in StreamStart function above
+  // TODO: see comment in sb_stream_start above
   sb_cleanup_ints(); /* remove interrupts */
   sb_voice(0);
 }
+
+const StreamBackend sb_stream_backend = {
+    "sb",
+    sb_stream_start,
+    sb_stream_get_buf,
+    sb_stream_ready,
+    sb_stream_get_format,
+    sb_stream_silent_blocks,
+    sb_stream_stop,
+};
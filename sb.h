@@ -1,10 +1,10 @@
 #ifndef _SB_H_
 #define _SB_H_
 
-#include <dpmi.h>
-#include <go32.h>
+#include "sb_platform.h"
 
 #include "defs.h"
+#include "stream.h"
 
 /*
  * Offsets relative to base I/O address.
@@ -25,6 +25,7 @@
 #define SB_DSP_WRITE_DATA 0x0C
 #define SB_DSP_WRITE_STATUS 0x0C
 #define SB_DSP_DATA_AVAIL 0x0E
+#define SB_DSP_ACK_16 0x0F /* 16-bit interrupt acknowledge, DSP 4.x */
 // #define SB_CD_ROM_DATA 0x10   /* Pro only */
 // #define SB_CD_ROM_STATUS 0x11 /* Pro only */
 // #define SB_CD_ROM_RESET 0x12  /* Pro only */
@@ -56,6 +57,11 @@
 // #define SB_DMA_WRMSK (SB_DMA + 15)
 #define SB_DMAPAGE 0x80
 
+/* Second (16-bit) DMA controller, channels 4-7 */
+#define SB_DMA16_MASK 0xD4
+#define SB_DMA16_MODE 0xD6
+#define SB_DMA16_FF 0xD8
+
 /* Types of Soundblaster Cards */
 // #define SB_TYPE_15 1
 // #define SB_TYPE_PRO 2
@@ -77,7 +83,7 @@
 // #define SB_DMA_26_BIT_DAC 0x76
 // #define SB_DMA_26_BIT_REF_DAC 0x77
 #define SB_HALT_DMA 0xD0
-// #define SB_CONTINUE_DMA 0xD4
+#define SB_CONTINUE_DMA 0xD4
 #define SB_SPEAKER_ON 0xD1
 #define SB_SPEAKER_OFF 0xD3
 // #define SB_DSP_ID 0xE0
@@ -92,6 +98,16 @@
 
 #define SB_SET_BLOCKSIZE 0x48
 #define SB_HIGH_DMA_8_BIT_DAC 0x91
+#define SB_DMA_8_BIT_DAC_AUTO 0x1C /* DSP 2.0+ */
+#define SB_EXIT_AUTO_DMA 0xDA      /* DSP 2.0+ */
+
+/* DSP 4.x (SB16) */
+#define SB_SET_OUTPUT_RATE 0x41
+#define SB_DMA_16_BIT_DAC_AUTO 0xB6 /* followed by mode and length */
+#define SB_MODE_16_BIT_STEREO 0x30  /* signed, stereo */
+#define SB_HALT_DMA_16 0xD5
+#define SB_CONTINUE_DMA_16 0xD6
+#define SB_EXIT_AUTO_DMA_16 0xD9
 // #define SB_HIGH_DMA_8_BIT_ADC 0x99
 
 /* Card parameters */
@@ -102,11 +118,11 @@
 // extern unsigned int sb_type;
 
 void sb_intr_play(_go32_dpmi_registers *reg);
-void sb_fill_buffer(register unsigned n);
-void sb_play_buffer(register unsigned n);
+void sb_play_buffer(unsigned long addr, unsigned int len);
 // void sb_play(unsigned char *data, unsigned long length);
 
 void sb_set_sample_rate(unsigned int rate);
+void sb_set_output_rate(unsigned int rate);
 void sb_voice(int state);
 RESULT sb_getparams();
 int sb_initcard();
@@ -127,9 +143,7 @@ void sb_dsp_version(short *major, short *minor);
 void sb_reset(void);
 void kbclear(void);
 
-void StreamStart(int Rate);
-unsigned char *StreamBuf(size_t *len);
-void StreamReady();
-void StreamStop();
+// The stream on the card, selected by default (see stream.h)
+extern const StreamBackend sb_stream_backend;
 
 #endif
@@ -0,0 +1,17 @@
+#ifndef _SB_PLATFORM_H_
+#define _SB_PLATFORM_H_
+
+/* Everything sb.c needs from the machine: port I/O (INP/OUT in defs.h),
+ * conventional memory and interrupt handlers. DJGPP provides the real thing,
+ * other hosts get the simulated Sound Blaster of sbsim.c behind the same
+ * names. */
+#ifdef __DJGPP__
+#include <dos.h>
+#include <dpmi.h>
+#include <go32.h>
+#include <pc.h>
+#else
+#include "sbsim.h"
+#endif
+
+#endif
@@ -0,0 +1,783 @@
+/* Simulated Sound Blaster, see sbsim.h. DJGPP builds use the real card. */
+#ifndef __DJGPP__
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <time.h>
+
+#include "sbsim.h"
+
+#define SBSIM_SIGNAL SIGUSR1
+#define SBSIM_TICK_NS 1000000L
+#define SBSIM_DOS_FIRST 0x10000UL /* below is DOS itself */
+#define SBSIM_DOS_END 0xA0000UL   /* video memory starts here */
+
+typedef void (*SimHandler)(_go32_dpmi_registers *);
+
+/* Addresses and counts are in transfer units, bytes on the first controller
+ * and words on the second. Writes set both the base and the current value,
+ * auto-init reloads the current one from the base after the last unit. */
+typedef struct SimDmaChannel {
+  uint16_t base_addr, base_count;
+  uint16_t cur_addr, cur_count;
+  uint8_t page, mode;
+  bool masked;
+} SimDmaChannel;
+
+typedef struct SimDmaController {
+  SimDmaChannel chan[4];
+  bool flipflop;
+  bool words;
+} SimDmaController;
+
+typedef struct SimDsp {
+  bool reset_latch;
+  uint8_t out[16]; /* bytes waiting at the read data port */
+  int out_len;
+  uint8_t cmd;
+  int args_needed, args_have;
+  uint8_t args[3];
+  uint8_t major, minor;
+  uint8_t time_constant;
+  unsigned int output_rate; /* 0 while the time constant sets the rate */
+  uint16_t block_size;
+  bool speaker;
+  uint8_t mixer_index;
+  uint8_t mixer[256];
+  /* Current transfer */
+  bool running, paused, auto_init, exit_auto, high_speed;
+  int bits, channels;
+  uint32_t block_bytes, block_left;
+  bool irq8, irq16;
+} SimDsp;
+
+static struct {
+  int ioaddr, irq, dma8, dma16;
+  SimDsp dsp;
+  SimDmaController dma[2];
+  uint8_t pic_mask[2];
+  bool irq_request, in_service;
+  double clock;    /* how far the DSP has played, in seconds */
+  double cpu_time; /* when the port accesses in progress happen */
+  bool in_tick;
+  _go32_dpmi_seginfo pm_vectors[256], rm_vectors[256];
+  unsigned long dos_top;
+  pthread_t main_thread, timer_thread;
+  volatile int timer_running;
+  sigset_t tick_set;
+  SbSimSink sink;
+  void *sink_user;
+  SbSimStats stats;
+  double kbhit_deadline;
+} sim;
+
+static unsigned char sim_dos_memory[0x100000];
+
+static const uint8_t page_ports[8] = {0x87, 0x83, 0x81, 0x82,
+                                      0x8F, 0x8B, 0x89, 0x8A};
+
+static double sim_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Keeps the tick out while the model is changed from the main loop */
+static void sim_lock(sigset_t *old) {
+  pthread_sigmask(SIG_BLOCK, &sim.tick_set, old);
+  if (!sim.in_tick)
+    sim.cpu_time = sim_now();
+}
+
+static void sim_unlock(const sigset_t *old) {
+  pthread_sigmask(SIG_SETMASK, old, NULL);
+}
+
+static int sim_irq_vector(void) {
+  return sim.irq < 8 ? 8 + sim.irq : 0x70 + sim.irq - 8;
+}
+
+/* ---- DMA controllers ---- */
+
+static uint32_t dma_linear(const SimDmaController *c,
+                           const SimDmaChannel *ch) {
+  if (c->words)
+    return ((uint32_t)(ch->page & 0xFE) << 16) | ((uint32_t)ch->cur_addr << 1);
+  return ((uint32_t)ch->page << 16) | ch->cur_addr;
+}
+
+/* Reads len bytes for the DSP. A masked channel, or a single-cycle one past
+ * its last unit, doesn't answer and the DSP plays silence. */
+static void dma_transfer(int channel, uint8_t *dest, uint32_t len) {
+  SimDmaController *c = &sim.dma[channel >> 2];
+  SimDmaChannel *ch = &c->chan[channel & 3];
+  uint32_t unit = c->words ? 2 : 1;
+  for (uint32_t i = 0; i < len; i += unit) {
+    if (ch->masked) {
+      memset(dest + i, sim.dsp.bits == 16 ? 0 : 0x80, len - i);
+      sim.stats.bytes_starved += len - i;
+      return;
+    }
+    memcpy(dest + i, &sim_dos_memory[dma_linear(c, ch)],
+           len - i < unit ? len - i : unit);
+    ch->cur_addr++;
+    if (ch->cur_count-- == 0) {
+      if (ch->mode & 0x10) {
+        ch->cur_addr = ch->base_addr;
+        ch->cur_count = ch->base_count;
+      } else {
+        ch->masked = true;
+      }
+    }
+  }
+}
+
+static void dma_write(SimDmaController *c, int reg, uint8_t value) {
+  if (reg < 8) {
+    SimDmaChannel *ch = &c->chan[reg >> 1];
+    uint16_t *base = reg & 1 ? &ch->base_count : &ch->base_addr;
+    uint16_t *cur = reg & 1 ? &ch->cur_count : &ch->cur_addr;
+    if (c->flipflop)
+      *base = (*base & 0x00FF) | value << 8;
+    else
+      *base = (*base & 0xFF00) | value;
+    *cur = *base;
+    c->flipflop = !c->flipflop;
+    return;
+  }
+  switch (reg) {
+  case 10: /* single mask */
+    c->chan[value & 3].masked = value & 4;
+    break;
+  case 11: /* mode */
+    c->chan[value & 3].mode = value;
+    break;
+  case 12: /* clear flip-flop */
+    c->flipflop = false;
+    break;
+  case 13: /* master clear */
+    for (int i = 0; i != 4; ++i)
+      c->chan[i].masked = true;
+    c->flipflop = false;
+    break;
+  case 14: /* clear all masks */
+    for (int i = 0; i != 4; ++i)
+      c->chan[i].masked = false;
+    break;
+  case 15: /* write all masks */
+    for (int i = 0; i != 4; ++i)
+      c->chan[i].masked = (value >> i) & 1;
+    break;
+  }
+}
+
+static uint8_t dma_read(SimDmaController *c, int reg) {
+  if (reg >= 8)
+    return 0;
+  SimDmaChannel *ch = &c->chan[reg >> 1];
+  uint16_t value = reg & 1 ? ch->cur_count : ch->cur_addr;
+  c->flipflop = !c->flipflop;
+  return c->flipflop ? value & 0xFF : value >> 8;
+}
+
+/* ---- DSP ---- */
+
+static unsigned int dsp_rate(void) {
+  SimDsp *dsp = &sim.dsp;
+  if (dsp->output_rate)
+    return dsp->output_rate;
+  if (dsp->high_speed)
+    return 256000000u / (65536u - ((unsigned int)dsp->time_constant << 8));
+  return 1000000u / (256u - dsp->time_constant);
+}
+
+static double dsp_byte_rate(void) {
+  return (double)dsp_rate() * sim.dsp.channels * (sim.dsp.bits / 8);
+}
+
+/* Moves the clock to t while nothing plays */
+static void sim_idle_until(double t) {
+  if (t <= sim.clock)
+    return;
+  if (sim.dsp.speaker && (!sim.dsp.running || sim.dsp.paused))
+    sim.stats.stall_ns += (unsigned long long)((t - sim.clock) * 1e9);
+  sim.clock = t;
+}
+
+static void dsp_push(uint8_t value) {
+  if (sim.dsp.out_len < (int)sizeof(sim.dsp.out))
+    sim.dsp.out[sim.dsp.out_len++] = value;
+}
+
+static void dsp_reset(void) {
+  SimDsp *dsp = &sim.dsp;
+  sim_idle_until(sim.cpu_time);
+  dsp->running = dsp->paused = dsp->high_speed = false;
+  dsp->speaker = false;
+  dsp->irq8 = dsp->irq16 = false;
+  dsp->args_needed = dsp->args_have = 0;
+  dsp->out_len = 0;
+  dsp_push(0xAA);
+}
+
+static void dsp_start(int bits, int channels, uint32_t bytes, bool auto_init,
+                      bool high_speed) {
+  SimDsp *dsp = &sim.dsp;
+  sim_idle_until(sim.cpu_time);
+  dsp->bits = bits;
+  dsp->channels = channels;
+  dsp->block_bytes = dsp->block_left = bytes;
+  dsp->auto_init = auto_init;
+  dsp->high_speed = high_speed;
+  dsp->exit_auto = false;
+  dsp->paused = false;
+  dsp->running = true;
+}
+
+static int dsp_command_args(uint8_t cmd) {
+  switch (cmd) {
+  case 0x10: /* direct DAC */
+  case 0x40: /* time constant */
+  case 0xE0: /* identification */
+    return 1;
+  case 0x14: /* 8-bit single-cycle */
+  case 0x41: /* output rate */
+  case 0x42: /* input rate */
+  case 0x48: /* block size */
+    return 2;
+  }
+  if (cmd >= 0xB0 && cmd <= 0xCF) /* SB16 transfers: mode, length */
+    return 3;
+  return 0;
+}
+
+static void dsp_execute(void) {
+  SimDsp *dsp = &sim.dsp;
+  const uint8_t *a = dsp->args;
+  switch (dsp->cmd) {
+  case 0x14:
+    dsp_start(8, 1, (a[0] | a[1] << 8) + 1u, false, false);
+    break;
+  case 0x1C:
+    dsp_start(8, 1, dsp->block_size + 1u, true, false);
+    break;
+  case 0x90:
+  case 0x91:
+    dsp_start(8, 1, dsp->block_size + 1u, dsp->cmd == 0x90, true);
+    break;
+  case 0x40:
+    dsp->time_constant = a[0];
+    dsp->output_rate = 0;
+    break;
+  case 0x41:
+  case 0x42:
+    dsp->output_rate = a[0] << 8 | a[1];
+    break;
+  case 0x48:
+    dsp->block_size = a[0] | a[1] << 8;
+    break;
+  case 0xD0:
+  case 0xD5:
+    dsp->paused = true;
+    break;
+  case 0xD4:
+  case 0xD6:
+    if (dsp->paused) {
+      sim_idle_until(sim.cpu_time);
+      dsp->paused = false;
+    }
+    break;
+  case 0xD1:
+    dsp->speaker = true;
+    break;
+  case 0xD3:
+    dsp->speaker = false;
+    break;
+  case 0xD8:
+    dsp_push(dsp->speaker ? 0xFF : 0x00);
+    break;
+  case 0xD9:
+  case 0xDA:
+    dsp->exit_auto = true;
+    break;
+  case 0xE0:
+    dsp_push(~a[0]);
+    break;
+  case 0xE1:
+    dsp_push(dsp->major);
+    dsp_push(dsp->minor);
+    break;
+  default:
+    /* Playback only, bit 3 asks for recording */
+    if (dsp->cmd >= 0xB0 && dsp->cmd <= 0xCF && !(dsp->cmd & 0x08)) {
+      int bits = dsp->cmd < 0xC0 ? 16 : 8;
+      uint32_t samples = (a[1] | a[2] << 8) + 1u;
+      dsp_start(bits, a[0] & 0x20 ? 2 : 1, samples * (bits / 8),
+                dsp->cmd & 0x04, false);
+    }
+    break;
+  }
+}
+
+static void dsp_write(uint8_t value) {
+  SimDsp *dsp = &sim.dsp;
+  /* High speed mode ignores commands until the next reset */
+  if (dsp->running && dsp->high_speed)
+    return;
+  if (dsp->args_have < dsp->args_needed) {
+    dsp->args[dsp->args_have++] = value;
+  } else {
+    dsp->cmd = value;
+    dsp->args_needed = dsp_command_args(value);
+    dsp->args_have = 0;
+  }
+  if (dsp->args_have == dsp->args_needed)
+    dsp_execute();
+}
+
+static uint8_t dsp_read(void) {
+  SimDsp *dsp = &sim.dsp;
+  if (dsp->out_len == 0)
+    return 0xFF;
+  uint8_t value = dsp->out[0];
+  memmove(dsp->out, dsp->out + 1, --dsp->out_len);
+  return value;
+}
+
+static void dsp_block_done(void) {
+  SimDsp *dsp = &sim.dsp;
+  if (dsp->bits == 16)
+    dsp->irq16 = true;
+  else
+    dsp->irq8 = true;
+  sim.irq_request = true;
+  if (dsp->auto_init && !dsp->exit_auto)
+    dsp->block_left = dsp->block_bytes;
+  else
+    dsp->running = false;
+}
+
+/* ---- Interrupts and the clock ---- */
+
+/* Calls the handler if the IRQ is raised, unmasked and not in service. The
+ * handler runs at the simulated time the block ended. */
+static void sim_deliver_irq(double now) {
+  if (!sim.irq_request || sim.in_service ||
+      (sim.pic_mask[sim.irq >> 3] >> (sim.irq & 7)) & 1)
+    return;
+  SimHandler handler =
+      (SimHandler)(uintptr_t)sim.pm_vectors[sim_irq_vector()].pm_offset;
+  if (handler == NULL)
+    return;
+  sim.irq_request = false;
+  sim.in_service = true;
+
+  unsigned long long latency = (unsigned long long)((now - sim.clock) * 1e9);
+  if (latency > sim.stats.latency_ns_max)
+    sim.stats.latency_ns_max = latency;
+  double start = sim_now();
+  sim.cpu_time = sim.clock;
+  handler(NULL);
+  unsigned long long spent = (unsigned long long)((sim_now() - start) * 1e9);
+  sim.stats.irqs++;
+  sim.stats.isr_ns_total += spent;
+  if (spent > sim.stats.isr_ns_max)
+    sim.stats.isr_ns_max = spent;
+}
+
+/* Plays everything due until now, interrupting at the end of each block */
+static void sim_advance(double now) {
+  SimDsp *dsp = &sim.dsp;
+  uint8_t buffer[4096];
+  sim_deliver_irq(now);
+  for (;;) {
+    if (!dsp->running || dsp->paused) {
+      sim_idle_until(now);
+      return;
+    }
+    double byte_rate = dsp_byte_rate();
+    uint32_t frame = dsp->channels * (dsp->bits / 8);
+    double due = (now - sim.clock) * byte_rate;
+    uint32_t n = due < dsp->block_left ? (uint32_t)due : dsp->block_left;
+    if (n > sizeof(buffer))
+      n = sizeof(buffer);
+    if (n != dsp->block_left)
+      n -= n % frame;
+    if (n == 0)
+      return;
+
+    dma_transfer(dsp->bits == 16 ? sim.dma16 : sim.dma8, buffer, n);
+    sim.stats.bytes_played += n;
+    if (sim.sink != NULL)
+      sim.sink(sim.sink_user, buffer, n, dsp->bits, dsp->channels,
+               dsp_rate());
+    sim.clock += n / byte_rate;
+    dsp->block_left -= n;
+    if (dsp->block_left == 0) {
+      dsp_block_done();
+      sim_deliver_irq(now);
+    }
+  }
+}
+
+static void sim_tick(int sig) {
+  (void)sig;
+  /* The handler may enable interrupts while we are still in here */
+  if (sim.in_tick)
+    return;
+  int saved_errno = errno;
+  sim.in_tick = true;
+  sim_advance(sim_now());
+  sim.in_tick = false;
+  errno = saved_errno;
+}
+
+static void *sim_timer(void *arg) {
+  (void)arg;
+  struct timespec tick = {0, SBSIM_TICK_NS};
+  while (sim.timer_running) {
+    nanosleep(&tick, NULL);
+    pthread_kill(sim.main_thread, SBSIM_SIGNAL);
+  }
+  return NULL;
+}
+
+static void sim_timer_start(void) {
+  if (sim.timer_running)
+    return;
+  sim.timer_running = 1;
+  if (pthread_create(&sim.timer_thread, NULL, sim_timer, NULL) != 0) {
+    fprintf(stderr, "sbsim: cannot start the timer thread\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void sim_timer_stop(void) {
+  if (!sim.timer_running)
+    return;
+  sim.timer_running = 0;
+  pthread_join(sim.timer_thread, NULL);
+}
+
+/* ---- Ports ---- */
+
+unsigned char inportb(unsigned short port) {
+  sigset_t old;
+  uint8_t value = 0xFF;
+  sim_lock(&old);
+  if (port >= sim.ioaddr && port < sim.ioaddr + 0x10) {
+    switch (port - sim.ioaddr) {
+    case 0x05:
+      if (sim.dsp.mixer_index == 0x82)
+        value = sim.dsp.irq8 | sim.dsp.irq16 << 1;
+      else
+        value = sim.dsp.mixer[sim.dsp.mixer_index];
+      break;
+    case 0x0A:
+      value = dsp_read();
+      break;
+    case 0x0C:
+      value = 0x7F; /* always ready for the next byte */
+      break;
+    case 0x0E:
+      sim.dsp.irq8 = false;
+      value = sim.dsp.out_len ? 0xFF : 0x7F;
+      break;
+    case 0x0F:
+      sim.dsp.irq16 = false;
+      break;
+    }
+  } else if (port < 0x10) {
+    value = dma_read(&sim.dma[0], port);
+  } else if (port >= 0xC0 && port < 0xE0 && !(port & 1)) {
+    value = dma_read(&sim.dma[1], (port - 0xC0) >> 1);
+  } else if (port == 0x21 || port == 0xA1) {
+    value = sim.pic_mask[port == 0xA1];
+  }
+  sim_unlock(&old);
+  return value;
+}
+
+void outportb(unsigned short port, unsigned char data) {
+  sigset_t old;
+  sim_lock(&old);
+  if (port >= sim.ioaddr && port < sim.ioaddr + 0x10) {
+    switch (port - sim.ioaddr) {
+    case 0x04:
+      sim.dsp.mixer_index = data;
+      break;
+    case 0x05:
+      sim.dsp.mixer[sim.dsp.mixer_index] = data;
+      break;
+    case 0x06:
+      if (data & 1)
+        sim.dsp.reset_latch = true;
+      else if (sim.dsp.reset_latch) {
+        sim.dsp.reset_latch = false;
+        dsp_reset();
+      }
+      break;
+    case 0x0C:
+      dsp_write(data);
+      break;
+    }
+  } else if (port < 0x10) {
+    dma_write(&sim.dma[0], port, data);
+  } else if (port >= 0xC0 && port < 0xE0 && !(port & 1)) {
+    dma_write(&sim.dma[1], (port - 0xC0) >> 1, data);
+  } else if (port == 0x20 || port == 0xA0) {
+    if ((data & 0xE0) == 0x20 || (data & 0xE0) == 0x60) /* EOI */
+      sim.in_service = false;
+  } else if (port == 0x21 || port == 0xA1) {
+    sim.pic_mask[port == 0xA1] = data;
+  } else {
+    for (int i = 0; i != 8; ++i)
+      if (port == page_ports[i])
+        sim.dma[i >> 2].chan[i & 3].page = data;
+  }
+  sim_unlock(&old);
+}
+
+/* ---- Memory and interrupt vectors ---- */
+
+void dosmemget(unsigned long offset, size_t length, void *buffer) {
+  if (offset < sizeof(sim_dos_memory) &&
+      length <= sizeof(sim_dos_memory) - offset)
+    memcpy(buffer, &sim_dos_memory[offset], length);
+}
+
+void dosmemput(const void *buffer, size_t length, unsigned long offset) {
+  if (offset < sizeof(sim_dos_memory) &&
+      length <= sizeof(sim_dos_memory) - offset)
+    memcpy(&sim_dos_memory[offset], buffer, length);
+}
+
+int disable(void) {
+  sigset_t old;
+  pthread_sigmask(SIG_BLOCK, &sim.tick_set, &old);
+  return !sigismember(&old, SBSIM_SIGNAL);
+}
+
+int enable(void) {
+  sigset_t old;
+  pthread_sigmask(SIG_UNBLOCK, &sim.tick_set, &old);
+  return !sigismember(&old, SBSIM_SIGNAL);
+}
+
+/* Memory is handed out from the bottom up, only the last block is really
+ * freed */
+int _go32_dpmi_allocate_dos_memory(_go32_dpmi_seginfo *info) {
+  if (info->size > (SBSIM_DOS_END - sim.dos_top) / 16) {
+    info->size = (SBSIM_DOS_END - sim.dos_top) / 16;
+    return 8; /* insufficient memory, as DOS says */
+  }
+  info->rm_segment = sim.dos_top / 16;
+  info->rm_offset = 0;
+  info->pm_selector = 0;
+  sim.dos_top += info->size * 16;
+  return 0;
+}
+
+int _go32_dpmi_free_dos_memory(_go32_dpmi_seginfo *info) {
+  if ((info->rm_segment + info->size) * 16 == sim.dos_top)
+    sim.dos_top = info->rm_segment * 16UL;
+  return 0;
+}
+
+/* Only protected mode handlers are called, real mode ones are just kept */
+int _go32_dpmi_allocate_real_mode_callback_iret(_go32_dpmi_seginfo *info,
+                                                _go32_dpmi_registers *regs) {
+  (void)regs;
+  info->size = 0;
+  info->rm_segment = 0xF000;
+  info->rm_offset = 0;
+  return 0;
+}
+
+int _go32_dpmi_free_real_mode_callback(_go32_dpmi_seginfo *info) {
+  (void)info;
+  return 0;
+}
+
+int _go32_dpmi_get_real_mode_interrupt_vector(int vector,
+                                              _go32_dpmi_seginfo *info) {
+  *info = sim.rm_vectors[vector & 0xFF];
+  return 0;
+}
+
+int _go32_dpmi_set_real_mode_interrupt_vector(int vector,
+                                              _go32_dpmi_seginfo *info) {
+  sim.rm_vectors[vector & 0xFF] = *info;
+  return 0;
+}
+
+/* The handler is called directly, pm_offset stays its address */
+int _go32_dpmi_allocate_iret_wrapper(_go32_dpmi_seginfo *info) {
+  info->size = 0;
+  return 0;
+}
+
+int _go32_dpmi_free_iret_wrapper(_go32_dpmi_seginfo *info) {
+  (void)info;
+  return 0;
+}
+
+unsigned short _go32_my_cs(void) { return 0; }
+
+int _go32_dpmi_get_protected_mode_interrupt_vector(int vector,
+                                                   _go32_dpmi_seginfo *info) {
+  *info = sim.pm_vectors[vector & 0xFF];
+  return 0;
+}
+
+/* The clock only runs while a handler for the card's IRQ is installed */
+int _go32_dpmi_set_protected_mode_interrupt_vector(int vector,
+                                                   _go32_dpmi_seginfo *info) {
+  sigset_t old;
+  sim_lock(&old);
+  sim.pm_vectors[vector & 0xFF] = *info;
+  if (vector == sim_irq_vector()) {
+    if (info->pm_offset != 0) {
+      sim_idle_until(sim.cpu_time);
+      sim_timer_start();
+    } else {
+      sim_timer_stop();
+    }
+  }
+  sim_unlock(&old);
+  return 0;
+}
+
+int kbhit(void) {
+  const char *seconds = getenv("SBSIM_SECONDS");
+  if (seconds != NULL) {
+    if (sim.kbhit_deadline == 0)
+      sim.kbhit_deadline = sim_now() + atof(seconds);
+    return sim_now() >= sim.kbhit_deadline;
+  }
+  fd_set fds;
+  struct timeval timeout = {0, 0};
+  FD_ZERO(&fds);
+  FD_SET(0, &fds);
+  return select(1, &fds, NULL, NULL, &timeout) > 0;
+}
+
+/* ---- Setup and statistics ---- */
+
+void sbsim_set_sink(SbSimSink sink, void *user) {
+  sigset_t old;
+  sim_lock(&old);
+  sim.sink = sink;
+  sim.sink_user = user;
+  sim_unlock(&old);
+}
+
+void sbsim_get_stats(SbSimStats *stats) {
+  sigset_t old;
+  sim_lock(&old);
+  *stats = sim.stats;
+  sim_unlock(&old);
+}
+
+void sbsim_reset_stats(void) {
+  sigset_t old;
+  sim_lock(&old);
+  memset(&sim.stats, 0, sizeof(sim.stats));
+  sim_unlock(&old);
+}
+
+void sbsim_set_dsp_version(unsigned int major, unsigned int minor) {
+  sigset_t old;
+  sim_lock(&old);
+  sim.dsp.major = major;
+  sim.dsp.minor = minor;
+  sim_unlock(&old);
+}
+
+static void sbsim_report(void) {
+  sim_timer_stop();
+  if (sim.stats.irqs == 0)
+    return;
+  fprintf(stderr,
+          "sbsim: %llu interrupts, handler %.1f us avg %.1f us max, latency "
+          "%.1f us max\n"
+          "sbsim: %llu bytes played, %llu starved, %.1f ms stalled\n",
+          sim.stats.irqs, sim.stats.isr_ns_total / 1e3 / sim.stats.irqs,
+          sim.stats.isr_ns_max / 1e3, sim.stats.latency_ns_max / 1e3,
+          sim.stats.bytes_played, sim.stats.bytes_starved,
+          sim.stats.stall_ns / 1e6);
+}
+
+static void sbsim_parse_blaster(const char *blaster) {
+  char *copy = strdup(blaster);
+  if (copy == NULL)
+    return;
+  for (char *tok = strtok(copy, " "); tok != NULL; tok = strtok(NULL, " ")) {
+    switch (tok[0]) {
+    case 'A':
+    case 'a':
+      sim.ioaddr = (int)strtol(tok + 1, NULL, 16);
+      break;
+    case 'I':
+    case 'i':
+      sim.irq = atoi(tok + 1) & 15;
+      break;
+    case 'D':
+    case 'd':
+      sim.dma8 = atoi(tok + 1) & 3;
+      break;
+    case 'H':
+    case 'h':
+      sim.dma16 = atoi(tok + 1) & 7;
+      break;
+    }
+  }
+  free(copy);
+}
+
+__attribute__((constructor)) static void sbsim_setup(void) {
+  unsigned int major = 4, minor = 5;
+  const char *version = getenv("SBSIM_DSP");
+  if (getenv("BLASTER") == NULL)
+    setenv("BLASTER", "A220 I5 D1 H5 T6", 0);
+  sim.ioaddr = 0x220;
+  sim.irq = 5;
+  sim.dma8 = 1;
+  sim.dma16 = 5;
+  sbsim_parse_blaster(getenv("BLASTER"));
+  if (version != NULL)
+    sscanf(version, "%u.%u", &major, &minor);
+  sim.dsp.major = major;
+  sim.dsp.minor = minor;
+  sim.dsp.time_constant = 0x83; /* about 8000 Hz */
+  sim.dsp.bits = 8;
+  sim.dsp.channels = 1;
+
+  sim.dma[1].words = true;
+  for (int i = 0; i != 8; ++i)
+    sim.dma[i >> 2].chan[i & 3].masked = true;
+  sim.pic_mask[0] = 0xB8;
+  sim.pic_mask[1] = 0xFF;
+  sim.dos_top = SBSIM_DOS_FIRST;
+  sim.clock = sim_now();
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = sim_tick;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  sigaction(SBSIM_SIGNAL, &action, NULL);
+  sigemptyset(&sim.tick_set);
+  sigaddset(&sim.tick_set, SBSIM_SIGNAL);
+  sim.main_thread = pthread_self();
+  atexit(sbsim_report);
+}
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef _SBSIM_H_
+#define _SBSIM_H_
+
+/* Simulated Sound Blaster for running the sound code on a normal host.
+ *
+ * The DJGPP calls sb.c makes are provided under their own names: port I/O
+ * goes to a model of the DSP, the two 8237 DMA controllers and the PIC,
+ * conventional memory is a 1M array, and interrupt handlers are installed in
+ * a table of protected mode vectors.
+ *
+ * While a handler is installed, a timer thread signals the main thread every
+ * millisecond. The signal handler lets the DSP catch up with the wall clock:
+ * it reads the DMA channel at the programmed rate, and at the end of every
+ * block raises the IRQ and calls the handler right there, preempting the
+ * main loop like the real interrupt would. disable() and enable() block and
+ * unblock that signal.
+ *
+ * The card is set up from BLASTER (set to "A220 I5 D1 H5 T6" if it's
+ * missing) and SBSIM_DSP, the DSP version as in "4.05" (the default). */
+
+#include <stddef.h>
+
+typedef struct _go32_dpmi_registers {
+  unsigned long edi, esi, ebp, res, ebx, edx, ecx, eax;
+  unsigned short flags, es, ds, fs, gs, ip, cs, sp, ss;
+} _go32_dpmi_registers;
+
+typedef struct _go32_dpmi_seginfo {
+  unsigned long size; /* in paragraphs for DOS memory */
+  unsigned long pm_offset;
+  unsigned short pm_selector;
+  unsigned short rm_offset;
+  unsigned short rm_segment;
+} _go32_dpmi_seginfo;
+
+unsigned char inportb(unsigned short port);
+void outportb(unsigned short port, unsigned char data);
+
+void dosmemget(unsigned long offset, size_t length, void *buffer);
+void dosmemput(const void *buffer, size_t length, unsigned long offset);
+
+/* Return non-zero if interrupts were enabled before the call */
+int disable(void);
+int enable(void);
+
+int _go32_dpmi_allocate_dos_memory(_go32_dpmi_seginfo *info);
+int _go32_dpmi_free_dos_memory(_go32_dpmi_seginfo *info);
+
+int _go32_dpmi_allocate_real_mode_callback_iret(_go32_dpmi_seginfo *info,
+                                                _go32_dpmi_registers *regs);
+int _go32_dpmi_free_real_mode_callback(_go32_dpmi_seginfo *info);
+int _go32_dpmi_get_real_mode_interrupt_vector(int vector,
+                                              _go32_dpmi_seginfo *info);
+int _go32_dpmi_set_real_mode_interrupt_vector(int vector,
+                                              _go32_dpmi_seginfo *info);
+
+int _go32_dpmi_allocate_iret_wrapper(_go32_dpmi_seginfo *info);
+int _go32_dpmi_free_iret_wrapper(_go32_dpmi_seginfo *info);
+unsigned short _go32_my_cs(void);
+int _go32_dpmi_get_protected_mode_interrupt_vector(int vector,
+                                                   _go32_dpmi_seginfo *info);
+int _go32_dpmi_set_protected_mode_interrupt_vector(int vector,
+                                                   _go32_dpmi_seginfo *info);
+
+/* Polls stdin. If SBSIM_SECONDS is set, it ignores stdin and reports a key
+ * press once that many seconds have passed since the first call. */
+int kbhit(void);
+
+typedef struct SbSimStats {
+  unsigned long long irqs;           /* handler calls */
+  unsigned long long isr_ns_total;   /* time spent in the handler */
+  unsigned long long isr_ns_max;
+  unsigned long long latency_ns_max; /* from the end of a block to its IRQ */
+  unsigned long long bytes_played;   /* read from DMA by the DSP */
+  unsigned long long bytes_starved;  /* wanted while the channel was masked */
+  unsigned long long stall_ns;       /* speaker on, but no transfer running */
+} SbSimStats;
+
+/* Receives everything the DSP plays, bits is 8 (unsigned) or 16 (signed),
+ * called from the simulated interrupt */
+typedef void (*SbSimSink)(void *user, const unsigned char *data, size_t len,
+                          int bits, int channels, unsigned int rate);
+
+void sbsim_set_sink(SbSimSink sink, void *user);
+void sbsim_get_stats(SbSimStats *stats);
+void sbsim_reset_stats(void);
+/* Changes the version the DSP reports, as SBSIM_DSP does at startup. Takes
+ * effect at the next sb_init. */
+void sbsim_set_dsp_version(unsigned int major, unsigned int minor);
+
+#endif
@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "sb.h"
+#include "stream.h"
+
+typedef PACKED_STRUCT WavHeader {
+  char riff[4];
+  uint32 riff_size;
+  char wave[4];
+  char fmt[4];
+  uint32 fmt_size;
+  uint16 format_tag; // 1 for PCM
+  uint16 channels;
+  uint32 rate;
+  uint32 byte_rate;
+  uint16 block_align;
+  uint16 bits;
+  char data[4];
+  uint32 data_size;
+}
+WavHeader;
+
+static const StreamBackend *backend = &sb_stream_backend;
+
+/* The WAV and null backends share the format, the buffer and the counters */
+static StreamFormat sink_format;
+static unsigned char sink_buf[STREAM_CHUNK_FRAMES * 4];
+static unsigned long long frames_written;
+static unsigned long sink_silent_blocks;
+
+static size_t sink_chunk_bytes(void) {
+  return STREAM_CHUNK_FRAMES * (sink_format.bits / 8) * sink_format.channels;
+}
+
+static void sink_set_format(int bits, int channels) {
+  sink_format.bits = bits == 8 ? 8 : 16;
+  sink_format.channels = channels == 1 ? 1 : 2;
+  sink_format.rate = 0;
+}
+
+static unsigned char *sink_buf_get(size_t *len) {
+  *len = sink_chunk_bytes();
+  return sink_buf;
+}
+
+static void sink_get_format(StreamFormat *format) { *format = sink_format; }
+
+static unsigned long sink_silent(void) { return sink_silent_blocks; }
+
+/* ---- WAV file ---- */
+
+static FILE *wav_file = NULL;
+static int wav_failed;
+
+static void wav_write_header(void) {
+  uint32 frame_bytes = (sink_format.bits / 8) * sink_format.channels;
+  uint32 data_size = (uint32)(frames_written * frame_bytes);
+  WavHeader header = {{'R', 'I', 'F', 'F'},
+                      sizeof(WavHeader) - 8 + data_size,
+                      {'W', 'A', 'V', 'E'},
+                      {'f', 'm', 't', ' '},
+                      16,
+                      1,
+                      sink_format.channels,
+                      sink_format.rate,
+                      sink_format.rate * frame_bytes,
+                      frame_bytes,
+                      sink_format.bits,
+                      {'d', 'a', 't', 'a'},
+                      data_size};
+  if (fseek(wav_file, 0, SEEK_SET) != 0 ||
+      fwrite(&header, sizeof(header), 1, wav_file) != 1)
+    wav_failed = 1;
+}
+
+static void wav_start(int rate) {
+  sink_format.rate = rate;
+  frames_written = 0;
+  sink_silent_blocks = 0;
+  if (wav_file != NULL)
+    wav_write_header(); /* rewritten with the sizes by StreamStop */
+}
+
+static void wav_ready(void) {
+  size_t bytes = sink_chunk_bytes();
+  if (wav_file != NULL && fwrite(sink_buf, 1, bytes, wav_file) != bytes)
+    wav_failed = 1;
+  frames_written += STREAM_CHUNK_FRAMES;
+}
+
+static void wav_stop(void) {
+  if (wav_file == NULL)
+    return;
+  wav_write_header();
+  if (fclose(wav_file) != 0)
+    wav_failed = 1;
+  wav_file = NULL;
+  if (wav_failed)
+    printf("Writing the WAV file failed\n");
+}
+
+static const StreamBackend wav_backend = {
+    "wav",           wav_start,       sink_buf_get, wav_ready,
+    sink_get_format, sink_silent,     wav_stop,
+};
+
+/* ---- Null sink ---- */
+
+/* In real time the sink plays slots like the card: StreamReady queues one,
+ * and every STREAM_CHUNK_FRAMES frames of wall time one is played, or a
+ * block of silence if none is queued. The clock starts with the first
+ * StreamReady. */
+#define NULL_RING_SLOTS 8
+
+static StreamClock null_clock;
+static unsigned long null_head, null_tail;
+static int null_running;
+static double null_slot_end; /* when the playing slot is done, in seconds */
+
+static double null_now(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static void null_catch_up(void) {
+  double now = null_now();
+  if (!null_running)
+    return;
+  while (null_slot_end <= now) {
+    if (null_tail != null_head)
+      null_tail++;
+    else
+      sink_silent_blocks++;
+    null_slot_end += (double)STREAM_CHUNK_FRAMES / sink_format.rate;
+  }
+}
+
+static void null_start(int rate) {
+  sink_format.rate = rate;
+  frames_written = 0;
+  sink_silent_blocks = 0;
+  null_head = null_tail = 0;
+  null_running = 0;
+}
+
+static unsigned char *null_buf_get(size_t *len) {
+  if (null_clock == STREAM_CLOCK_REALTIME) {
+    null_catch_up();
+    if (null_head - null_tail >= NULL_RING_SLOTS)
+      return NULL;
+  }
+  return sink_buf_get(len);
+}
+
+static void null_ready(void) {
+  frames_written += STREAM_CHUNK_FRAMES;
+  if (null_clock != STREAM_CLOCK_REALTIME)
+    return;
+  null_catch_up();
+  if (null_head - null_tail >= NULL_RING_SLOTS)
+    return;
+  null_head++;
+  if (!null_running) {
+    null_running = 1;
+    null_slot_end =
+        null_now() + (double)STREAM_CHUNK_FRAMES / sink_format.rate;
+  }
+}
+
+static void null_stop(void) { null_running = 0; }
+
+static const StreamBackend null_backend = {
+    "null",          null_start,  null_buf_get, null_ready,
+    sink_get_format, sink_silent, null_stop,
+};
+
+/* ---- Selection ---- */
+
+void stream_use_sb(void) { backend = &sb_stream_backend; }
+
+RESULT stream_use_wav(const char *path, int bits, int channels) {
+  if (wav_file != NULL)
+    fclose(wav_file);
+  wav_file = fopen(path, "wb");
+  CHECKERR(wav_file == NULL, "Can't open %s for writing\n", path);
+  wav_failed = 0;
+  sink_set_format(bits, channels);
+  backend = &wav_backend;
+  return RES_OK;
+onerror:
+  return RES_ERR;
+}
+
+void stream_use_null(int bits, int channels, StreamClock clock) {
+  sink_set_format(bits, channels);
+  null_clock = clock;
+  backend = &null_backend;
+}
+
+RESULT stream_use(const char *spec) {
+  if (strcmp(spec, "sb") == 0) {
+    stream_use_sb();
+  } else if (strncmp(spec, "wav:", 4) == 0) {
+    return stream_use_wav(spec + 4, 16, 2);
+  } else if (strcmp(spec, "null") == 0) {
+    stream_use_null(16, 2, STREAM_CLOCK_FAST);
+  } else {
+    CHECKERR(strcmp(spec, "null:realtime") != 0,
+             "Unknown sound backend %s\n", spec);
+    stream_use_null(16, 2, STREAM_CLOCK_REALTIME);
+  }
+  return RES_OK;
+onerror:
+  return RES_ERR;
+}
+
+const StreamBackend *stream_backend(void) { return backend; }
+
+unsigned long long stream_frames_written(void) { return frames_written; }
+
+void StreamStart(int Rate) { backend->start(Rate); }
+
+unsigned char *StreamBuf(size_t *len) { return backend->buf(len); }
+
+void StreamReady() { backend->ready(); }
+
+void StreamGetFormat(StreamFormat *format) { backend->get_format(format); }
+
+unsigned long StreamSilentBlocks() { return backend->silent_blocks(); }
+
+void StreamStop() { backend->stop(); }
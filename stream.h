@@ -0,0 +1,62 @@
+#ifndef _STREAM_H_
+#define _STREAM_H_
+
+#include <stddef.h>
+
+#include "defs.h"
+
+// Format of the samples StreamBuf hands out. 8-bit samples are unsigned,
+// 16-bit ones signed, stereo frames are left then right.
+typedef struct StreamFormat {
+  int bits;     // 8 or 16
+  int channels; // 1 or 2
+  int rate;     // set by StreamStart
+} StreamFormat;
+
+// Where the stream goes. The Stream* functions below call the selected
+// backend, which may only be changed while the stream is stopped.
+typedef struct StreamBackend {
+  const char *name;
+  void (*start)(int rate);
+  unsigned char *(*buf)(size_t *len);
+  void (*ready)(void);
+  void (*get_format)(StreamFormat *format);
+  unsigned long (*silent_blocks)(void);
+  void (*stop)(void);
+} StreamBackend;
+
+// Frames per buffer of the WAV and null backends, as in a DMA slot
+#define STREAM_CHUNK_FRAMES 2048
+
+typedef enum StreamClock {
+  STREAM_CLOCK_FAST,     // StreamBuf never waits
+  STREAM_CLOCK_REALTIME, // StreamBuf waits like a card playing at the rate
+} StreamClock;
+
+// The Sound Blaster (sb.c), the default. Needs sb_init.
+void stream_use_sb(void);
+// Appends every buffer passed to StreamReady to a WAV file, the header is
+// completed by StreamStop. StreamBuf never waits.
+RESULT stream_use_wav(const char *path, int bits, int channels);
+// Throws the buffers away, counting them
+void stream_use_null(int bits, int channels, StreamClock clock);
+// Takes "sb", "wav:PATH", "null" or "null:realtime", 16-bit stereo for the
+// file and null backends
+RESULT stream_use(const char *spec);
+const StreamBackend *stream_backend(void);
+
+// Frames passed to StreamReady since StreamStart (WAV and null backends)
+unsigned long long stream_frames_written(void);
+
+void StreamStart(int Rate);
+// Returns NULL while all slots of the ring are waiting to be played
+unsigned char *StreamBuf(size_t *len);
+void StreamReady();
+// Valid after sb_init (or selecting another backend), the rate after
+// StreamStart
+void StreamGetFormat(StreamFormat *format);
+// Blocks of silence played because no slot was ready
+unsigned long StreamSilentBlocks();
+void StreamStop();
+
+#endif
@@ -0,0 +1,385 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "synth.h"
+
+#define SYNTH_TABLE_BITS 8
+#define SYNTH_TABLE_SIZE (1 << SYNTH_TABLE_BITS)
+// Noise takes 32 values per period from a longer table, so it only repeats
+// every 128 periods
+#define SYNTH_NOISE_BITS 12
+#define SYNTH_NOISE_STEP_SHIFT (SYNTH_NOISE_BITS - 5)
+#define SYNTH_STEP_MAX 0x80000000u // half the rate
+#define SYNTH_DUTY_MIN (1u << 24)
+#define SYNTH_DUTY_MAX (255u << 24)
+
+enum { ENV_ATTACK, ENV_DECAY, ENV_HOLD, ENV_RELEASE };
+
+static int16 synth_tables[SYNTH_WAVE_COUNT][SYNTH_TABLE_SIZE];
+static int16 synth_noise[1 << SYNTH_NOISE_BITS];
+static bool synth_tables_ready = false;
+
+// 2^(k/12) in 16.16
+static const uint32 synth_semitones[12] = {
+    65536, 69433, 73562, 77936, 82570, 87480, 92682, 98193, 104032, 110218,
+    116772, 123715};
+
+static uint32 synth_rand(uint32 *seed) {
+  *seed = *seed * 1103515245u + 12345u;
+  return *seed >> 8;
+}
+
+static void build_tables(void) {
+  const double pi = 3.14159265358979323846;
+  uint32 seed = 1;
+  for (int i = 0; i < SYNTH_TABLE_SIZE; ++i) {
+    int32 ramp = i * 2 * 32767 / (SYNTH_TABLE_SIZE - 1) - 32767;
+    synth_tables[SYNTH_WAVE_SINE][i] =
+        (int16)lrint(sin(2 * pi * i / SYNTH_TABLE_SIZE) * 32767);
+    synth_tables[SYNTH_WAVE_SAW][i] = (int16)ramp;
+    synth_tables[SYNTH_WAVE_TRIANGLE][i] =
+        (int16)(i < SYNTH_TABLE_SIZE / 2 ? ramp * 2 + 32767 : 32767 - ramp * 2);
+  }
+  for (int i = 0; i < 1 << SYNTH_NOISE_BITS; ++i)
+    synth_noise[i] = (int16)((int32)(synth_rand(&seed) % 65535) - 32767);
+  synth_tables_ready = true;
+}
+
+RESULT synth_init(Synth *synth, uint32 max_frames, unsigned int rate) {
+  if (!synth_tables_ready)
+    build_tables();
+  memset(synth->voices, 0, sizeof(synth->voices));
+  synth->max_frames = max_frames ? max_frames : 1;
+  synth->rate = rate;
+  synth->accum = malloc(synth->max_frames * sizeof(int32));
+  OOMERROR(synth->accum);
+  return RES_OK;
+onoom:
+  exit(EXIT_FAILURE);
+}
+
+void synth_free(Synth *synth) {
+  free(synth->accum);
+  synth->accum = NULL;
+}
+
+static uint32 ms_frames(const Synth *synth, uint16 ms) {
+  return ms * synth->rate / 1000;
+}
+
+static uint32 hz_step(const Synth *synth, uint32 hz) {
+  unsigned long long step = ((unsigned long long)hz << 32) / synth->rate;
+  return step < SYNTH_STEP_MAX ? (uint32)step : SYNTH_STEP_MAX;
+}
+
+// 2 to the power of a few hundredths of an octave, in 8.24 fixed point.
+// Four terms of the series are plenty for SYNTH_SWEEP_MAX.
+static uint32 exp2_small(int32 octaves) {
+  long long y = (long long)octaves * 11629080 >> 24; // ln 2 in .24
+  long long y2 = y * y >> 24, y3 = y2 * y >> 24;
+  return (uint32)((1 << 24) + y + y2 / 2 + y3 / 6);
+}
+
+static uint32 semitones_factor(int semitones) {
+  int octave = semitones >= 0 ? semitones / 12 : -((11 - semitones) / 12);
+  uint32 factor = synth_semitones[semitones - octave * 12];
+  return octave >= 0 ? factor << octave : factor >> -octave;
+}
+
+static void start_stage(SynthVoice *v, int stage, uint32 frames,
+                        int32 target) {
+  v->stage = stage;
+  v->stage_left = frames;
+  if (frames == 0)
+    v->level = target;
+  v->level_delta =
+      frames ? (int32)(((long long)target - v->level) / (long long)frames)
+             : 0;
+}
+
+// The stage is over, the level lands exactly on its target
+static void next_stage(SynthVoice *v) {
+  switch (v->stage) {
+  case ENV_ATTACK:
+    v->level = v->peak;
+    start_stage(v, ENV_DECAY, v->decay_frames, v->sustain);
+    break;
+  case ENV_DECAY:
+    v->level = v->sustain;
+    start_stage(v, ENV_HOLD, v->hold_frames, v->sustain);
+    break;
+  case ENV_HOLD:
+    start_stage(v, ENV_RELEASE, v->release_frames, 0);
+    break;
+  default:
+    v->active = false;
+  }
+}
+
+int synth_play(Synth *synth, const SynthParams *params) {
+  for (int i = 0; i < SYNTH_VOICES; ++i) {
+    SynthVoice *v = &synth->voices[i];
+    if (v->active)
+      continue;
+    int32 sweep = params->sweep;
+    if (sweep > SYNTH_SWEEP_MAX)
+      sweep = SYNTH_SWEEP_MAX;
+    else if (sweep < -SYNTH_SWEEP_MAX)
+      sweep = -SYNTH_SWEEP_MAX;
+    memset(v, 0, sizeof(*v));
+    v->wave = params->wave < SYNTH_WAVE_COUNT ? params->wave
+                                               : SYNTH_WAVE_SQUARE;
+    v->step = hz_step(synth, params->freq);
+    v->step_min = hz_step(synth, params->freq_min);
+    v->sweep = sweep ? exp2_small((int32)((long long)sweep * SYNTH_TICK_FRAMES
+                                          * 65536 / synth->rate))
+                     : 0;
+    v->duty = params->duty ? (uint32)params->duty << 24 : 0x80000000u;
+    v->duty_delta = (int32)((long long)params->duty_sweep * SYNTH_TICK_FRAMES
+                            * (1 << 24) / synth->rate);
+    v->arp_left = params->arp_ms ? ms_frames(synth, params->arp_ms) : 0;
+    v->arp = semitones_factor(params->arp_semitones);
+    v->tick_left = SYNTH_TICK_FRAMES;
+    v->peak = (int32)params->volume << 23;
+    v->sustain = (int32)((long long)v->peak * params->sustain / 255);
+    v->decay_frames = ms_frames(synth, params->decay_ms);
+    v->hold_frames = params->hold_ms == SYNTH_HOLD_FOREVER
+                         ? 0xFFFFFFFFu
+                         : ms_frames(synth, params->hold_ms);
+    v->release_frames = ms_frames(synth, params->release_ms);
+    start_stage(v, ENV_ATTACK, ms_frames(synth, params->attack_ms), v->peak);
+    v->active = v->step > 0;
+    return v->active ? i : -1;
+  }
+  return -1;
+}
+
+void synth_release(Synth *synth, int voice) {
+  if (voice < 0 || voice >= SYNTH_VOICES)
+    return;
+  SynthVoice *v = &synth->voices[voice];
+  if (v->active && v->stage < ENV_RELEASE)
+    start_stage(v, ENV_RELEASE, v->release_frames, 0);
+}
+
+void synth_stop(Synth *synth, int voice) {
+  if (voice >= 0 && voice < SYNTH_VOICES)
+    synth->voices[voice].active = false;
+}
+
+bool synth_playing(const Synth *synth) {
+  for (int i = 0; i < SYNTH_VOICES; ++i)
+    if (synth->voices[i].active)
+      return true;
+  return false;
+}
+
+static void synth_tick(SynthVoice *v) {
+  v->tick_left = SYNTH_TICK_FRAMES;
+  unsigned long long step = v->step;
+  if (v->sweep != 0)
+    step = step * v->sweep >> 24;
+  if (v->arp_left != 0) {
+    if (v->arp_left <= SYNTH_TICK_FRAMES) {
+      v->arp_left = 0;
+      step = step * v->arp >> 16;
+    } else {
+      v->arp_left -= SYNTH_TICK_FRAMES;
+    }
+  }
+  v->step = step < SYNTH_STEP_MAX ? (uint32)step : SYNTH_STEP_MAX;
+  long long duty = (long long)v->duty + v->duty_delta;
+  v->duty = duty < SYNTH_DUTY_MIN   ? SYNTH_DUTY_MIN
+            : duty > SYNTH_DUTY_MAX ? SYNTH_DUTY_MAX
+                                    : (uint32)duty;
+  if (v->step < v->step_min || v->step == 0)
+    v->active = false;
+}
+
+// Adds run frames of the voice to accum. The level moves by level_delta each
+// frame and the gain is its top 15 bits.
+static void render_table(SynthVoice *v, int32 *accum, uint32 run,
+                         const int16 *table, int index_bits,
+                         int step_shift) {
+  uint32 phase = v->phase, step = v->step >> step_shift;
+  int32 level = v->level, delta = v->level_delta;
+  int shift = 32 - index_bits;
+  for (uint32 i = 0; i < run; ++i) {
+    accum[i] += (table[phase >> shift] * (level >> 16)) >> 15;
+    phase += step;
+    level += delta;
+  }
+  v->phase = phase;
+  v->level = level;
+}
+
+static void render_square(SynthVoice *v, int32 *accum, uint32 run) {
+  uint32 phase = v->phase, step = v->step, duty = v->duty;
+  int32 level = v->level, delta = v->level_delta;
+  for (uint32 i = 0; i < run; ++i) {
+    int32 gain = level >> 16;
+    accum[i] += phase < duty ? gain : -gain;
+    phase += step;
+    level += delta;
+  }
+  v->phase = phase;
+  v->level = level;
+}
+
+static void render_voice(SynthVoice *v, int32 *accum, uint32 frames) {
+  uint32 done = 0;
+  while (done < frames && v->active) {
+    if (v->stage_left == 0) {
+      next_stage(v);
+      continue;
+    }
+    if (v->tick_left == 0) {
+      synth_tick(v);
+      continue;
+    }
+    uint32 run = frames - done;
+    if (run > v->stage_left)
+      run = v->stage_left;
+    if (run > v->tick_left)
+      run = v->tick_left;
+    if (v->wave == SYNTH_WAVE_SQUARE)
+      render_square(v, accum + done, run);
+    else if (v->wave == SYNTH_WAVE_NOISE)
+      render_table(v, accum + done, run, synth_noise, SYNTH_NOISE_BITS,
+                   SYNTH_NOISE_STEP_SHIFT);
+    else
+      render_table(v, accum + done, run, synth_tables[v->wave],
+                   SYNTH_TABLE_BITS, 0);
+    done += run;
+    v->stage_left -= run;
+    v->tick_left -= run;
+  }
+}
+
+// Sums all voices into accum, at most max_frames
+static uint32 synth_render(Synth *synth, uint32 frames) {
+  if (frames > synth->max_frames)
+    frames = synth->max_frames;
+  memset(synth->accum, 0, frames * sizeof(int32));
+  for (int i = 0; i < SYNTH_VOICES; ++i)
+    if (synth->voices[i].active)
+      render_voice(&synth->voices[i], synth->accum, frames);
+  return frames;
+}
+
+void synth_mix_s16(Synth *synth, int16 *out, uint32 frames, int channels) {
+  while (frames > 0 && synth_playing(synth)) {
+    uint32 n = synth_render(synth, frames);
+    for (uint32 i = 0; i < n; ++i)
+      for (int c = 0; c < channels; ++c, ++out) {
+        int32 s = *out + synth->accum[i];
+        *out = (int16)(s > 32767 ? 32767 : s < -32768 ? -32768 : s);
+      }
+    frames -= n;
+  }
+}
+
+void synth_mix_u8(Synth *synth, uint8 *out, uint32 frames) {
+  while (frames > 0 && synth_playing(synth)) {
+    uint32 n = synth_render(synth, frames);
+    for (uint32 i = 0; i < n; ++i, ++out) {
+      int32 s = *out - 128 + (synth->accum[i] >> 8);
+      *out = (uint8)((s > 127 ? 127 : s < -128 ? -128 : s) + 128);
+    }
+    frames -= n;
+  }
+}
+
+/* ---- Presets ---- */
+
+static const char *synth_preset_names[SYNTH_PRESET_COUNT] = {
+    "pickup", "laser", "explosion", "powerup", "hit", "jump", "blip"};
+
+const char *synth_preset_name(SynthPreset preset) {
+  return preset < SYNTH_PRESET_COUNT ? synth_preset_names[preset] : "?";
+}
+
+// From lo to hi, both included
+static int32 rnd(uint32 *seed, int32 lo, int32 hi) {
+  return lo + (int32)(synth_rand(seed) % (uint32)(hi - lo + 1));
+}
+
+void synth_preset(SynthParams *params, SynthPreset preset, uint32 seed) {
+  memset(params, 0, sizeof(*params));
+  seed = seed * 2654435761u + preset;
+  params->wave = SYNTH_WAVE_SQUARE;
+  params->volume = 96;
+  params->duty = 128;
+  params->sustain = 255;
+  switch (preset) {
+  case SYNTH_PRESET_PICKUP:
+    params->freq = rnd(&seed, 700, 1600);
+    params->hold_ms = rnd(&seed, 20, 100);
+    params->release_ms = rnd(&seed, 80, 300);
+    if (rnd(&seed, 0, 1)) {
+      params->arp_ms = rnd(&seed, 40, 100);
+      params->arp_semitones = rnd(&seed, 4, 12);
+    }
+    break;
+  case SYNTH_PRESET_LASER: {
+    static const uint8 waves[] = {SYNTH_WAVE_SQUARE, SYNTH_WAVE_SAW,
+                                  SYNTH_WAVE_SINE};
+    params->wave = waves[rnd(&seed, 0, 2)];
+    params->freq = rnd(&seed, 500, 2000);
+    params->freq_min = params->freq / 8;
+    params->sweep = -rnd(&seed, 4 * 256, 12 * 256);
+    params->duty = rnd(&seed, 64, 192);
+    params->duty_sweep = rnd(&seed, -200, 200);
+    params->hold_ms = rnd(&seed, 50, 150);
+    params->release_ms = rnd(&seed, 50, 250);
+    break;
+  }
+  case SYNTH_PRESET_EXPLOSION:
+    params->wave = SYNTH_WAVE_NOISE;
+    params->volume = 128;
+    params->freq = rnd(&seed, 40, 300);
+    params->sweep = rnd(&seed, -2 * 256, 128);
+    params->decay_ms = rnd(&seed, 50, 150);
+    params->sustain = rnd(&seed, 160, 255);
+    params->hold_ms = rnd(&seed, 50, 200);
+    params->release_ms = rnd(&seed, 200, 600);
+    break;
+  case SYNTH_PRESET_POWERUP:
+    params->wave = rnd(&seed, 0, 1) ? SYNTH_WAVE_SAW : SYNTH_WAVE_SQUARE;
+    params->freq = rnd(&seed, 250, 700);
+    params->sweep = rnd(&seed, 256, 3 * 256);
+    params->duty = rnd(&seed, 96, 160);
+    params->hold_ms = rnd(&seed, 100, 300);
+    params->release_ms = rnd(&seed, 100, 400);
+    if (rnd(&seed, 0, 1)) {
+      params->arp_ms = rnd(&seed, 60, 150);
+      params->arp_semitones = rnd(&seed, 3, 7);
+    }
+    break;
+  case SYNTH_PRESET_HIT: {
+    static const uint8 waves[] = {SYNTH_WAVE_SQUARE, SYNTH_WAVE_SAW,
+                                  SYNTH_WAVE_NOISE};
+    params->wave = waves[rnd(&seed, 0, 2)];
+    params->freq = rnd(&seed, 200, 900);
+    params->freq_min = 40;
+    params->sweep = -rnd(&seed, 6 * 256, 16 * 256);
+    params->hold_ms = rnd(&seed, 10, 50);
+    params->release_ms = rnd(&seed, 80, 200);
+    break;
+  }
+  case SYNTH_PRESET_JUMP:
+    params->freq = rnd(&seed, 250, 550);
+    params->sweep = rnd(&seed, 2 * 256, 5 * 256);
+    params->duty = rnd(&seed, 100, 156);
+    params->hold_ms = rnd(&seed, 50, 150);
+    params->release_ms = rnd(&seed, 80, 200);
+    break;
+  default:
+    params->wave = rnd(&seed, 0, 1) ? SYNTH_WAVE_SINE : SYNTH_WAVE_SQUARE;
+    params->freq = rnd(&seed, 400, 1500);
+    params->hold_ms = rnd(&seed, 30, 80);
+    params->release_ms = rnd(&seed, 10, 60);
+    break;
+  }
+}
@@ -0,0 +1,112 @@
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <stdbool.h>
+
+#include "defs.h"
+
+// Sound effects generated on the fly, in the manner of sfxr: an oscillator
+// with a pitch sweep, a pitch jump and an ADSR envelope. An effect is a
+// SynthParams of a couple dozen bytes instead of its samples.
+//
+// Oscillators read precomputed wavetables (sine, saw, triangle, noise) with
+// a 0.32 fixed-point phase, square waves compare the phase with the duty.
+// Sweeps, the pitch jump and the duty change every SYNTH_TICK_FRAMES frames;
+// in between a sample costs a table read, a multiply and a few adds, with no
+// floating point. Voices add into 32-bit sums that are saturated to the
+// stream buffer like music_mix does.
+
+#define SYNTH_VOICES 8
+#define SYNTH_TICK_FRAMES 64
+#define SYNTH_HOLD_FOREVER 0xFFFF // hold_ms: until synth_release
+#define SYNTH_SWEEP_MAX (16 * 256) // octaves per second
+
+typedef enum SynthWave {
+  SYNTH_WAVE_SQUARE,
+  SYNTH_WAVE_SAW,
+  SYNTH_WAVE_SINE,
+  SYNTH_WAVE_TRIANGLE,
+  SYNTH_WAVE_NOISE,
+  SYNTH_WAVE_COUNT,
+} SynthWave;
+
+typedef enum SynthPreset {
+  SYNTH_PRESET_PICKUP,
+  SYNTH_PRESET_LASER,
+  SYNTH_PRESET_EXPLOSION,
+  SYNTH_PRESET_POWERUP,
+  SYNTH_PRESET_HIT,
+  SYNTH_PRESET_JUMP,
+  SYNTH_PRESET_BLIP,
+  SYNTH_PRESET_COUNT,
+} SynthPreset;
+
+typedef struct SynthParams {
+  uint8 wave;         // SynthWave
+  uint8 volume;       // 0 .. 255
+  uint16 freq;        // Hz at the start
+  uint16 freq_min;    // a falling sweep cuts the sound off below it, or 0
+  int16 sweep;        // 1/256 octaves per second, up to SYNTH_SWEEP_MAX
+  uint16 arp_ms;      // when the pitch jumps, 0 for never
+  int8 arp_semitones; // by how much
+  uint8 duty;         // of a square wave, 128 for half
+  int16 duty_sweep;   // change of the duty per second
+  // Envelope: up to full volume, down to sustain, held, then down to 0
+  uint16 attack_ms;
+  uint16 decay_ms;
+  uint16 hold_ms; // or SYNTH_HOLD_FOREVER
+  uint16 release_ms;
+  uint8 sustain; // 0 .. 255 of full volume
+} SynthParams;
+
+typedef struct SynthVoice {
+  bool active;
+  uint8 wave;
+  uint8 stage; // of the envelope
+  uint32 phase;
+  uint32 step; // 0.32 fractions of a period per frame
+  uint32 step_min;
+  uint32 sweep; // 8.24 factor of step per tick, 0 for none
+  uint32 duty;  // phase where a square wave goes low
+  int32 duty_delta; // per tick
+  uint32 arp_left;  // frames until the jump, 0 if done or none
+  uint32 arp;       // 16.16 factor of step
+  uint32 tick_left; // frames until the next tick
+  // The level is the gain in its top 15 bits, peak and sustain are levels
+  int32 level;
+  int32 level_delta; // per frame
+  uint32 stage_left; // frames
+  int32 peak;
+  int32 sustain;
+  uint32 decay_frames, hold_frames, release_frames;
+} SynthVoice;
+
+typedef struct Synth {
+  SynthVoice voices[SYNTH_VOICES];
+  int32 *accum;
+  uint32 max_frames;
+  unsigned int rate;
+} Synth;
+
+// Builds the wavetables the first time. rate is that of the stream, frames
+// is the size of the internal buffer, longer mixes are done in pieces.
+RESULT synth_init(Synth *synth, uint32 max_frames, unsigned int rate);
+void synth_free(Synth *synth);
+
+// Starts an effect, returns its voice or -1 if all are busy
+int synth_play(Synth *synth, const SynthParams *params);
+// Goes on to the release of the envelope
+void synth_release(Synth *synth, int voice);
+void synth_stop(Synth *synth, int voice);
+bool synth_playing(const Synth *synth);
+
+// Add frames of all voices to signed 16-bit or unsigned 8-bit mono samples,
+// saturating
+void synth_mix_s16(Synth *synth, int16 *out, uint32 frames, int channels);
+void synth_mix_u8(Synth *synth, uint8 *out, uint32 frames);
+
+// A random effect of the kind, the same for the same seed
+void synth_preset(SynthParams *params, SynthPreset preset, uint32 seed);
+const char *synth_preset_name(SynthPreset preset);
+
+#endif // SYNTH_H
@@ -0,0 +1,139 @@
+/*
+ * adpcmenc: converts a sound to IMA ADPCM (see adpcm.h) for the mixer.
+ *
+ * Usage: adpcmenc input.wav|input.voc output.wav
+ * Stereo input is mixed down to mono, the rate is kept. Prints the sizes and
+ * the signal to noise ratio of the decoded sound against the input.
+ */
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../adpcm.h"
+#include "../defs.h"
+#include "../dynarray.h"
+#include "../music.h"
+
+typedef PACKED_STRUCT AdpcmWavHeader {
+  char riff[4];
+  uint32 riff_size;
+  char wave[4];
+  char fmt[4];
+  uint32 fmt_size;
+  uint16 format_tag;
+  uint16 channels;
+  uint32 rate;
+  uint32 byte_rate;
+  uint16 block_align;
+  uint16 bits;
+  uint16 extra_size;
+  uint16 samples_per_block;
+  char fact[4];
+  uint32 fact_size;
+  uint32 samples;
+  char data[4];
+  uint32 data_size;
+}
+AdpcmWavHeader;
+
+// Reads the whole input as mono 16-bit samples
+static RESULT read_input(const char *path, Dynarray *samples, uint32 *rate) {
+  MusicStream music;
+  int16 chunk[1024];
+  if (music_open(&music, path, false) != RES_OK)
+    return RES_ERR;
+  *rate = music.rate;
+  while (!music_finished(&music)) {
+    music_fill(&music);
+    // Interpolation wants the frame after the last one played
+    uint32 n = music.head - music.tail - (music.at_end ? 0 : 1);
+    if (n > 1024)
+      n = 1024;
+    memset(chunk, 0, n * sizeof(int16));
+    music_mix_s16(&music, chunk, n, 1, music.rate);
+    for (uint32 i = 0; i < n; ++i)
+      dynarray_push(samples, &chunk[i]);
+  }
+  music_close(&music);
+  return RES_OK;
+}
+
+int main(int argc, char **argv) {
+  Dynarray samples = make_dynarray(sizeof(int16), 4096);
+  Dynarray blocks = make_dynarray(ADPCM_BLOCK_BYTES, 16);
+  uint32 rate = 0;
+  FILE *out = NULL;
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s input.wav|input.voc output.wav\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  CHECKERR(read_input(argv[1], &samples, &rate) != RES_OK, "Can't read %s\n",
+           argv[1]);
+
+  const int16 *in = (const int16 *)samples.data;
+  uint32 length = samples.len, data_size = 0;
+  int index = 0;
+  double signal = 0, noise = 0;
+  for (uint32 start = 0; start < length; start += ADPCM_BLOCK_SAMPLES) {
+    uint32 count = length - start < ADPCM_BLOCK_SAMPLES ? length - start
+                                                         : ADPCM_BLOCK_SAMPLES;
+    uint8 *block = dynarray_push_inplace(&blocks);
+    int16 decoded[ADPCM_BLOCK_SAMPLES];
+    adpcm_encode_block(in + start, count, block, &index);
+    adpcm_decode_block(block, decoded, count);
+    for (uint32 i = 0; i < count; ++i) {
+      double d = decoded[i] - in[start + i];
+      signal += (double)in[start + i] * in[start + i];
+      noise += d * d;
+    }
+    // The last block is cut after its last sample
+    data_size += count == ADPCM_BLOCK_SAMPLES ? ADPCM_BLOCK_BYTES
+                                              : 4 + count / 2;
+  }
+
+  AdpcmWavHeader header = {{'R', 'I', 'F', 'F'},
+                           sizeof(AdpcmWavHeader) - 8 + data_size +
+                               (data_size & 1),
+                           {'W', 'A', 'V', 'E'},
+                           {'f', 'm', 't', ' '},
+                           20,
+                           ADPCM_WAV_FORMAT,
+                           1,
+                           rate,
+                           (uint32)((unsigned long long)rate *
+                                    ADPCM_BLOCK_BYTES / ADPCM_BLOCK_SAMPLES),
+                           ADPCM_BLOCK_BYTES,
+                           4,
+                           2,
+                           ADPCM_BLOCK_SAMPLES,
+                           {'f', 'a', 'c', 't'},
+                           4,
+                           length,
+                           {'d', 'a', 't', 'a'},
+                           data_size};
+  uint8 pad = 0;
+  out = fopen(argv[2], "wb");
+  CHECKERR(out == NULL, "Can't open %s for writing\n", argv[2]);
+  bool failed = fwrite(&header, sizeof(header), 1, out) != 1 ||
+                fwrite(blocks.data, 1, data_size, out) != data_size ||
+                ((data_size & 1) && fwrite(&pad, 1, 1, out) != 1);
+  failed |= fclose(out) != 0;
+  out = NULL;
+  CHECKERR(failed, "Can't write %s\n", argv[2]);
+
+  printf("%u samples at %u Hz: %u bytes as 16-bit PCM, %u as ADPCM, "
+         "SNR %.1f dB\n",
+         length, rate, length * 2, data_size,
+         noise > 0 ? 10 * log10(signal / noise) : INFINITY);
+  dynarray_free(&samples);
+  dynarray_free(&blocks);
+  return EXIT_SUCCESS;
+onerror:
+  if (out != NULL)
+    fclose(out);
+  dynarray_free(&samples);
+  dynarray_free(&blocks);
+  return EXIT_FAILURE;
+}
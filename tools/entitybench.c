@@ -0,0 +1,91 @@
+/*
+ * entitybench: fills an entity store (see entity_store.h) and times the
+ * timer tick and the removal of dead entities.
+ *
+ * Usage: entitybench [-e entities] [-n rounds]
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../defs.h"
+#include "../entity_store.h"
+
+#define DEFAULT_ENTITIES 10000
+#define DEFAULT_ROUNDS 1000
+#define TIMER_RANGE 64
+#define DEATH_RATE 50 // one in this many entities dies every round
+
+static uint32 bench_rand(uint32 *seed) {
+  *seed = *seed * 1103515245u + 12345u;
+  return *seed >> 8;
+}
+
+// Tops the store up to entities, with random positions and timers
+static void spawn(EntityStore *store, uint32 entities, uint32 *seed) {
+  while (store->count < entities) {
+    EntityHandle handle =
+        entity_spawn(store, ENTITY_PROP, bench_rand(seed) % 256,
+                     bench_rand(seed) % 256);
+    int32 index = entity_index(store, handle);
+    store->timer[index] = bench_rand(seed) % TIMER_RANGE;
+  }
+}
+
+int main(int argc, char **argv) {
+  int entities = DEFAULT_ENTITIES, rounds = DEFAULT_ROUNDS;
+  EntityStore store;
+  EntityHandle *ready = NULL;
+  for (int i = 1; i < argc; i += 2) {
+    CHECKERR(i + 1 >= argc, "Usage: %s [-e entities] [-n rounds]\n", argv[0]);
+    if (strcmp(argv[i], "-e") == 0)
+      entities = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "-n") == 0)
+      rounds = atoi(argv[i + 1]);
+    else
+      CHECKERR(true, "Usage: %s [-e entities] [-n rounds]\n", argv[0]);
+  }
+  CHECKERR(entities < 1 || entities >= ENTITY_MAX || rounds < 1,
+           "Bad number of entities or rounds\n");
+  CHECKERR(entity_store_init(&store, entities) != RES_OK,
+           "Can't make the entity store\n");
+  ready = malloc(entities * sizeof(EntityHandle));
+  OOMERROR(ready);
+
+  uint32 seed = 1;
+  unsigned long long num_ready = 0, num_removed = 0;
+  double tick = 0, remove = 0;
+  for (int round = 0; round < rounds; ++round) {
+    spawn(&store, entities, &seed);
+    clock_t start = clock();
+    uint32 n = entity_store_tick(&store, 1, ready);
+    tick += (double)(clock() - start) / CLOCKS_PER_SEC;
+    num_ready += n;
+    // Ready entities wait again, and some random ones die
+    for (uint32 i = 0; i < n; ++i) {
+      int32 index = entity_index(&store, ready[i]);
+      store.timer[index] = 1 + bench_rand(&seed) % TIMER_RANGE;
+    }
+    for (uint32 i = 0; i < (uint32)entities / DEATH_RATE; ++i)
+      store.health[bench_rand(&seed) % store.count] = 0;
+
+    start = clock();
+    num_removed += entity_store_remove_dead(&store);
+    remove += (double)(clock() - start) / CLOCKS_PER_SEC;
+  }
+  printf("%d entities, %d rounds: %llu ready, %llu removed\n", entities,
+         rounds, num_ready, num_removed);
+  printf("entity_store_tick: %.1f us (%.2f ns per entity), "
+         "entity_store_remove_dead: %.1f us\n",
+         tick * 1e6 / rounds, tick * 1e9 / rounds / entities,
+         remove * 1e6 / rounds);
+  free(ready);
+  entity_store_free(&store);
+  return EXIT_SUCCESS;
+onerror:
+  return EXIT_FAILURE;
+onoom:
+  exit(EXIT_FAILURE);
+}
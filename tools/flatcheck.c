@@ -0,0 +1,129 @@
+/*
+ * flatcheck: decodes GMM maps both into the chunk tree (decode_chunks) and
+ * into the flat pool (decode_chunks_flat), checks that the two agree node
+ * by node and times decoding and freeing each.
+ *
+ * Usage: flatcheck map.gmm...
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../defs.h"
+#include "../gmm_file.h"
+
+static double seconds_since(clock_t start) {
+  return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static bool same_cell(const RiffChunkLevelCell *a,
+                      const RiffChunkLevelCell *b) {
+  if (a->cells_count != b->cells_count || a->row_len != b->row_len)
+    return false;
+  const uint8 *planes_a[GMM_LAYER_COUNT] = {
+      a->floor,      a->floor_orientation, a->floor_color,
+      a->wall_north, a->wall_west,         a->trail};
+  const uint8 *planes_b[GMM_LAYER_COUNT] = {
+      b->floor,      b->floor_orientation, b->floor_color,
+      b->wall_north, b->wall_west,         b->trail};
+  for (int i = 0; i < GMM_LAYER_COUNT; ++i)
+    if (memcmp(planes_a[i], planes_b[i], a->cells_count) != 0)
+      return false;
+  return true;
+}
+
+// Walks the tree in pre-order alongside the flat pool, *index is the flat
+// node that should match the next chunk. Returns the number of mismatches.
+static unsigned int compare(Dynarray *tree, Dynarray *flat, uint32 parent,
+                            uint32 *index) {
+  unsigned int bad = 0;
+  for (unsigned int i = 0; i < dynarray_size(tree); ++i) {
+    GmmChunk *ck = (GmmChunk *)dynarray_get(tree, i);
+    GmmFlatChunk *node = flat_chunk_at(flat, *index);
+    if (node == NULL)
+      return bad + 1;
+    uint32 self = (*index)++;
+    RiffChunkHeader *head = (RiffChunkHeader *)ck;
+    RiffChunkHeader *flat_head = (RiffChunkHeader *)&node->chunk;
+    if (ck->ctype != node->chunk.ctype ||
+        memcmp(head->ckId, flat_head->ckId, 4) != 0 ||
+        head->ckSize != flat_head->ckSize || node->parent != parent) {
+      printf("  node %u (%.4s): header or parent differs\n", self,
+             (const char *)head->ckId);
+      bad++;
+      continue;
+    }
+    if (ck->ctype == GMM_LVL_CELL &&
+        !same_cell(&ck->level_cell_chunk, &node->chunk.level_cell_chunk)) {
+      printf("  node %u: cell layers differ\n", self);
+      bad++;
+    }
+    if (ck->ctype != GMM_LIST)
+      continue;
+    Dynarray *children = &ck->list_chunk.children;
+    if (node->child_count != dynarray_size(children)) {
+      printf("  node %u: %u children, %u in the tree\n", self,
+             node->child_count, dynarray_size(children));
+      bad++;
+    }
+    bad += compare(children, flat, self, index);
+    if (node->subtree_end != *index) {
+      printf("  node %u: subtree ends at %u, should be %u\n", self,
+             node->subtree_end, *index);
+      bad++;
+    }
+  }
+  return bad;
+}
+
+int main(int argc, char **argv) {
+  CHECKERR(argc < 2, "Usage: %s map.gmm...\n", argv[0]);
+  unsigned int failed = 0;
+  for (int i = 1; i < argc; ++i) {
+    FILE *in = fopen(argv[i], "rb");
+    CHECKERR(in == NULL, "Can't open %s\n", argv[i]);
+    Context ctx = {argv[i]};
+    RiffFile riff = read_riff(in, &ctx);
+    fclose(in);
+
+    clock_t start = clock();
+    Dynarray tree = decode_chunks(&riff);
+    double tree_decode = seconds_since(start);
+    start = clock();
+    Dynarray flat = decode_chunks_flat(&riff, 0);
+    double flat_decode = seconds_since(start);
+
+    uint32 index = 0;
+    unsigned int bad = compare(&tree, &flat, GMM_FLAT_NONE, &index);
+    if (index != dynarray_size(&flat)) {
+      printf("  %u nodes in the pool, %u in the tree\n", dynarray_size(&flat),
+             index);
+      bad++;
+    }
+    // The counting pass should have sized the pool exactly
+    if (flat.cap != dynarray_size(&flat) + 1) {
+      printf("  pool capacity %u for %u nodes\n", flat.cap,
+             dynarray_size(&flat));
+      bad++;
+    }
+
+    start = clock();
+    free_chunks(&tree);
+    double tree_free = seconds_since(start);
+    start = clock();
+    free_flat_chunks(&flat);
+    double flat_free = seconds_since(start);
+    free_gmmfile(&riff);
+
+    printf("%s: %u nodes, %s; decode %.2f ms tree, %.2f ms flat; "
+           "free %.2f ms tree, %.2f ms flat\n",
+           argv[i], index, bad ? "MISMATCH" : "ok", tree_decode * 1e3,
+           flat_decode * 1e3, tree_free * 1e3, flat_free * 1e3);
+    failed += bad != 0;
+  }
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+onerror:
+  return EXIT_FAILURE;
+}
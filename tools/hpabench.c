@@ -0,0 +1,109 @@
+/*
+ * hpabench: builds the path planner (see hpa.h) for a GMM map and times
+ * queries between random open cells anywhere in the campaign.
+ *
+ * Usage: hpabench [-n queries] [-c cluster] map.gmm
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../defs.h"
+#include "../gmm_file.h"
+#include "../hpa.h"
+
+#define DEFAULT_QUERIES 2000
+#define DEFAULT_CLUSTER 8
+
+static uint32 bench_rand(uint32 *seed) {
+  *seed = *seed * 1103515245u + 12345u;
+  return *seed >> 8;
+}
+
+// A random open cell, or false after enough tries on a level without any
+static bool random_cell(const HpaGraph *graph, uint32 *seed, HpaPoint *p) {
+  for (int tries = 0; tries < 10000; ++tries) {
+    p->level = bench_rand(seed) % graph->num_levels;
+    const LevelGrid *grid = &graph->levels[p->level].grid;
+    if (grid->rows == 0 || grid->cols == 0)
+      continue;
+    p->row = bench_rand(seed) % grid->rows;
+    p->col = bench_rand(seed) % grid->cols;
+    if (grid_cell_open(grid, p->row, p->col))
+      return true;
+  }
+  return false;
+}
+
+static double seconds_since(clock_t start) {
+  return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char **argv) {
+  int queries = DEFAULT_QUERIES, first = 1;
+  uint16 cluster = DEFAULT_CLUSTER;
+  while (first + 1 < argc && argv[first][0] == '-') {
+    if (strcmp(argv[first], "-n") == 0)
+      queries = atoi(argv[first + 1]);
+    else if (strcmp(argv[first], "-c") == 0)
+      cluster = atoi(argv[first + 1]);
+    else
+      break;
+    first += 2;
+  }
+  CHECKERR(argc - first != 1, "Usage: %s [-n queries] [-c cluster] map.gmm\n",
+           argv[0]);
+  FILE *in = fopen(argv[first], "rb");
+  CHECKERR(in == NULL, "Can't open %s\n", argv[first]);
+  Context ctx = {argv[first]};
+  RiffFile file = read_riff(in, &ctx);
+  fclose(in);
+  Dynarray chunks = decode_chunks(&file);
+  Dynarray levels = make_dynarray(sizeof(GmmLevel), 8);
+  RiffChunkMapLinks *links = NULL;
+  gmm_collect_levels(&chunks, &levels, &links);
+
+  HpaGraph graph;
+  clock_t start = clock();
+  CHECKERR(hpa_build(&graph, (GmmLevel *)levels.data, levels.len, links,
+                     cluster) != RES_OK,
+           "Can't build the planner for %s\n", argv[first]);
+  double build = seconds_since(start);
+  printf("%u levels, %u clusters, %u nodes, %u edges, built in %.1f ms\n",
+         graph.num_levels, graph.clusters.len, graph.nodes.len,
+         graph.edge_first[graph.nodes.len], build * 1e3);
+
+  HpaPath path;
+  hpa_path_init(&path);
+  uint32 seed = 1;
+  int found = 0, cross_level = 0;
+  double total = 0, worst = 0;
+  for (int i = 0; i < queries; ++i) {
+    HpaPoint from, to;
+    if (!random_cell(&graph, &seed, &from) || !random_cell(&graph, &seed, &to))
+      break;
+    start = clock();
+    if (hpa_find_path(&graph, from, to, &path) == RES_OK) {
+      found++;
+      cross_level += from.level != to.level;
+    }
+    double t = seconds_since(start);
+    total += t;
+    if (t > worst)
+      worst = t;
+  }
+  printf("%d queries, %d found (%d across levels): %.1f us average, "
+         "%.1f us worst\n",
+         queries, found, cross_level, queries ? total * 1e6 / queries : 0.0,
+         worst * 1e6);
+
+  hpa_path_free(&path);
+  hpa_free(&graph);
+  dynarray_free(&levels);
+  free_chunks(&chunks);
+  free_gmmfile(&file);
+  return EXIT_SUCCESS;
+onerror:
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,47 @@
+/*
+ * layerdup: decodes GMM maps with shared cell layers and reports how many
+ * bytes of layers the deduplication saves, per map and for all of them.
+ *
+ * Usage: layerdup map.gmm...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../defs.h"
+#include "../gmm_file.h"
+#include "../layer_cache.h"
+
+int main(int argc, char **argv) {
+  CHECKERR(argc < 2, "Usage: %s map.gmm...\n", argv[0]);
+  // Maps stay decoded, so that layers are shared between them too
+  LayerCacheStats before, after;
+  for (int i = 1; i < argc; ++i) {
+    FILE *in = fopen(argv[i], "rb");
+    CHECKERR(in == NULL, "Can't open %s\n", argv[i]);
+    Context ctx = {argv[i]};
+    RiffFile riff = read_riff(in, &ctx);
+    fclose(in);
+    layer_cache_stats(&before);
+    decode_chunks_with_flags(&riff, GMM_DECODE_SHARE_LAYERS);
+    layer_cache_stats(&after);
+    size_t wanted = after.bytes_wanted - before.bytes_wanted;
+    size_t stored = after.bytes_stored - before.bytes_stored;
+    printf("%s: %u layers, %u new unique, %lu bytes, %lu stored, "
+           "%lu saved\n",
+           argv[i], after.interned - before.interned,
+           after.unique - before.unique, (unsigned long)wanted,
+           (unsigned long)stored, (unsigned long)(wanted - stored));
+  }
+  printf("total: %u layers, %u unique, %lu bytes, %lu stored, %lu saved "
+         "(%.1f%%)\n",
+         after.interned, after.unique, (unsigned long)after.bytes_wanted,
+         (unsigned long)after.bytes_stored,
+         (unsigned long)(after.bytes_wanted - after.bytes_stored),
+         after.bytes_wanted
+             ? 100.0 * (after.bytes_wanted - after.bytes_stored) /
+                   after.bytes_wanted
+             : 0.0);
+  return EXIT_SUCCESS;
+onerror:
+  return EXIT_FAILURE;
+}
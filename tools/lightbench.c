@@ -0,0 +1,129 @@
+/*
+ * lightbench: times the light map (see light_map.h) on a generated level:
+ * lighting it from scratch, moving single lights and opening and closing
+ * doors, each change applied incrementally.
+ *
+ * Usage: lightbench [-s size] [-l lights] [-n changes]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../defs.h"
+#include "../light_map.h"
+
+#define DEFAULT_SIZE 256
+#define DEFAULT_LIGHTS 300
+#define DEFAULT_CHANGES 2000
+#define LIGHT_INTENSITY 12
+
+typedef struct Light {
+  uint16 row;
+  uint16 col;
+} Light;
+
+static uint32 bench_rand(uint32 *seed) {
+  *seed = *seed * 1103515245u + 12345u;
+  return *seed >> 8;
+}
+
+static double seconds_since(clock_t start) {
+  return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char **argv) {
+  int size = DEFAULT_SIZE, num_lights = DEFAULT_LIGHTS;
+  int changes = DEFAULT_CHANGES;
+  for (int i = 1; i < argc; i += 2) {
+    CHECKERR(i + 1 >= argc, "Usage: %s [-s size] [-l lights] [-n changes]\n",
+             argv[0]);
+    if (strcmp(argv[i], "-s") == 0)
+      size = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "-l") == 0)
+      num_lights = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "-n") == 0)
+      changes = atoi(argv[i + 1]);
+    else
+      CHECKERR(true, "Usage: %s [-s size] [-l lights] [-n changes]\n",
+               argv[0]);
+  }
+  CHECKERR(size < 2 || size > 4096 || num_lights < 1,
+           "Bad size or number of lights\n");
+
+  // Rooms of 8x8 cells with a door or an archway in most of their walls
+  uint32 stride = size + 1, cells = stride * stride, seed = 1;
+  uint8 *floor = calloc(cells, 1), *north = calloc(cells, 1);
+  uint8 *west = calloc(cells, 1);
+  Light *lights = malloc(num_lights * sizeof(Light));
+  OOMERROR(floor);
+  OOMERROR(north);
+  OOMERROR(west);
+  OOMERROR(lights);
+  for (int r = 0; r <= size; ++r)
+    for (int c = 0; c <= size; ++c) {
+      uint32 i = r * stride + c;
+      floor[i] = r < size && c < size;
+      if (r % 8 == 0 || r == size)
+        north[i] = bench_rand(&seed) % 4 ? GMM_WALL_WALL : GMM_WALL_DOOR;
+      if (c % 8 == 0 || c == size)
+        west[i] = bench_rand(&seed) % 4 ? GMM_WALL_WALL : GMM_WALL_ARCHWAY;
+    }
+  LevelGrid grid = {size, size, stride, floor, north, west};
+  LightMap map;
+  CHECKERR(light_map_init(&map, &grid) != RES_OK, "Can't make the light map\n");
+
+  clock_t start = clock();
+  for (int i = 0; i < num_lights; ++i) {
+    lights[i].row = bench_rand(&seed) % size;
+    lights[i].col = bench_rand(&seed) % size;
+    light_map_set_source(&map, lights[i].row, lights[i].col, LIGHT_INTENSITY);
+  }
+  double build = seconds_since(start);
+  printf("%dx%d level, %d lights of %d: lit in %.2f ms\n", size, size,
+         num_lights, LIGHT_INTENSITY, build * 1e3);
+
+  start = clock();
+  for (int i = 0; i < changes; ++i) {
+    Light *light = &lights[bench_rand(&seed) % num_lights];
+    light_map_set_source(&map, light->row, light->col, 0);
+    light->row = (light->row + bench_rand(&seed) % 5 + size - 2) % size;
+    light->col = (light->col + bench_rand(&seed) % 5 + size - 2) % size;
+    light_map_set_source(&map, light->row, light->col, LIGHT_INTENSITY);
+  }
+  double moves = seconds_since(start);
+
+  start = clock();
+  for (int i = 0; i < changes; ++i) {
+    // A door on a room's north wall, shut and opened again
+    uint16 row = 8 * (1 + bench_rand(&seed) % ((size - 1) / 8));
+    uint16 col = bench_rand(&seed) % size;
+    uint8 *wall = &north[row * stride + col];
+    uint8 old = *wall;
+    *wall = old == GMM_WALL_NONE ? GMM_WALL_WALL : GMM_WALL_NONE;
+    light_map_edge_changed(&map, row, col, DIR_NORTH);
+    *wall = old;
+    light_map_edge_changed(&map, row, col, DIR_NORTH);
+  }
+  double doors = seconds_since(start);
+
+  start = clock();
+  light_map_clear(&map);
+  for (int i = 0; i < num_lights; ++i)
+    light_map_set_source(&map, lights[i].row, lights[i].col, LIGHT_INTENSITY);
+  double rebuild = seconds_since(start);
+
+  printf("moving a light: %.1f us, toggling a wall: %.1f us, "
+         "relighting everything: %.2f ms\n",
+         moves * 1e6 / changes, doors * 1e6 / (2 * changes), rebuild * 1e3);
+  light_map_free(&map);
+  free(lights);
+  free(floor);
+  free(north);
+  free(west);
+  return EXIT_SUCCESS;
+onerror:
+  return EXIT_FAILURE;
+onoom:
+  exit(EXIT_FAILURE);
+}
@@ -0,0 +1,283 @@
+/*
+ * mixbench: plays looping voices through the mixer (see mixer.h) into the
+ * null stream backend and measures the CPU time a voice costs.
+ *
+ * Usage: mixbench [-q | -a] [-8] [-i nearest|linear|polyphase] [-s seconds]
+ *
+ * The stream is 16-bit stereo, or 8-bit mono with -8 as on a Sound Blaster
+ * before the SB16. Voices play 22 kHz samples at slightly different pitches,
+ * so that every one of them interpolates.
+ *
+ * With -q a tone recorded at 11025 and 22050 Hz is played in every mode and
+ * compared with the exact tone at the output rate, next to the same tone
+ * converted to 44100 Hz beforehand. It prints the signal to noise ratio, the
+ * cost of a voice and the memory of a second of the sample.
+ *
+ * With -a the 22050 Hz tone plays from 8-bit samples and from IMA ADPCM (see
+ * adpcm.h), and the cost of a voice is printed for both with the memory.
+ */
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../adpcm.h"
+#include "../defs.h"
+#include "../mixer.h"
+#include "../stream.h"
+
+#define OUTPUT_RATE 44100
+#define SAMPLE_RATE 22050
+#define SAMPLE_LENGTH 4096
+#define DEFAULT_SECONDS 20
+#define USAGE                                                                  \
+  "Usage: %s [-q | -a] [-8] [-i nearest|linear|polyphase] [-s seconds]\n"
+#define QUALITY_VOICES 8
+#define TONE_AMPLITUDE 100 // of the int8 samples
+#define MAX_LAG 3          // frames searched for the best alignment
+
+static const char *interp_names[] = {"nearest", "linear", "polyphase"};
+
+static uint32 bench_rand(uint32 *seed) {
+  *seed = *seed * 1103515245u + 12345u;
+  return *seed >> 8;
+}
+
+// Renders frames into the stream, returns the CPU time it took
+static double render(Mixer *mixer, unsigned long long frames) {
+  StreamFormat format;
+  StreamGetFormat(&format);
+  clock_t start = clock();
+  while (frames > 0) {
+    size_t len;
+    unsigned char *buf = StreamBuf(&len);
+    if (buf == NULL)
+      continue;
+    uint32 n = len / (format.bits / 8 * format.channels);
+    if (format.bits == 16)
+      mixer_render_s16(mixer, (int16 *)buf, n, format.channels);
+    else
+      mixer_render(mixer, buf, n);
+    StreamReady();
+    frames -= n < frames ? n : frames;
+  }
+  return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+// Whole numbers of periods per second, so that a second loops cleanly
+static double tone(double t) {
+  return 0.6 * sin(2 * M_PI * 440 * t) + 0.3 * sin(2 * M_PI * 1870 * t);
+}
+
+static int8 *make_tone(uint32 rate) {
+  int8 *samples = malloc(rate);
+  OOMERROR(samples);
+  for (uint32 i = 0; i < rate; ++i)
+    samples[i] = (int8)lrint(TONE_AMPLITUDE * tone((double)i / rate));
+  return samples;
+onoom:
+  exit(EXIT_FAILURE);
+}
+
+// Signal to noise ratio in dB of a second of the looping tone against the
+// exact one, at the best alignment
+static double tone_snr(Mixer *mixer, const int8 *samples, uint32 rate,
+                       MixInterp interp) {
+  static int16 out[OUTPUT_RATE];
+  int voice = mixer_play(mixer, samples, rate, mixer_step(rate, OUTPUT_RATE),
+                         MIXER_VOLUME_MAX, 0, rate);
+  mixer_set_interp(mixer, voice, interp);
+  for (uint32 done = 0; done < OUTPUT_RATE; done += STREAM_CHUNK_FRAMES) {
+    uint32 n = OUTPUT_RATE - done;
+    mixer_render_s16(mixer, out + done,
+                     n < STREAM_CHUNK_FRAMES ? n : STREAM_CHUNK_FRAMES, 1);
+  }
+  mixer_stop(mixer, voice);
+
+  double best = -1000;
+  for (int lag = -MAX_LAG; lag <= MAX_LAG; ++lag) {
+    double signal = 0, noise = 0;
+    for (int i = MAX_LAG; i < OUTPUT_RATE - MAX_LAG; ++i) {
+      double exact = TONE_AMPLITUDE * MIXER_VOLUME_MAX *
+                     tone((double)(i + lag) / OUTPUT_RATE);
+      signal += exact * exact;
+      noise += (out[i] - exact) * (out[i] - exact);
+    }
+    double snr = noise > 0 ? 10 * log10(signal / noise) : 1000;
+    if (snr > best)
+      best = snr;
+  }
+  return best;
+}
+
+// Compares the modes on the tone, see the top of the file
+static void quality(Mixer *mixer, int seconds) {
+  static const uint32 rates[] = {OUTPUT_RATE, 22050, 11025};
+  unsigned long long frames = (unsigned long long)seconds * OUTPUT_RATE;
+  double base = render(mixer, frames);
+  printf("%d voices, %d s of sound per run\n", QUALITY_VOICES, seconds);
+  printf("source  mode        SNR dB  ns per voice and frame  bytes per s\n");
+  for (int r = 0; r < 3; ++r) {
+    int8 *samples = make_tone(rates[r]);
+    for (int interp = 0; interp <= MIXER_INTERP_POLYPHASE; ++interp) {
+      double snr = tone_snr(mixer, samples, rates[r], interp);
+      int voices[QUALITY_VOICES];
+      for (int v = 0; v < QUALITY_VOICES; ++v) {
+        voices[v] = mixer_play(mixer, samples, rates[r],
+                               mixer_step(rates[r], OUTPUT_RATE),
+                               MIXER_VOLUME_MAX / QUALITY_VOICES, 0,
+                               rates[r]);
+        mixer_set_interp(mixer, voices[v], interp);
+      }
+      double t = render(mixer, frames);
+      for (int v = 0; v < QUALITY_VOICES; ++v)
+        mixer_stop(mixer, voices[v]);
+      printf("%6u  %-10s  %6.1f  %22.2f  %11u\n", rates[r],
+             rates[r] == OUTPUT_RATE ? "converted" : interp_names[interp],
+             snr, (t - base) * 1e9 / QUALITY_VOICES / frames, rates[r]);
+      // A step of 1 doesn't interpolate, one mode says it all
+      if (rates[r] == OUTPUT_RATE)
+        break;
+    }
+    free(samples);
+  }
+}
+
+// The tone of make_tone in 16 bits, encoded like adpcmenc does
+static void make_adpcm_tone(AdpcmSound *sound, uint32 rate) {
+  uint32 blocks = (rate + ADPCM_BLOCK_SAMPLES - 1) / ADPCM_BLOCK_SAMPLES;
+  int16 *pcm = malloc(rate * sizeof(int16));
+  OOMERROR(pcm);
+  sound->data = malloc(blocks * ADPCM_BLOCK_BYTES);
+  OOMERROR(sound->data);
+  for (uint32 i = 0; i < rate; ++i)
+    pcm[i] = (int16)lrint(TONE_AMPLITUDE * 256 * tone((double)i / rate));
+  int index = 0;
+  for (uint32 b = 0; b < blocks; ++b) {
+    uint32 start = b * ADPCM_BLOCK_SAMPLES;
+    uint32 count = rate - start < ADPCM_BLOCK_SAMPLES ? rate - start
+                                                      : ADPCM_BLOCK_SAMPLES;
+    adpcm_encode_block(pcm + start, count,
+                       sound->data + b * ADPCM_BLOCK_BYTES, &index);
+  }
+  sound->data_size = blocks * ADPCM_BLOCK_BYTES;
+  sound->length = rate;
+  sound->rate = rate;
+  free(pcm);
+  return;
+onoom:
+  exit(EXIT_FAILURE);
+}
+
+static void stop_all(Mixer *mixer) {
+  for (int v = 0; v < MIXER_VOICES; ++v)
+    mixer_stop(mixer, v);
+}
+
+// Compares PCM and ADPCM voices, see the top of the file
+static void adpcm_cost(Mixer *mixer, int seconds) {
+  int8 *pcm = make_tone(SAMPLE_RATE);
+  AdpcmSound sound;
+  make_adpcm_tone(&sound, SAMPLE_RATE);
+  uint32 step = mixer_step(SAMPLE_RATE, OUTPUT_RATE);
+  unsigned long long frames = (unsigned long long)seconds * OUTPUT_RATE;
+  double base = render(mixer, frames);
+  printf("%s, %d s of sound per run\n", interp_names[mixer->interp], seconds);
+  printf("a second of the sample: %u bytes of 16-bit PCM, %u of 8-bit PCM, "
+         "%u of ADPCM\n",
+         SAMPLE_RATE * 2, SAMPLE_RATE, sound.data_size);
+  printf("voices  ns per voice and frame: PCM  ADPCM\n");
+  for (int voices = 1; voices <= MIXER_VOICES; voices *= 2) {
+    for (int v = 0; v < voices; ++v)
+      mixer_play(mixer, pcm, SAMPLE_RATE, step, MIXER_VOLUME_MAX / voices, 0,
+                 SAMPLE_RATE);
+    double t_pcm = render(mixer, frames);
+    stop_all(mixer);
+    for (int v = 0; v < voices; ++v)
+      mixer_play_adpcm(mixer, &sound, step, MIXER_VOLUME_MAX / voices, 0,
+                       SAMPLE_RATE);
+    double t_adpcm = render(mixer, frames);
+    stop_all(mixer);
+    printf("%6d  %27.2f  %5.2f\n", voices,
+           (t_pcm - base) * 1e9 / voices / frames,
+           (t_adpcm - base) * 1e9 / voices / frames);
+  }
+  adpcm_free(&sound);
+  free(pcm);
+}
+
+int main(int argc, char **argv) {
+  int bits = 16, channels = 2, seconds = DEFAULT_SECONDS;
+  char mode = 0;
+  MixInterp interp = MIXER_INTERP_LINEAR;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-q") == 0 || strcmp(argv[i], "-a") == 0) {
+      mode = argv[i][1];
+      continue;
+    }
+    if (strcmp(argv[i], "-8") == 0) {
+      bits = 8;
+      channels = 1;
+      continue;
+    }
+    CHECKERR(i + 1 >= argc, USAGE, argv[0]);
+    if (strcmp(argv[i], "-s") == 0) {
+      seconds = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-i") == 0) {
+      ++i;
+      interp = 0;
+      while (interp <= MIXER_INTERP_POLYPHASE &&
+             strcmp(argv[i], interp_names[interp]) != 0)
+        interp++;
+      CHECKERR(interp > MIXER_INTERP_POLYPHASE, "Unknown mode %s\n", argv[i]);
+    } else {
+      CHECKERR(true, USAGE, argv[0]);
+    }
+  }
+  CHECKERR(seconds < 1, "Bad number of seconds\n");
+
+  static int8 samples[SAMPLE_LENGTH];
+  uint32 seed = 1;
+  for (int i = 0; i < SAMPLE_LENGTH; ++i)
+    samples[i] = (int8)(bench_rand(&seed) & 0xFF) / 4;
+
+  Mixer mixer;
+  CHECKERR(mixer_init(&mixer, STREAM_CHUNK_FRAMES) != RES_OK,
+           "Can't start the mixer\n");
+  mixer.interp = interp;
+  stream_use_null(bits, channels, STREAM_CLOCK_FAST);
+  StreamStart(OUTPUT_RATE);
+  if (mode == 'q')
+    quality(&mixer, seconds);
+  else if (mode == 'a')
+    adpcm_cost(&mixer, seconds);
+  if (mode != 0) {
+    StreamStop();
+    mixer_free(&mixer);
+    return EXIT_SUCCESS;
+  }
+
+  unsigned long long frames = (unsigned long long)seconds * OUTPUT_RATE;
+  double base = render(&mixer, frames);
+  printf("%d-bit %s, %s, %d s of sound per run\n", bits,
+         channels == 2 ? "stereo" : "mono", interp_names[interp], seconds);
+  printf("voices  ms per s  ns per voice and frame\n");
+  printf("%6d  %8.2f\n", 0, base * 1e3 / seconds);
+  int playing = 0;
+  for (int voices = 1; voices <= MIXER_VOICES; voices *= 2) {
+    for (; playing < voices; ++playing)
+      mixer_play(&mixer, samples, SAMPLE_LENGTH,
+                 mixer_step(SAMPLE_RATE + 37 * playing, OUTPUT_RATE),
+                 MIXER_VOLUME_MAX / MIXER_VOICES, 0, SAMPLE_LENGTH);
+    double t = render(&mixer, frames);
+    printf("%6d  %8.2f  %8.2f\n", voices, t * 1e3 / seconds,
+           (t - base) * 1e9 / voices / frames);
+  }
+  StreamStop();
+  mixer_free(&mixer);
+  return EXIT_SUCCESS;
+onerror:
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,128 @@
+/*
+ * mkpack: builds an asset pack (see pack.h) out of loose files.
+ *
+ * Usage: mkpack [-a align] output.pak file...
+ * Assets are named by the path given on the command line.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "../defs.h"
+#include "../pack.h"
+
+typedef struct InputFile {
+  const char *name;
+  PackEntry entry;
+} InputFile;
+
+static int compare_inputs(const void *a, const void *b) {
+  const InputFile *x = a, *y = b;
+  if (x->entry.name_hash != y->entry.name_hash)
+    return x->entry.name_hash < y->entry.name_hash ? -1 : 1;
+  return pack_compare_names(x->name, y->name);
+}
+
+static long file_size(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (f == NULL)
+    return -1;
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fclose(f);
+  return size;
+}
+
+static RESULT copy_file(FILE *out, const char *path) {
+  char buffer[16384];
+  size_t n;
+  FILE *in = fopen(path, "rb");
+  CHECKERR(in == NULL, "Can't open %s\n", path);
+  while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0)
+    CHECKERR(fwrite(buffer, 1, n, out) != n, "Can't write asset %s\n", path);
+  fclose(in);
+  return RES_OK;
+onerror:
+  if (in)
+    fclose(in);
+  return RES_ERR;
+}
+
+int main(int argc, char **argv) {
+  uint16 align_log2 = 4;
+  int first = 1;
+  FILE *out = NULL;
+  InputFile *inputs = NULL;
+
+  if (argc > 2 && strcmp(argv[1], "-a") == 0) {
+    int align = atoi(argv[2]);
+    align_log2 = 0;
+    while ((1 << align_log2) < align)
+      align_log2++;
+    first = 3;
+  }
+  CHECKERR(argc - first < 2, "Usage: %s [-a align] output.pak file...\n",
+           argv[0]);
+  const char *out_name = argv[first];
+  uint32 num_inputs = argc - first - 1;
+  inputs = calloc(num_inputs, sizeof(InputFile));
+  OOMERROR(inputs);
+
+  uint32 names_size = 0;
+  for (uint32 i = 0; i < num_inputs; ++i) {
+    inputs[i].name = argv[first + 1 + i];
+    long size = file_size(inputs[i].name);
+    CHECKERR(size < 0, "Can't open %s\n", inputs[i].name);
+    inputs[i].entry.name_hash = pack_hash_name(inputs[i].name);
+    inputs[i].entry.size = size;
+    inputs[i].entry.align_log2 = align_log2;
+    names_size += strlen(inputs[i].name) + 1;
+  }
+  qsort(inputs, num_inputs, sizeof(InputFile), compare_inputs);
+
+  // Lay out names and data
+  uint32 align = 1u << align_log2;
+  uint32 pos = sizeof(PackHeader) + sizeof(PackEntry) * num_inputs + names_size;
+  uint32 name_pos = 0;
+  for (uint32 i = 0; i < num_inputs; ++i) {
+    CHECKERR(i > 0 && compare_inputs(&inputs[i - 1], &inputs[i]) == 0,
+             "%s is given twice\n", inputs[i].name);
+    inputs[i].entry.name_offset = name_pos;
+    name_pos += strlen(inputs[i].name) + 1;
+    pos = (pos + align - 1) & ~(align - 1);
+    inputs[i].entry.offset = pos;
+    pos += inputs[i].entry.size;
+  }
+
+  out = fopen(out_name, "wb");
+  CHECKERR(out == NULL, "Can't create %s\n", out_name);
+  PackHeader header;
+  memcpy(header.magic, PACK_MAGIC, 4);
+  header.version = PACK_VERSION;
+  header.reserved = 0;
+  header.num_entries = num_inputs;
+  header.names_size = names_size;
+  fwrite(&header, sizeof(header), 1, out);
+  for (uint32 i = 0; i < num_inputs; ++i)
+    fwrite(&inputs[i].entry, sizeof(PackEntry), 1, out);
+  for (uint32 i = 0; i < num_inputs; ++i)
+    fwrite(inputs[i].name, 1, strlen(inputs[i].name) + 1, out);
+  for (uint32 i = 0; i < num_inputs; ++i) {
+    while ((uint32)ftell(out) < inputs[i].entry.offset)
+      fputc(0, out);
+    CHECKERR(copy_file(out, inputs[i].name) != RES_OK,
+             "Can't add %s to the pack\n", inputs[i].name);
+    printf("%08x %10u %s\n", inputs[i].entry.name_hash, inputs[i].entry.size,
+           inputs[i].name);
+  }
+  CHECKERR(fclose(out) != 0, "Can't write %s\n", out_name);
+  free(inputs);
+  printf("%u assets, %u bytes\n", num_inputs, pos);
+  return EXIT_SUCCESS;
+onerror:
+  if (out)
+    fclose(out);
+  free(inputs);
+  return EXIT_FAILURE;
+onoom:
+  exit(EXIT_FAILURE);
+}
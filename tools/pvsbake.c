@@ -0,0 +1,108 @@
+/*
+ * pvsbake: bakes the potentially visible sets (see pvs.h) of every level of
+ * a GMM map and reports their size, next to what the GMM cell layer RLE
+ * would make of them with an offset per cell.
+ *
+ * Usage: pvsbake [-r radius] map.gmm output.pvs
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "../defs.h"
+#include "../gmm_file.h"
+#include "../pvs.h"
+#include "../rle_layer.h"
+
+#define DEFAULT_RADIUS 8
+
+int main(int argc, char **argv) {
+  uint16 radius = DEFAULT_RADIUS;
+  int first = 1;
+  FILE *in = NULL, *out = NULL;
+  PvsLevel *baked = NULL;
+  uint16 num_baked = 0;
+
+  if (argc > 2 && strcmp(argv[1], "-r") == 0) {
+    radius = atoi(argv[2]);
+    first = 3;
+  }
+  CHECKERR(argc - first != 2, "Usage: %s [-r radius] map.gmm output.pvs\n",
+           argv[0]);
+  CHECKERR(radius < 1 || radius > PVS_MAX_RADIUS, "Bad radius\n");
+  in = fopen(argv[first], "rb");
+  CHECKERR(in == NULL, "Can't open %s\n", argv[first]);
+  Context ctx = {argv[first]};
+  RiffFile file = read_riff(in, &ctx);
+  fclose(in);
+  in = NULL;
+  Dynarray chunks = decode_chunks(&file);
+  Dynarray levels = make_dynarray(sizeof(GmmLevel), 8);
+  RiffChunkMapLinks *links = NULL;
+  gmm_collect_levels(&chunks, &levels, &links);
+
+  baked = calloc(levels.len ? levels.len : 1, sizeof(PvsLevel));
+  OOMERROR(baked);
+  printf("level  size     cells  open   stored     rle  rle/stored  "
+         "avg visible\n");
+  unsigned long long stored_total = 0, rle_total = 0;
+  for (; num_baked < levels.len; ++num_baked) {
+    LevelGrid grid;
+    GmmLevel *level = (GmmLevel *)dynarray_get(&levels, num_baked);
+    CHECKERR(level_grid_from_level(level, &grid) != RES_OK,
+             "Level %u has no cell layers\n", num_baked);
+    PvsLevel *pvs = &baked[num_baked];
+    CHECKERR(pvs_bake_level(&grid, radius, pvs) != RES_OK,
+             "Can't bake level %u\n", num_baked);
+
+    uint32 window_bytes = pvs_window_bytes(pvs);
+    uint32 num_cells = (uint32)pvs->rows * pvs->cols;
+    uint32 open = 0, visible = 0;
+    // The RLE takes an offset per cell, and closed cells pack to nothing
+    uint32 rle = (num_cells + 1) * sizeof(uint32);
+    uint8 *packed = malloc(2 * window_bytes);
+    OOMERROR(packed);
+    for (uint16 r = 0; r < pvs->rows; ++r)
+      for (uint16 c = 0; c < pvs->cols; ++c) {
+        if (!grid_cell_open(&grid, r, c))
+          continue;
+        open++;
+        const uint8 *window = pvs_cell_window(pvs, r, c);
+        uint32 used = 0;
+        for (uint32 i = 0; i < window_bytes; ++i) {
+          visible += __builtin_popcount(window[i]);
+          if (window[i] != 0)
+            used = i + 1;
+        }
+        rle += rle_encode(window, used, packed);
+      }
+    free(packed);
+    printf("%5u  %3ux%-3u  %5u  %5u  %7u  %6u  %9.1f%%  %11.1f\n",
+           num_baked, pvs->rows, pvs->cols, num_cells, open,
+           pvs_level_bytes(pvs), rle, 100.0 * rle / pvs_level_bytes(pvs),
+           open ? (double)visible / open : 0.0);
+    stored_total += pvs_level_bytes(pvs);
+    rle_total += rle;
+  }
+  printf("total: %llu bytes stored, %llu with the RLE (%.1f%%)\n",
+         stored_total, rle_total,
+         stored_total ? 100.0 * rle_total / stored_total : 0.0);
+
+  out = fopen(argv[first + 1], "wb");
+  CHECKERR(out == NULL, "Can't create %s\n", argv[first + 1]);
+  CHECKERR(pvs_write(out, baked, num_baked) != RES_OK, "Can't write %s\n",
+           argv[first + 1]);
+  CHECKERR(fclose(out) != 0, "Can't write %s\n", argv[first + 1]);
+  for (uint16 i = 0; i < num_baked; ++i)
+    pvs_level_free(&baked[i]);
+  free(baked);
+  dynarray_free(&levels);
+  free_chunks(&chunks);
+  free_gmmfile(&file);
+  return EXIT_SUCCESS;
+onerror:
+  if (out)
+    fclose(out);
+  return EXIT_FAILURE;
+onoom:
+  exit(EXIT_FAILURE);
+}
@@ -0,0 +1,87 @@
+/*
+ * rlebench: decodes GMM maps with byte planes and with run-length layers
+ * (see rle_layer.h) and compares the memory of the chunks with the cost of
+ * a level_cell_get over every cell of every layer.
+ *
+ * Usage: rlebench [-n passes] map.gmm...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../defs.h"
+#include "../gmm_file.h"
+
+#define DEFAULT_PASSES 20
+
+typedef struct Result {
+  size_t bytes;
+  unsigned long long lookups;
+  double seconds;
+  uint32 checksum;
+} Result;
+
+static void run(RiffFile *file, unsigned int flags, int passes,
+                Result *result) {
+  Dynarray chunks = decode_chunks_with_flags(file, flags);
+  Dynarray levels = make_dynarray(sizeof(GmmLevel), 8);
+  RiffChunkMapLinks *links = NULL;
+  gmm_collect_levels(&chunks, &levels, &links);
+  for (unsigned int i = 0; i < chunks.len; ++i)
+    result->bytes += chunk_memory_size((GmmChunk *)dynarray_get(&chunks, i));
+
+  clock_t start = clock();
+  for (int pass = 0; pass < passes; ++pass)
+    for (unsigned int i = 0; i < levels.len; ++i) {
+      GmmLevel *level = (GmmLevel *)dynarray_get(&levels, i);
+      if (level->cell == NULL || level->prop == NULL)
+        continue;
+      for (int layer = 0; layer < GMM_LAYER_COUNT; ++layer)
+        for (uint16 r = 0; r < level->prop->num_rows; ++r)
+          for (uint16 c = 0; c < level->prop->num_columns; ++c)
+            result->checksum = result->checksum * 31 +
+                               level_cell_get(level->cell, layer, r, c);
+      result->lookups += (unsigned long long)GMM_LAYER_COUNT *
+                         level->prop->num_rows * level->prop->num_columns;
+    }
+  result->seconds += (double)(clock() - start) / CLOCKS_PER_SEC;
+  dynarray_free(&levels);
+  free_chunks(&chunks);
+}
+
+static void print_result(const char *name, const Result *result) {
+  printf("%-11s %10lu bytes  %12llu lookups  %7.2f ns/lookup  (%08x)\n", name,
+         (unsigned long)result->bytes, result->lookups,
+         result->lookups ? result->seconds * 1e9 / result->lookups : 0.0,
+         result->checksum);
+}
+
+int main(int argc, char **argv) {
+  int passes = DEFAULT_PASSES, first = 1;
+  Result planes = {0}, rle = {0};
+  if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+    passes = atoi(argv[2]);
+    first = 3;
+  }
+  CHECKERR(first >= argc, "Usage: %s [-n passes] map.gmm...\n", argv[0]);
+  for (int i = first; i < argc; ++i) {
+    FILE *in = fopen(argv[i], "rb");
+    CHECKERR(in == NULL, "Can't open %s\n", argv[i]);
+    Context ctx = {argv[i]};
+    RiffFile file = read_riff(in, &ctx);
+    fclose(in);
+    run(&file, 0, passes, &planes);
+    run(&file, GMM_DECODE_RLE_LAYERS, passes, &rle);
+    free_gmmfile(&file);
+  }
+  print_result("byte planes", &planes);
+  print_result("rle layers", &rle);
+  if (planes.bytes != 0)
+    printf("rle layers take %.1f%% of the memory, lookups cost %.1fx\n",
+           100.0 * rle.bytes / planes.bytes,
+           planes.seconds > 0 ? rle.seconds / planes.seconds : 0.0);
+  return EXIT_SUCCESS;
+onerror:
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,141 @@
+/*
+ * sbunderrun: streams through the simulated Sound Blaster (see sbsim.h) as
+ * DSP 1.x, 2.x and 4.x, first with a producer that keeps up and then with
+ * one that falls behind. Checks that the underrun shows in
+ * StreamSilentBlocks while the DSP never reads a masked DMA channel, and
+ * prints the interrupt handler time and latency of each DSP.
+ *
+ * Usage: sbunderrun [-s seconds]
+ *
+ * The slow producer only delivers a slot every SLOW_FACTOR slot times. It
+ * runs until the ring of the driver is empty and the first silent block
+ * plays, then for seconds more.
+ */
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../defs.h"
+#include "../sb.h"
+#include "../stream.h"
+
+#define RATE 22050
+#define DEFAULT_SECONDS 1.0
+#define KEEP_UP_SECONDS 0.5
+#define DRAIN_SECONDS 10.0 // to empty the ring, at most
+#define SLOW_FACTOR 3
+
+typedef struct DspVersion {
+  unsigned int major;
+  unsigned int minor;
+  const char *name;
+} DspVersion;
+
+// SB 1.5 (single-cycle), SB 2.0 (auto-init) and SB16 (16-bit stereo)
+static const DspVersion versions[] = {
+    {1, 5, "1.x"}, {2, 1, "2.x"}, {4, 5, "4.x"}};
+#define NUM_VERSIONS (sizeof(versions) / sizeof(versions[0]))
+
+typedef struct RunResult {
+  StreamFormat format;
+  unsigned long keeping_up; // silent blocks
+  unsigned long behind;
+  SbSimStats stats;
+} RunResult;
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Fills slots with silence for the given time, at most one every interval
+// seconds, or until more than silent_limit silent blocks have played. The
+// simulated interrupts come in while we sleep.
+static void produce(double seconds, double interval, int silence,
+                    unsigned long silent_limit) {
+  double end = now_seconds() + seconds, next = 0;
+  for (double t = now_seconds(); t < end; t = now_seconds()) {
+    if (StreamSilentBlocks() > silent_limit)
+      break;
+    size_t len;
+    unsigned char *buf = t >= next ? StreamBuf(&len) : NULL;
+    if (buf != NULL) {
+      memset(buf, silence, len);
+      StreamReady();
+      next = t + interval;
+    } else {
+      struct timespec nap = {0, 1000000};
+      nanosleep(&nap, NULL);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  double seconds = DEFAULT_SECONDS;
+  RunResult results[NUM_VERSIONS];
+  int failed = 0;
+  for (int i = 1; i < argc; i += 2) {
+    CHECKERR(i + 1 >= argc || strcmp(argv[i], "-s") != 0,
+             "Usage: %s [-s seconds]\n", argv[0]);
+    seconds = atof(argv[i + 1]);
+  }
+  CHECKERR(seconds <= 0, "Bad number of seconds\n");
+
+  // sb_init talks, so the table waits until all runs are done
+  for (size_t v = 0; v < NUM_VERSIONS; ++v) {
+    RunResult *run = &results[v];
+    sbsim_set_dsp_version(versions[v].major, versions[v].minor);
+    CHECKERR(!sb_init(), "Can't init the simulated card as DSP %s\n",
+             versions[v].name);
+    stream_use_sb();
+    StreamStart(RATE);
+    StreamGetFormat(&run->format);
+    double slot_time = (double)STREAM_CHUNK_FRAMES / run->format.rate;
+    int silence = run->format.bits == 16 ? 0 : 128;
+    sbsim_reset_stats();
+
+    produce(KEEP_UP_SECONDS, 0, silence, ULONG_MAX);
+    run->keeping_up = StreamSilentBlocks();
+    produce(DRAIN_SECONDS, SLOW_FACTOR * slot_time, silence, run->keeping_up);
+    produce(seconds, SLOW_FACTOR * slot_time, silence, ULONG_MAX);
+    run->behind = StreamSilentBlocks() - run->keeping_up;
+    StreamStop();
+    sbsim_get_stats(&run->stats);
+    sb_cleanup();
+  }
+
+  printf("DSP  format     irqs  handler max  latency max  silent  "
+         "starved  stalled\n");
+  for (size_t v = 0; v < NUM_VERSIONS; ++v) {
+    const RunResult *run = &results[v];
+    printf("%-3s  %2d-bit %s  %5llu  %8.1f us  %8.1f us  %2lu+%-3lu  %7llu  "
+           "%5.0f ms\n",
+           versions[v].name, run->format.bits,
+           run->format.channels == 2 ? "st" : "mo", run->stats.irqs,
+           run->stats.isr_ns_max / 1e3, run->stats.latency_ns_max / 1e3,
+           run->keeping_up, run->behind, run->stats.bytes_starved,
+           run->stats.stall_ns / 1e6);
+  }
+  for (size_t v = 0; v < NUM_VERSIONS; ++v) {
+    const RunResult *run = &results[v];
+    if (run->behind == 0) {
+      printf("  DSP %s: the producer fell behind without silent blocks\n",
+             versions[v].name);
+      failed++;
+    }
+    if (run->stats.bytes_starved != 0) {
+      printf("  DSP %s: the DSP read a masked DMA channel\n",
+             versions[v].name);
+      failed++;
+    }
+  }
+  printf("silent is keeping up + falling behind; %s\n",
+         failed ? "FAILED" : "ok");
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+onerror:
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,153 @@
+/*
+ * trigbench: loads a small trigger program (see trigger_vm.h) with a
+ * counting loop, runs it through the VM and prints the instructions per
+ * second.
+ *
+ * Usage: trigbench [-i iterations] [-n runs]
+ *
+ * The loop is what trigc makes of
+ *   script bench
+ *     push 0
+ *     store 0
+ *     push 0
+ *     store 1
+ *   top:
+ *     load 1
+ *     load 0
+ *     push 31
+ *     mul
+ *     xor
+ *     store 1
+ *     load 0
+ *     push 1
+ *     add
+ *     dup
+ *     store 0
+ *     arg 0
+ *     lt
+ *     jnz top
+ *     load 1
+ *     ret
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../defs.h"
+#include "../pack.h"
+#include "../trigger_vm.h"
+
+#define DEFAULT_ITERATIONS 10000
+#define DEFAULT_RUNS 1000
+#define SCRIPT_NAME "bench"
+#define LOOP_INSTRUCTIONS 14
+#define OTHER_INSTRUCTIONS 6
+
+static uint8 image[256];
+static uint32 image_len;
+
+static void emit(uint8 byte) { image[image_len++] = byte; }
+
+static void emit2(uint8 op, uint8 operand) {
+  emit(op);
+  emit(operand);
+}
+
+// Lays out a program file around the loop above
+static uint32 build_program(void) {
+  TriggerFileHeader header;
+  TriggerScriptEntry entry;
+  uint32 code_start = sizeof(header) + sizeof(entry);
+
+  image_len = code_start;
+  emit2(TOP_PUSH8, 0);
+  emit2(TOP_STORE, 0);
+  emit2(TOP_PUSH8, 0);
+  emit2(TOP_STORE, 1);
+  uint32 top = image_len;
+  emit2(TOP_LOAD, 1);
+  emit2(TOP_LOAD, 0);
+  emit2(TOP_PUSH8, 31);
+  emit(TOP_MUL);
+  emit(TOP_XOR);
+  emit2(TOP_STORE, 1);
+  emit2(TOP_LOAD, 0);
+  emit2(TOP_PUSH8, 1);
+  emit(TOP_ADD);
+  emit(TOP_DUP);
+  emit2(TOP_STORE, 0);
+  emit2(TOP_ARG, 0);
+  emit(TOP_LT);
+  emit(TOP_JNZ);
+  int32 offset = (int32)top - (int32)(image_len + 2);
+  emit(offset & 0xFF);
+  emit((offset >> 8) & 0xFF);
+  emit2(TOP_LOAD, 1);
+  emit(TOP_RET);
+  uint32 code_size = image_len - code_start;
+  memcpy(image + image_len, SCRIPT_NAME, sizeof(SCRIPT_NAME));
+  image_len += sizeof(SCRIPT_NAME);
+
+  memcpy(header.magic, TRIGGER_MAGIC, 4);
+  header.version = TRIGGER_VERSION;
+  header.num_scripts = 1;
+  header.code_size = code_size;
+  header.strings_size = sizeof(SCRIPT_NAME);
+  entry.name_hash = pack_hash_name(SCRIPT_NAME);
+  entry.name_offset = 0;
+  entry.offset = 0;
+  memcpy(image, &header, sizeof(header));
+  memcpy(image + sizeof(header), &entry, sizeof(entry));
+  return image_len;
+}
+
+int main(int argc, char **argv) {
+  int32 iterations = DEFAULT_ITERATIONS;
+  int runs = DEFAULT_RUNS;
+  for (int i = 1; i < argc; i += 2) {
+    CHECKERR(i + 1 >= argc, "Usage: %s [-i iterations] [-n runs]\n", argv[0]);
+    if (strcmp(argv[i], "-i") == 0)
+      iterations = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "-n") == 0)
+      runs = atoi(argv[i + 1]);
+    else
+      CHECKERR(true, "Usage: %s [-i iterations] [-n runs]\n", argv[0]);
+  }
+  CHECKERR(iterations < 1 || runs < 1, "Bad number of iterations or runs\n");
+
+  TriggerProgram program;
+  uint32 size = build_program();
+  CHECKERR(trigger_program_load(&program, image, size) != RES_OK,
+           "The benchmark program doesn't verify\n");
+  const TriggerScriptEntry *script = trigger_find_script(&program, "BENCH");
+  CHECKERR(script == NULL, "Can't find the benchmark script\n");
+  TriggerVm vm;
+  trigger_vm_init(&vm, &program, NULL);
+  vm.jump_limit = iterations + 1;
+
+  // The same sum in C, to check that the VM got it right
+  uint32 expected = 0;
+  for (int32 i = 0; i < iterations; ++i)
+    expected ^= (uint32)i * 31;
+
+  int32 result = 0;
+  clock_t start = clock();
+  for (int i = 0; i < runs; ++i)
+    CHECKERR(trigger_run(&vm, script, &iterations, 1, &result) != RES_OK ||
+                 (uint32)result != expected,
+             "Run %d went wrong\n", i);
+  double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+  double instructions =
+      ((double)iterations * LOOP_INSTRUCTIONS + OTHER_INSTRUCTIONS) * runs;
+  printf("%d runs of %d iterations, %.0f instructions in %.3f s: "
+         "%.1f million per second\n",
+         runs, iterations, instructions, seconds,
+         seconds > 0 ? instructions / seconds / 1e6 : 0.0);
+  trigger_program_free(&program);
+  return EXIT_SUCCESS;
+onerror:
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,346 @@
+/*
+ * trigc: assembles trigger scripts (see trigger_vm.h) into a program file.
+ *
+ * Usage: trigc input.trs output.trg
+ *
+ * Source format, one instruction per line, ';' starts a comment:
+ *   script <custom_id>      starts the script run for that annotation
+ *   <label>:                jump target, local to the script
+ *   push <number>           picks the shortest PUSH8/16/32
+ *   str "text"              pushes the offset of a string
+ *   load/store <var>        global variables 0..255
+ *   arg <n>                 argument n of trigger_run
+ *   jmp/jz/jnz <label>
+ *   call <host function> <argc>
+ * and every other opcode by its name, e.g. "add", "eq", "ret".
+ */
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "../defs.h"
+#include "../dynarray.h"
+#include "../pack.h"
+#include "../trigger_vm.h"
+
+#define MAX_LINE 512
+#define MAX_NAME 64
+
+typedef struct Script {
+  char name[MAX_NAME];
+  TriggerScriptEntry entry;
+} Script;
+
+typedef struct Label {
+  char name[MAX_NAME];
+  uint32 pos;
+} Label;
+
+typedef struct Fixup {
+  char name[MAX_NAME];
+  uint32 operand_pos; // the jump offset is relative to operand_pos + 2
+  int line;
+} Fixup;
+
+#define OP_NAME(name, operand_bytes, pops, pushes) #name,
+static const char *op_names[TOP_COUNT] = {TRIGGER_OPCODES(OP_NAME)};
+#undef OP_NAME
+#define CALL_NAME(name) #name,
+static const char *call_names[TRIGGER_NUM_CALLS] = {
+    TRIGGER_HOST_CALLS(CALL_NAME)};
+#undef CALL_NAME
+
+static Dynarray code, strings, scripts, labels, fixups;
+
+static void emit(uint8 byte) { dynarray_push(&code, &byte); }
+
+static void emit16(int32 value) {
+  emit(value & 0xFF);
+  emit((value >> 8) & 0xFF);
+}
+
+static void emit32(int32 value) {
+  emit16(value & 0xFFFF);
+  emit16((value >> 16) & 0xFFFF);
+}
+
+static int find_name(const char **names, int count, const char *name) {
+  for (int i = 0; i < count; ++i)
+    if (strcasecmp(names[i], name) == 0)
+      return i;
+  return -1;
+}
+
+static int32 add_string(const char *text) {
+  // Reuse an identical string if there is one
+  for (uint32 pos = 0; pos < strings.len; pos += strlen(strings.data + pos) + 1)
+    if (strcmp(strings.data + pos, text) == 0)
+      return pos;
+  int32 pos = strings.len;
+  for (const char *c = text; ; ++c) {
+    dynarray_push(&strings, (void *)c);
+    if (*c == '\0')
+      break;
+  }
+  return pos;
+}
+
+// Patches the jumps of the current script
+static RESULT resolve_labels(void) {
+  for (unsigned i = 0; i < fixups.len; ++i) {
+    Fixup *fix = (Fixup *)dynarray_get(&fixups, i);
+    Label *target = NULL;
+    for (unsigned j = 0; j < labels.len && target == NULL; ++j)
+      if (strcmp(((Label *)dynarray_get(&labels, j))->name, fix->name) == 0)
+        target = (Label *)dynarray_get(&labels, j);
+    CHECKERR(target == NULL, "line %d: unknown label %s\n", fix->line,
+             fix->name);
+    int32 offset = (int32)target->pos - (int32)(fix->operand_pos + 2);
+    CHECKERR(offset < -32768 || offset > 32767, "line %d: jump too far\n",
+             fix->line);
+    code.data[fix->operand_pos] = offset & 0xFF;
+    code.data[fix->operand_pos + 1] = (offset >> 8) & 0xFF;
+  }
+  labels.len = 0;
+  fixups.len = 0;
+  return RES_OK;
+onerror:
+  return RES_ERR;
+}
+
+// Splits off the next word, or a quoted string
+static char *next_token(char **cursor) {
+  char *p = *cursor;
+  while (isspace((unsigned char)*p))
+    p++;
+  if (*p == '\0' || *p == ';')
+    return NULL;
+  char *start = p;
+  if (*p == '"') {
+    start = ++p;
+    while (*p != '\0' && *p != '"')
+      p++;
+  } else {
+    while (*p != '\0' && !isspace((unsigned char)*p))
+      p++;
+  }
+  if (*p != '\0')
+    *p++ = '\0';
+  *cursor = p;
+  return start;
+}
+
+static RESULT parse_number(const char *token, int line, long min, long max,
+                           int32 *out) {
+  char *end;
+  CHECKERR(token == NULL, "line %d: missing operand\n", line);
+  long value = strtol(token, &end, 0);
+  CHECKERR(*end != '\0' || value < min || value > max,
+           "line %d: bad operand %s\n", line, token);
+  *out = value;
+  return RES_OK;
+onerror:
+  return RES_ERR;
+}
+
+static RESULT assemble_line(char *text, int line, bool *in_script) {
+  char *cursor = text;
+  char *word = next_token(&cursor);
+  char *operand;
+  int32 value, argc;
+  if (word == NULL)
+    return RES_OK;
+
+  if (strcmp(word, "script") == 0) {
+    CHECKERR(*in_script && resolve_labels() != RES_OK,
+             "line %d: can't finish the previous script\n", line);
+    operand = next_token(&cursor);
+    CHECKERR(operand == NULL || strlen(operand) >= MAX_NAME,
+             "line %d: script needs a custom id\n", line);
+    Script *script = (Script *)dynarray_push_inplace(&scripts);
+    strcpy(script->name, operand);
+    script->entry.name_hash = pack_hash_name(operand);
+    script->entry.name_offset = add_string(operand);
+    script->entry.offset = code.len;
+    *in_script = true;
+    return RES_OK;
+  }
+  CHECKERR(!*in_script, "line %d: code outside of a script\n", line);
+  size_t len = strlen(word);
+  if (word[len - 1] == ':') {
+    CHECKERR(len > MAX_NAME, "line %d: label too long\n", line);
+    Label *label = (Label *)dynarray_push_inplace(&labels);
+    word[len - 1] = '\0';
+    strcpy(label->name, word);
+    label->pos = code.len;
+    return RES_OK;
+  }
+
+  operand = next_token(&cursor);
+  if (strcasecmp(word, "push") == 0) {
+    CHECKERR(parse_number(operand, line, INT32_MIN, INT32_MAX, &value) !=
+                 RES_OK,
+             "line %d: push needs a number\n", line);
+    if (value >= -128 && value <= 127) {
+      emit(TOP_PUSH8);
+      emit(value & 0xFF);
+    } else if (value >= -32768 && value <= 32767) {
+      emit(TOP_PUSH16);
+      emit16(value);
+    } else {
+      emit(TOP_PUSH32);
+      emit32(value);
+    }
+    return RES_OK;
+  }
+  if (strcasecmp(word, "str") == 0) {
+    CHECKERR(operand == NULL, "line %d: str needs a string\n", line);
+    emit(TOP_PUSH32);
+    emit32(add_string(operand));
+    return RES_OK;
+  }
+
+  int op = find_name(op_names, TOP_COUNT, word);
+  CHECKERR(op < 0, "line %d: unknown instruction %s\n", line, word);
+  CHECKERR(op == TOP_PUSH8 || op == TOP_PUSH16 || op == TOP_PUSH32,
+           "line %d: use push instead of %s\n", line, word);
+  emit(op);
+  switch (op) {
+  case TOP_LOAD:
+  case TOP_STORE:
+    CHECKERR(parse_number(operand, line, 0, TRIGGER_NUM_VARS - 1, &value) !=
+                 RES_OK,
+             "line %d: bad variable\n", line);
+    emit(value);
+    break;
+  case TOP_ARG:
+    CHECKERR(parse_number(operand, line, 0, TRIGGER_MAX_ARGS - 1, &value) !=
+                 RES_OK,
+             "line %d: bad argument index\n", line);
+    emit(value);
+    break;
+  case TOP_JMP:
+  case TOP_JZ:
+  case TOP_JNZ: {
+    CHECKERR(operand == NULL || strlen(operand) >= MAX_NAME,
+             "line %d: jump needs a label\n", line);
+    Fixup *fix = (Fixup *)dynarray_push_inplace(&fixups);
+    strcpy(fix->name, operand);
+    fix->operand_pos = code.len;
+    fix->line = line;
+    emit16(0);
+    break;
+  }
+  case TOP_CALL:
+    CHECKERR(operand == NULL, "line %d: call needs a function\n", line);
+    value = find_name(call_names, TRIGGER_NUM_CALLS, operand);
+    if (value < 0)
+      CHECKERR(parse_number(operand, line, 0, TRIGGER_NUM_CALLS - 1,
+                            &value) != RES_OK,
+               "line %d: unknown host function %s\n", line, operand);
+    CHECKERR(parse_number(next_token(&cursor), line, 0, TRIGGER_STACK_SIZE,
+                          &argc) != RES_OK,
+             "line %d: call needs an argument count\n", line);
+    emit(value);
+    emit(argc);
+    break;
+  default:
+    break;
+  }
+  CHECKERR(next_token(&cursor) != NULL, "line %d: unexpected operand\n",
+           line);
+  return RES_OK;
+onerror:
+  return RES_ERR;
+}
+
+static int compare_scripts(const void *a, const void *b) {
+  const Script *x = a, *y = b;
+  if (x->entry.name_hash != y->entry.name_hash)
+    return x->entry.name_hash < y->entry.name_hash ? -1 : 1;
+  return pack_compare_names(x->name, y->name);
+}
+
+int main(int argc, char **argv) {
+  FILE *in = NULL, *out = NULL;
+  char text[MAX_LINE];
+  int line = 0;
+  bool in_script = false;
+  uint8 *image = NULL;
+
+  CHECKERR(argc != 3, "Usage: %s input.trs output.trg\n", argv[0]);
+  code = make_dynarray(sizeof(uint8), 1024);
+  strings = make_dynarray(sizeof(char), 1024);
+  scripts = make_dynarray(sizeof(Script), 32);
+  labels = make_dynarray(sizeof(Label), 32);
+  fixups = make_dynarray(sizeof(Fixup), 32);
+
+  in = fopen(argv[1], "r");
+  CHECKERR(in == NULL, "Can't open %s\n", argv[1]);
+  while (fgets(text, sizeof(text), in) != NULL) {
+    line++;
+    CHECKERR(assemble_line(text, line, &in_script) != RES_OK,
+             "%s: assembly failed\n", argv[1]);
+  }
+  fclose(in);
+  in = NULL;
+  CHECKERR(in_script && resolve_labels() != RES_OK, "%s: assembly failed\n",
+           argv[1]);
+  CHECKERR(scripts.len == 0, "%s has no scripts\n", argv[1]);
+
+  qsort(scripts.data, scripts.len, sizeof(Script), compare_scripts);
+  for (unsigned i = 1; i < scripts.len; ++i) {
+    Script *a = (Script *)dynarray_get(&scripts, i - 1);
+    Script *b = (Script *)dynarray_get(&scripts, i);
+    CHECKERR(a->entry.name_hash == b->entry.name_hash &&
+                 pack_compare_names(a->name, b->name) == 0,
+             "Scripts %s and %s have the same custom id\n", a->name, b->name);
+  }
+
+  // Build the image in memory and check it with the loader's verifier
+  TriggerFileHeader header;
+  memcpy(header.magic, TRIGGER_MAGIC, 4);
+  header.version = TRIGGER_VERSION;
+  header.num_scripts = scripts.len;
+  header.code_size = code.len;
+  header.strings_size = strings.len;
+  uint32 size = sizeof(header) + scripts.len * sizeof(TriggerScriptEntry) +
+                code.len + strings.len;
+  image = malloc(size);
+  OOMERROR(image);
+  uint8 *pos = image;
+  memcpy(pos, &header, sizeof(header));
+  pos += sizeof(header);
+  for (unsigned i = 0; i < scripts.len; ++i) {
+    Script *script = (Script *)dynarray_get(&scripts, i);
+    memcpy(pos, &script->entry, sizeof(TriggerScriptEntry));
+    pos += sizeof(TriggerScriptEntry);
+  }
+  memcpy(pos, code.data, code.len);
+  memcpy(pos + code.len, strings.data, strings.len);
+  TriggerProgram program;
+  CHECKERR(trigger_program_load(&program, image, size) != RES_OK,
+           "%s doesn't verify\n", argv[1]);
+  trigger_program_free(&program);
+
+  out = fopen(argv[2], "wb");
+  CHECKERR(out == NULL, "Can't create %s\n", argv[2]);
+  CHECKERR(fwrite(image, 1, size, out) != size, "Can't write %s\n", argv[2]);
+  CHECKERR(fclose(out) != 0, "Can't write %s\n", argv[2]);
+  printf("%u scripts, %u bytes of code, %u bytes of strings\n", scripts.len,
+         code.len, strings.len);
+  free(image);
+  return EXIT_SUCCESS;
+onerror:
+  if (in)
+    fclose(in);
+  if (out)
+    fclose(out);
+  free(image);
+  return EXIT_FAILURE;
+onoom:
+  exit(EXIT_FAILURE);
+}
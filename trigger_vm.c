@@ -0,0 +1,345 @@
+/*
+    gmm2json: program that reads Gridmonger's GMM file and converts it into
+   JSON format
+    Copyright (C) 2025 Jagholin (github.com/Jagholin)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see
+   <https://www.gnu.org/licenses/>
+*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pack.h"
+#include "trigger_vm.h"
+
+#define DEFAULT_JUMP_LIMIT 65536
+#define DEPTH_UNKNOWN -1
+
+#define OP_OPERANDS(name, operand_bytes, pops, pushes) operand_bytes,
+#define OP_POPS(name, operand_bytes, pops, pushes) pops,
+#define OP_PUSHES(name, operand_bytes, pops, pushes) pushes,
+static const uint8 op_operand_bytes[TOP_COUNT] = {TRIGGER_OPCODES(OP_OPERANDS)};
+static const uint8 op_pops[TOP_COUNT] = {TRIGGER_OPCODES(OP_POPS)};
+static const uint8 op_pushes[TOP_COUNT] = {TRIGGER_OPCODES(OP_PUSHES)};
+#undef OP_OPERANDS
+#undef OP_POPS
+#undef OP_PUSHES
+
+// Operands are little endian and unaligned
+static inline int16 read16(const uint8 *p) { return (int16)(p[0] | p[1] << 8); }
+
+static inline int32 read32(const uint8 *p) {
+  return (int32)((uint32)p[0] | (uint32)p[1] << 8 | (uint32)p[2] << 16 |
+                 (uint32)p[3] << 24);
+}
+
+static RESULT set_depth(int16 *depth, uint32 *work, uint32 *work_len,
+                        uint32 pc, int16 value) {
+  if (depth[pc] == DEPTH_UNKNOWN) {
+    depth[pc] = value;
+    work[(*work_len)++] = pc;
+  }
+  CHECKERR(depth[pc] != value,
+           "Trigger code at %u is reached with different stack depths\n", pc);
+  return RES_OK;
+onerror:
+  return RES_ERR;
+}
+
+// Follows every path from the start of a script and records the stack depth
+// before each instruction
+static RESULT verify_script(const TriggerProgram *program, uint32 start,
+                            int16 *depth, uint32 *work) {
+  uint32 work_len = 0;
+  const uint8 *code = program->code;
+
+  CHECKERR(set_depth(depth, work, &work_len, start, 0) != RES_OK,
+           "Trigger scripts share code at different stack depths\n");
+  while (work_len > 0) {
+    uint32 pc = work[--work_len];
+    uint8 op = code[pc];
+    CHECKERR(op >= TOP_COUNT, "Unknown trigger opcode %u at %u\n", op, pc);
+    uint32 next = pc + 1 + op_operand_bytes[op];
+    CHECKERR(next > program->code_size, "Truncated trigger opcode at %u\n",
+             pc);
+    int pops = op_pops[op];
+    if (op == TOP_CALL) {
+      CHECKERR(code[pc + 1] >= TRIGGER_NUM_CALLS,
+               "Unknown host function %u at %u\n", code[pc + 1], pc);
+      pops = code[pc + 2];
+    }
+    CHECKERR(op == TOP_ARG && code[pc + 1] >= TRIGGER_MAX_ARGS,
+             "Bad argument index at %u\n", pc);
+    CHECKERR(depth[pc] < pops, "Trigger stack underflow at %u\n", pc);
+    int16 new_depth = depth[pc] - pops + op_pushes[op];
+    CHECKERR(new_depth > TRIGGER_STACK_SIZE, "Trigger stack overflow at %u\n",
+             pc);
+
+    if (op == TOP_HALT || op == TOP_RET)
+      continue;
+    if (op == TOP_JMP || op == TOP_JZ || op == TOP_JNZ) {
+      int32 target = (int32)next + read16(code + pc + 1);
+      CHECKERR(target < 0 || (uint32)target >= program->code_size,
+               "Trigger jump at %u leaves the code\n", pc);
+      CHECKERR(set_depth(depth, work, &work_len, target, new_depth) != RES_OK,
+               "Bad jump at %u\n", pc);
+      if (op == TOP_JMP)
+        continue;
+    }
+    CHECKERR(next >= program->code_size,
+             "Trigger code runs past its end at %u\n", pc);
+    CHECKERR(set_depth(depth, work, &work_len, next, new_depth) != RES_OK,
+             "Bad instruction at %u\n", pc);
+  }
+  return RES_OK;
+onerror:
+  return RES_ERR;
+}
+
+RESULT trigger_program_load(TriggerProgram *program, const uint8 *data,
+                            uint32 size) {
+  TriggerFileHeader header;
+  int16 *depth = NULL;
+  uint32 *work = NULL;
+
+  memset(program, 0, sizeof(TriggerProgram));
+  CHECKERR(size < sizeof(header), "Trigger program is too short\n");
+  memcpy(&header, data, sizeof(header));
+  CHECKERR(strncmp(header.magic, TRIGGER_MAGIC, 4) != 0 ||
+               header.version != TRIGGER_VERSION,
+           "Not a trigger program, or unsupported version\n");
+  uint32 table_size = header.num_scripts * sizeof(TriggerScriptEntry);
+  CHECKERR((uint64_t)sizeof(header) + table_size + header.code_size +
+                   header.strings_size >
+               size,
+           "Trigger program is truncated\n");
+  CHECKERR(header.code_size == 0 ||
+               (header.strings_size > 0 &&
+                data[sizeof(header) + table_size + header.code_size +
+                     header.strings_size - 1] != '\0'),
+           "Corrupt trigger program\n");
+
+  // One block: script table, code, strings
+  uint8 *block = malloc(table_size + header.code_size + header.strings_size);
+  OOMERROR(block);
+  memcpy(block, data + sizeof(header),
+         table_size + header.code_size + header.strings_size);
+  program->num_scripts = header.num_scripts;
+  program->scripts = (TriggerScriptEntry *)block;
+  program->code = block + table_size;
+  program->code_size = header.code_size;
+  program->strings = (char *)program->code + header.code_size;
+  program->strings_size = header.strings_size;
+
+  depth = malloc(header.code_size * sizeof(int16));
+  OOMERROR(depth);
+  work = malloc(header.code_size * sizeof(uint32));
+  OOMERROR(work);
+  for (uint32 i = 0; i < header.code_size; ++i)
+    depth[i] = DEPTH_UNKNOWN;
+  for (uint16 i = 0; i < program->num_scripts; ++i) {
+    const TriggerScriptEntry *script = &program->scripts[i];
+    const char *name = trigger_string(program, script->name_offset);
+    CHECKERR(name == NULL, "Trigger script %u has no name\n", i);
+    if (i > 0) {
+      const TriggerScriptEntry *prev = &program->scripts[i - 1];
+      CHECKERR(prev->name_hash > script->name_hash ||
+                   (prev->name_hash == script->name_hash &&
+                    pack_compare_names(program->strings + prev->name_offset,
+                                       name) >= 0),
+               "Trigger scripts aren't sorted\n");
+    }
+    CHECKERR(script->offset >= program->code_size,
+             "Trigger script %u starts outside of the code\n", i);
+    CHECKERR(verify_script(program, script->offset, depth, work) != RES_OK,
+             "Trigger script %u doesn't verify\n", i);
+  }
+  free(depth);
+  free(work);
+  return RES_OK;
+onerror:
+  free(depth);
+  free(work);
+  trigger_program_free(program);
+  return RES_ERR;
+onoom:
+  exit(EXIT_FAILURE);
+}
+
+void trigger_program_free(TriggerProgram *program) {
+  free(program->scripts);
+  memset(program, 0, sizeof(TriggerProgram));
+}
+
+const TriggerScriptEntry *trigger_find_script(const TriggerProgram *program,
+                                              const char *custom_id) {
+  uint32 hash = pack_hash_name(custom_id);
+  uint32 lo = 0, hi = program->num_scripts;
+  while (lo < hi) {
+    uint32 mid = (lo + hi) >> 1;
+    if (program->scripts[mid].name_hash < hash)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  // Hash collisions are possible, so compare the names too
+  for (; lo < program->num_scripts && program->scripts[lo].name_hash == hash;
+       ++lo)
+    if (pack_compare_names(program->strings + program->scripts[lo].name_offset,
+                           custom_id) == 0)
+      return &program->scripts[lo];
+  return NULL;
+}
+
+const char *trigger_string(const TriggerProgram *program, int32 offset) {
+  if (offset < 0 || (uint32)offset >= program->strings_size)
+    return NULL;
+  if (offset > 0 && program->strings[offset - 1] != '\0')
+    return NULL;
+  return program->strings + offset;
+}
+
+void trigger_vm_init(TriggerVm *vm, const TriggerProgram *program,
+                     void *user) {
+  memset(vm, 0, sizeof(TriggerVm));
+  vm->program = program;
+  vm->user = user;
+  vm->jump_limit = DEFAULT_JUMP_LIMIT;
+}
+
+// Arithmetic wraps around like the 386 does instead of being undefined
+#define WRAP(expr) ((int32)(expr))
+#define BINARY_OP(name, expr)                                                  \
+  op_##name : --sp;                                                            \
+  sp[-1] = (expr);                                                             \
+  NEXT;
+
+RESULT trigger_run(TriggerVm *vm, const TriggerScriptEntry *script,
+                   const int32 *args, uint8 argc, int32 *result) {
+#define OP_LABEL(name, operand_bytes, pops, pushes) &&op_##name,
+  static const void *dispatch[TOP_COUNT] = {TRIGGER_OPCODES(OP_LABEL)};
+#undef OP_LABEL
+// Every handler jumps straight to the next one, there's no central loop
+#define NEXT goto *dispatch[*ip++]
+
+  int32 arg[TRIGGER_MAX_ARGS] = {0};
+  const uint8 *ip = vm->program->code + script->offset;
+  int32 *sp = vm->stack;
+  uint32 jumps_left = vm->jump_limit;
+  int16 offset;
+  int32 tmp;
+
+  for (uint8 i = 0; i < argc && i < TRIGGER_MAX_ARGS; ++i)
+    arg[i] = args[i];
+  NEXT;
+
+op_HALT:
+  *result = 0;
+  return RES_OK;
+op_RET:
+  *result = sp[-1];
+  return RES_OK;
+op_PUSH8:
+  *sp++ = (int8_t)*ip++;
+  NEXT;
+op_PUSH16:
+  *sp++ = read16(ip);
+  ip += 2;
+  NEXT;
+op_PUSH32:
+  *sp++ = read32(ip);
+  ip += 4;
+  NEXT;
+op_POP:
+  --sp;
+  NEXT;
+op_DUP:
+  sp[0] = sp[-1];
+  ++sp;
+  NEXT;
+op_SWAP:
+  tmp = sp[-1];
+  sp[-1] = sp[-2];
+  sp[-2] = tmp;
+  NEXT;
+op_LOAD:
+  *sp++ = vm->vars[*ip++];
+  NEXT;
+op_STORE:
+  vm->vars[*ip++] = *--sp;
+  NEXT;
+op_ARG:
+  *sp++ = arg[*ip++];
+  NEXT;
+  BINARY_OP(ADD, WRAP((uint32)sp[-1] + (uint32)sp[0]))
+  BINARY_OP(SUB, WRAP((uint32)sp[-1] - (uint32)sp[0]))
+  BINARY_OP(MUL, WRAP((uint32)sp[-1] * (uint32)sp[0]))
+  // Division by zero gives 0, and INT32_MIN / -1 wraps around
+  BINARY_OP(DIV, sp[0] == 0    ? 0
+                 : sp[0] == -1 ? WRAP(0u - (uint32)sp[-1])
+                               : sp[-1] / sp[0])
+  BINARY_OP(MOD, sp[0] == 0 || sp[0] == -1 ? 0 : sp[-1] % sp[0])
+op_NEG:
+  sp[-1] = WRAP(0u - (uint32)sp[-1]);
+  NEXT;
+op_NOT:
+  sp[-1] = !sp[-1];
+  NEXT;
+  BINARY_OP(AND, sp[-1] & sp[0])
+  BINARY_OP(OR, sp[-1] | sp[0])
+  BINARY_OP(XOR, sp[-1] ^ sp[0])
+  BINARY_OP(EQ, sp[-1] == sp[0])
+  BINARY_OP(NE, sp[-1] != sp[0])
+  BINARY_OP(LT, sp[-1] < sp[0])
+  BINARY_OP(LE, sp[-1] <= sp[0])
+  BINARY_OP(GT, sp[-1] > sp[0])
+  BINARY_OP(GE, sp[-1] >= sp[0])
+op_JMP:
+  offset = read16(ip);
+  ip += 2;
+  CHECKERR(offset < 0 && --jumps_left == 0, "Trigger script runs too long\n");
+  ip += offset;
+  NEXT;
+op_JZ:
+  offset = read16(ip);
+  ip += 2;
+  if (*--sp == 0) {
+    CHECKERR(offset < 0 && --jumps_left == 0,
+             "Trigger script runs too long\n");
+    ip += offset;
+  }
+  NEXT;
+op_JNZ:
+  offset = read16(ip);
+  ip += 2;
+  if (*--sp != 0) {
+    CHECKERR(offset < 0 && --jumps_left == 0,
+             "Trigger script runs too long\n");
+    ip += offset;
+  }
+  NEXT;
+op_CALL: {
+  TriggerHostFn fn = vm->host[ip[0]];
+  uint8 count = ip[1];
+  ip += 2;
+  sp -= count;
+  *sp = fn ? fn(vm->user, sp, count) : 0;
+  ++sp;
+  NEXT;
+}
+onerror:
+  return RES_ERR;
+#undef NEXT
+}
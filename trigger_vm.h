@@ -0,0 +1,152 @@
+/*
+    gmm2json: program that reads Gridmonger's GMM file and converts it into
+   JSON format
+    Copyright (C) 2025 Jagholin (github.com/Jagholin)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see
+   <https://www.gnu.org/licenses/>
+*/
+#ifndef TRIGGER_VM_H
+#define TRIGGER_VM_H
+
+#include "defs.h"
+
+// Bytecode for cell triggers, compiled by tools/trigc. Scripts are looked up
+// by the custom_id of a CustomIdAnnotation.
+//
+// Programs are verified when loaded: every jump lands on an instruction, and
+// the stack depth is known at every instruction, so the interpreter doesn't
+// check for stack overflow or underflow while it runs.
+
+#define TRIGGER_MAGIC "GTRG"
+#define TRIGGER_VERSION 2
+
+#define TRIGGER_STACK_SIZE 32
+#define TRIGGER_NUM_VARS 256
+#define TRIGGER_MAX_ARGS 4
+
+// X(name, operand bytes, values popped, values pushed).
+// CALL pops as many values as its second operand says.
+#define TRIGGER_OPCODES(X)                                                     \
+  X(HALT, 0, 0, 0)                                                             \
+  X(RET, 0, 1, 0)                                                              \
+  X(PUSH8, 1, 0, 1)                                                            \
+  X(PUSH16, 2, 0, 1)                                                           \
+  X(PUSH32, 4, 0, 1)                                                           \
+  X(POP, 0, 1, 0)                                                              \
+  X(DUP, 0, 1, 2)                                                              \
+  X(SWAP, 0, 2, 2)                                                             \
+  X(LOAD, 1, 0, 1)                                                             \
+  X(STORE, 1, 1, 0)                                                            \
+  X(ARG, 1, 0, 1)                                                              \
+  X(ADD, 0, 2, 1)                                                              \
+  X(SUB, 0, 2, 1)                                                              \
+  X(MUL, 0, 2, 1)                                                              \
+  X(DIV, 0, 2, 1)                                                              \
+  X(MOD, 0, 2, 1)                                                              \
+  X(NEG, 0, 1, 1)                                                              \
+  X(NOT, 0, 1, 1)                                                              \
+  X(AND, 0, 2, 1)                                                              \
+  X(OR, 0, 2, 1)                                                               \
+  X(XOR, 0, 2, 1)                                                              \
+  X(EQ, 0, 2, 1)                                                               \
+  X(NE, 0, 2, 1)                                                               \
+  X(LT, 0, 2, 1)                                                               \
+  X(LE, 0, 2, 1)                                                               \
+  X(GT, 0, 2, 1)                                                               \
+  X(GE, 0, 2, 1)                                                               \
+  X(JMP, 2, 0, 0)                                                              \
+  X(JZ, 2, 1, 0)                                                               \
+  X(JNZ, 2, 1, 0)                                                              \
+  X(CALL, 2, 0, 1)
+
+#define TRIGGER_OP_ENUM(name, operand_bytes, pops, pushes) TOP_##name,
+typedef enum TriggerOp { TRIGGER_OPCODES(TRIGGER_OP_ENUM) TOP_COUNT } TriggerOp;
+#undef TRIGGER_OP_ENUM
+
+// Functions the game provides to scripts, called with CALL id, argc
+#define TRIGGER_HOST_CALLS(X)                                                  \
+  X(MESSAGE)                                                                   \
+  X(SET_WALL)                                                                  \
+  X(SET_FLOOR)                                                                 \
+  X(TELEPORT)                                                                  \
+  X(PLAY_SOUND)                                                                \
+  X(GIVE_ITEM)                                                                 \
+  X(DAMAGE)
+
+#define TRIGGER_CALL_ENUM(name) TRIGGER_CALL_##name,
+typedef enum TriggerCall {
+  TRIGGER_HOST_CALLS(TRIGGER_CALL_ENUM) TRIGGER_NUM_CALLS
+} TriggerCall;
+#undef TRIGGER_CALL_ENUM
+
+typedef PACKED_STRUCT TriggerFileHeader {
+  char magic[4];
+  uint16 version;
+  uint16 num_scripts;
+  uint32 code_size;
+  uint32 strings_size;
+}
+TriggerFileHeader;
+
+// Sorted by name_hash and then name, followed by the code and then the
+// strings
+typedef PACKED_STRUCT TriggerScriptEntry {
+  uint32 name_hash;   // pack_hash_name of the custom id
+  uint32 name_offset; // of the custom id, into the strings
+  uint32 offset;      // into the code
+}
+TriggerScriptEntry;
+
+typedef struct TriggerProgram {
+  uint16 num_scripts;
+  TriggerScriptEntry *scripts;
+  uint8 *code;
+  uint32 code_size;
+  // NUL terminated strings, scripts refer to them by offset
+  char *strings;
+  uint32 strings_size;
+} TriggerProgram;
+
+// Host functions get the popped arguments in push order
+typedef int32 (*TriggerHostFn)(void *user, const int32 *args, uint8 argc);
+
+typedef struct TriggerVm {
+  const TriggerProgram *program;
+  TriggerHostFn host[TRIGGER_NUM_CALLS];
+  void *user;
+  // Backward jumps allowed per run, guards against endless loops
+  uint32 jump_limit;
+  int32 vars[TRIGGER_NUM_VARS];
+  int32 stack[TRIGGER_STACK_SIZE];
+} TriggerVm;
+
+// Copies and verifies a compiled program
+RESULT trigger_program_load(TriggerProgram *program, const uint8 *data,
+                            uint32 size);
+void trigger_program_free(TriggerProgram *program);
+
+// Returns NULL if no script has that custom id
+const TriggerScriptEntry *trigger_find_script(const TriggerProgram *program,
+                                              const char *custom_id);
+// Returns NULL if offset isn't the start of a string
+const char *trigger_string(const TriggerProgram *program, int32 offset);
+
+void trigger_vm_init(TriggerVm *vm, const TriggerProgram *program, void *user);
+// Runs a script to its end. args are read by ARG, the value left by RET is
+// stored in result (0 after HALT).
+RESULT trigger_run(TriggerVm *vm, const TriggerScriptEntry *script,
+                   const int32 *args, uint8 argc, int32 *result);
+
+#endif // TRIGGER_VM_H